@@ -0,0 +1,358 @@
+//
+//  bench.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+/*
+ pipes-bench: runs ./pipes over a sweep of sizes, worker counts, tile
+ grids, backends, transports and kernels on generated inputs. Every
+ configuration gets warm-up runs, then timed trials, and the median and
+ p99 of each phase of pipes --timings are reported as CSV or JSON.
+ With few trials p99 is the nearest rank, the slowest trial.
+ */
+
+#include "globals.h"
+#include <stdint.h>
+
+#define BENCH_LIST_MAX 16   // Values per swept option
+#define BENCH_PHASES 8      // The phases of pipes --timings, then its total and the wall time of the process
+
+// Same order as the --timings line of pipes
+static const char *phase_names[BENCH_PHASES] = {"ingest", "distribute", "multiply", "gather", "svd", "output", "total", "wall"};
+
+// Comma separated values of one swept option
+struct list {
+    int count;
+    char *values[BENCH_LIST_MAX];
+};
+
+enum {
+    OPT_N = 256,
+    OPT_WORKERS,
+    OPT_GRID,
+    OPT_BACKEND,
+    OPT_TRANSPORT,
+    OPT_KERNEL,
+    OPT_TRIALS,
+    OPT_WARMUP,
+    OPT_FORMAT,
+    OPT_PIPES
+};
+
+static const struct option long_options[] = {
+    {"n", required_argument, NULL, OPT_N},
+    {"workers", required_argument, NULL, OPT_WORKERS},
+    {"grid", required_argument, NULL, OPT_GRID},
+    {"backend", required_argument, NULL, OPT_BACKEND},
+    {"transport", required_argument, NULL, OPT_TRANSPORT},
+    {"kernel", required_argument, NULL, OPT_KERNEL},
+    {"trials", required_argument, NULL, OPT_TRIALS},
+    {"warmup", required_argument, NULL, OPT_WARMUP},
+    {"format", required_argument, NULL, OPT_FORMAT},
+    {"pipes", required_argument, NULL, OPT_PIPES},
+    {NULL, 0, NULL, 0}
+};
+
+static void print_usage(void){
+    printf("\nUsage:\n"
+           "./pipes-bench [--n=6,7,8] [--workers=0,...] [--grid=0,PxQ,...] [--backend=fork,threads]\n"
+           "              [--transport=pipe,shm] [--kernel=auto,scalar,...] [--trials=5] [--warmup=1]\n"
+           "              [--format=csv|json] [--pipes=./pipes] [-- extra pipes arguments]\n"
+           "Workers and grid 0 leave the choice to pipes. Threads run with the pipe transport only.\n");
+}
+
+// Splits a comma separated option value in place
+static int parse_list(struct list *list, char *text){
+    list->count = 0;
+    for(char *value = strtok(text, ","); value != NULL; value = strtok(NULL, ",")){
+        if(list->count == BENCH_LIST_MAX){
+            fprintf(stderr,"At most %d values per option: %s\n", BENCH_LIST_MAX, value);
+            return -1;
+        }
+        list->values[list->count++] = value;
+    }
+    return list->count > 0 ? 0 : -1;
+}
+
+static double seconds_now(void){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ Random printable input of 2^n x 2^n characters, the layout -i and -j
+ expect.
+return:
+   0 on success
+  -1 after reporting the failure
+*/
+static int generate_input(const char *path, int n, unsigned seed){
+    size_t size = (size_t) 1 << (2 * n);
+    char *data = malloc(size);
+    FILE *fp;
+
+    if(data == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in generate_input()\n");
+        return -1;
+    }
+    srand(seed);
+    for(size_t i = 0; i < size; i++)
+        data[i] = (char) ('!' + rand() % 94);
+    fp = fopen(path, "w");
+    if(fp == NULL || fwrite(data, 1, size, fp) != size || fclose(fp) != 0){
+        fprintf(stderr,"Input %s could not be written: %s\n", path, strerror(errno));
+        free(data);
+        return -1;
+    }
+    free(data);
+    return 0;
+}
+
+/**
+ One run of pipes with argv, stdout is read for the --timings line and
+ stderr is dropped.
+return:
+   0 with the phase times in ms, total and wall included
+  -1 when pipes failed or printed no timings
+*/
+static int run_pipes(char **argv, double *ms){
+    char *output = NULL, *line, *field;
+    size_t length = 0, capacity = 0;
+    int fds[2], status;
+    double start = seconds_now();
+    ssize_t got;
+    pid_t pid;
+
+    if(pipe(fds) == -1)
+        return -1;
+    pid = fork();
+    if(pid == -1)
+        return -1;
+    if(pid == 0){
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        freopen("/dev/null", "w", stderr);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    for(;;){
+        if(length + 4096 > capacity){
+            capacity = capacity ? capacity * 2 : 65536;
+            output = realloc(output, capacity + 1);
+            if(output == NULL){
+                fprintf(stderr, "Failed allocated memory : malloc() in run_pipes()\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        got = read(fds[0], output + length, capacity - length);
+        if(got == -1 && errno == EINTR)
+            continue;
+        if(got <= 0)
+            break;
+        length += got;
+    }
+    close(fds[0]);
+    while(waitpid(pid, &status, 0) == -1 && errno == EINTR)
+        ;
+    ms[BENCH_PHASES - 1] = (seconds_now() - start) * 1e3;
+
+    if(output == NULL || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        free(output);
+        return -1;
+    }
+    output[length] = '\0';
+    line = strstr(output, "Timings ms:");
+    if(line == NULL){
+        free(output);
+        return -1;
+    }
+    ms[BENCH_PHASES - 2] = 0.0;
+    for(int p = 0; p < BENCH_PHASES - 2; p++){
+        field = strstr(line, phase_names[p]);
+        ms[p] = field != NULL ? strtod(field + strlen(phase_names[p]) + 1, NULL) : 0.0;
+        ms[BENCH_PHASES - 2] += ms[p];
+    }
+    free(output);
+    return 0;
+}
+
+static int compare_doubles(const void *a, const void *b){
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Median and nearest rank p99 of count values, sorted in place
+static void summarize(double *values, int count, double *median, double *p99){
+    int rank = (int) ceil(0.99 * count);
+
+    qsort(values, count, sizeof(double), compare_doubles);
+    *median = count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2.0;
+    *p99 = values[(rank > 0 ? rank : 1) - 1];
+}
+
+int main(int argc, char *argv[]){
+    char n_default[] = "6,7,8", zero_w[] = "0", zero_g[] = "0", backend_default[] = "fork,threads";
+    char transport_default[] = "pipe,shm", kernel_default[] = "auto";
+    struct list ns, workers, grids, backends, transports, kernels;
+    char dir[] = "/tmp/pipes-bench.XXXXXX", input1[64], input2[64], n_arg[16], *pipes = "./pipes";
+    char w_arg[32], g_arg[32], backend_arg[48], transport_arg[48], kernel_arg[48];
+    char *run_argv[64];
+    int option, trials = 5, warmup = 1, json = 0, extra, argc_run, rows = 0, failed;
+    double *samples, median, p99;
+
+    parse_list(&ns, n_default);
+    parse_list(&workers, zero_w);
+    parse_list(&grids, zero_g);
+    parse_list(&backends, backend_default);
+    parse_list(&transports, transport_default);
+    parse_list(&kernels, kernel_default);
+
+    while((option = getopt_long(argc, argv, "", long_options, NULL)) != -1){
+        switch(option){
+            case OPT_N: failed = parse_list(&ns, optarg); break;
+            case OPT_WORKERS: failed = parse_list(&workers, optarg); break;
+            case OPT_GRID: failed = parse_list(&grids, optarg); break;
+            case OPT_BACKEND: failed = parse_list(&backends, optarg); break;
+            case OPT_TRANSPORT: failed = parse_list(&transports, optarg); break;
+            case OPT_KERNEL: failed = parse_list(&kernels, optarg); break;
+            case OPT_TRIALS: trials = (int) strtol(optarg, NULL, 10); failed = trials < 1; break;
+            case OPT_WARMUP: warmup = (int) strtol(optarg, NULL, 10); failed = warmup < 0; break;
+            case OPT_FORMAT:
+                json = strcmp(optarg, "json") == 0;
+                failed = !json && strcmp(optarg, "csv") != 0;
+                break;
+            case OPT_PIPES: pipes = optarg; failed = 0; break;
+            default: failed = 1;
+        }
+        if(failed){
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+    // Whatever follows "--" goes to every run
+    extra = optind;
+    if(argc - extra > 32){
+        fprintf(stderr,"Too many extra pipes arguments\n");
+        return EXIT_FAILURE;
+    }
+    if(access(pipes, X_OK) == -1){
+        fprintf(stderr,"%s is not runnable, build it first: %s\n", pipes, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if(mkdtemp(dir) == NULL){
+        fprintf(stderr,"Input directory could not be created: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    samples = malloc((size_t) BENCH_PHASES * trials * sizeof(double));
+    if(samples == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in main()\n");
+        return EXIT_FAILURE;
+    }
+
+    if(json)
+        printf("[\n");
+    else{
+        printf("n,backend,transport,kernel,workers,grid,trials");
+        for(int p = 0; p < BENCH_PHASES; p++)
+            printf(",%s_median_ms,%s_p99_ms", phase_names[p], phase_names[p]);
+        printf("\n");
+    }
+
+    for(int in = 0; in < ns.count; in++){
+        int n = (int) strtol(ns.values[in], NULL, 10);
+
+        snprintf(input1, sizeof(input1), "%s/a%d.txt", dir, n);
+        snprintf(input2, sizeof(input2), "%s/b%d.txt", dir, n);
+        if(n < 2 || n > 14 || generate_input(input1, n, 1) == -1 || generate_input(input2, n, 2) == -1){
+            fprintf(stderr,"Skipping n=%s, inputs could not be made\n", ns.values[in]);
+            continue;
+        }
+        snprintf(n_arg, sizeof(n_arg), "%d", n);
+
+        for(int ib = 0; ib < backends.count; ib++)
+        for(int it = 0; it < transports.count; it++)
+        for(int ik = 0; ik < kernels.count; ik++)
+        for(int iw = 0; iw < workers.count; iw++)
+        for(int ig = 0; ig < grids.count; ig++){
+            // Threads share C already, pipes refuses the shm transport with them
+            if(strcmp(backends.values[ib], "threads") == 0 && strcmp(transports.values[it], "pipe") != 0)
+                continue;
+
+            argc_run = 0;
+            run_argv[argc_run++] = pipes;
+            run_argv[argc_run++] = "-i"; run_argv[argc_run++] = input1;
+            run_argv[argc_run++] = "-j"; run_argv[argc_run++] = input2;
+            run_argv[argc_run++] = "-n"; run_argv[argc_run++] = n_arg;
+            snprintf(backend_arg, sizeof(backend_arg), "--backend=%s", backends.values[ib]);
+            snprintf(transport_arg, sizeof(transport_arg), "--transport=%s", transports.values[it]);
+            snprintf(kernel_arg, sizeof(kernel_arg), "--kernel=%s", kernels.values[ik]);
+            run_argv[argc_run++] = backend_arg;
+            run_argv[argc_run++] = transport_arg;
+            run_argv[argc_run++] = kernel_arg;
+            if(strcmp(workers.values[iw], "0") != 0){
+                snprintf(w_arg, sizeof(w_arg), "-w%s", workers.values[iw]);
+                run_argv[argc_run++] = w_arg;
+            }
+            if(strcmp(grids.values[ig], "0") != 0){
+                snprintf(g_arg, sizeof(g_arg), "-g%s", grids.values[ig]);
+                run_argv[argc_run++] = g_arg;
+            }
+            run_argv[argc_run++] = "--timings";
+            run_argv[argc_run++] = "--output=none";
+            for(int e = extra; e < argc; e++)
+                run_argv[argc_run++] = argv[e];
+            run_argv[argc_run] = NULL;
+
+            failed = 0;
+            for(int r = 0; r < warmup + trials && !failed; r++){
+                double ms[BENCH_PHASES];
+
+                failed = run_pipes(run_argv, ms) == -1;
+                // Trial r - warmup, phase p at samples[p*trials + trial]
+                for(int p = 0; r >= warmup && !failed && p < BENCH_PHASES; p++)
+                    samples[p * trials + r - warmup] = ms[p];
+            }
+            if(failed){
+                fprintf(stderr,"Skipping n=%d %s %s %s workers=%s grid=%s, pipes failed\n", n, backend_arg, transport_arg,
+                        kernel_arg, workers.values[iw], grids.values[ig]);
+                continue;
+            }
+
+            if(json){
+                printf("%s  {\"n\": %d, \"backend\": \"%s\", \"transport\": \"%s\", \"kernel\": \"%s\", \"workers\": %s, \"grid\": \"%s\", \"trials\": %d",
+                       rows ? ",\n" : "", n, backends.values[ib], transports.values[it], kernels.values[ik],
+                       workers.values[iw], grids.values[ig], trials);
+                for(int p = 0; p < BENCH_PHASES; p++){
+                    summarize(samples + p * trials, trials, &median, &p99);
+                    printf(", \"%s\": {\"median_ms\": %.3f, \"p99_ms\": %.3f}", phase_names[p], median, p99);
+                }
+                printf("}");
+            }
+            else{
+                printf("%d,%s,%s,%s,%s,%s,%d", n, backends.values[ib], transports.values[it], kernels.values[ik],
+                       workers.values[iw], grids.values[ig], trials);
+                for(int p = 0; p < BENCH_PHASES; p++){
+                    summarize(samples + p * trials, trials, &median, &p99);
+                    printf(",%.3f,%.3f", median, p99);
+                }
+                printf("\n");
+            }
+            fflush(stdout);
+            rows++;
+        }
+        unlink(input1);
+        unlink(input2);
+    }
+    if(json)
+        printf("%s]\n", rows ? "\n" : "");
+    rmdir(dir);
+    free(samples);
+    return rows > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,278 @@
+//
+//  cache.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "cache.h"
+#include "protocol.h"
+#include <dirent.h>
+#include <sys/file.h>
+
+#define HASH_C1 0x87c37b91114253d5ULL
+#define HASH_C2 0x4cf5ad432745937fULL
+
+// An entry found while evicting
+struct cache_file {
+    char name[64];
+    off_t size;
+    struct timespec used;
+};
+
+static uint64_t rotl(uint64_t x, int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+// Last step of each lane, every input bit reaches every output bit
+static uint64_t fmix(uint64_t x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/**
+ Folds size bytes of data into key, MurmurHash3 x64_128 seeded with the
+ key so far: 16 bytes per round, two multiplies a lane, several GB/s, so
+ hashing A and B costs little next to multiplying them. Chained calls
+ hash the pieces in order, each with its length.
+ */
+void cache_hash(struct cache_key *key, const void *data, size_t size){
+    const unsigned char *p = data;
+    unsigned char tail[16];
+    uint64_t h1 = key->h[0], h2 = key->h[1], k1, k2;
+    size_t i;
+    
+    for(i = 0; i < size; i += 16){
+        // The last partial block is padded with zeros, the length below tells it apart
+        if(size - i < 16){
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, p + i, size - i);
+            memcpy(&k1, tail, 8);
+            memcpy(&k2, tail + 8, 8);
+        }
+        else{
+            memcpy(&k1, p + i, 8);
+            memcpy(&k2, p + i + 8, 8);
+        }
+        k1 *= HASH_C1; k1 = rotl(k1, 31); k1 *= HASH_C2; h1 ^= k1;
+        h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= HASH_C2; k2 = rotl(k2, 33); k2 *= HASH_C1; h2 ^= k2;
+        h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 += h2;
+    h2 += h1;
+    key->h[0] = h1;
+    key->h[1] = h2;
+}
+
+// 32 hex digits
+void cache_key_name(const struct cache_key *key, char *name, size_t size){
+    snprintf(name, size, "%016llx%016llx", (unsigned long long) key->h[0], (unsigned long long) key->h[1]);
+}
+
+static void cache_path(const struct cache *c, const struct cache_key *key, char *path, size_t size){
+    char name[33];
+    
+    cache_key_name(key, name, sizeof(name));
+    snprintf(path, size, "%s/%s%s", c->dir, name, CACHE_SUFFIX);
+}
+
+// Adds to the counters file under an exclusive lock, runs sharing the directory may update it at once
+static void cache_count(struct cache *c, int hits, int misses, int stores, int evictions){
+    struct cache_counts counts;
+    char path[512];
+    int fd;
+    
+    snprintf(path, sizeof(path), "%s/counters", c->dir);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd == -1 || flock(fd, LOCK_EX) == -1){
+        fprintf(stderr,"Cache counters %s could not be updated: %s\n", path, strerror(errno));
+        if(fd != -1)
+            close(fd);
+        return;
+    }
+    // A new file reads nothing
+    if(pread(fd, &counts, sizeof(counts), 0) != sizeof(counts))
+        memset(&counts, 0, sizeof(counts));
+    counts.hits += hits;
+    counts.misses += misses;
+    counts.stores += stores;
+    counts.evictions += evictions;
+    if(pwrite(fd, &counts, sizeof(counts), 0) != sizeof(counts))
+        fprintf(stderr,"Cache counters %s could not be updated: %s\n", path, strerror(errno));
+    close(fd);
+    c->counts = counts;
+}
+
+// Least recently used first
+static int by_use(const void *a, const void *b){
+    const struct cache_file *x = a, *y = b;
+    
+    if(x->used.tv_sec != y->used.tv_sec)
+        return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    if(x->used.tv_nsec != y->used.tv_nsec)
+        return x->used.tv_nsec < y->used.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+// Removes the least recently used entries until the rest fit the limit, returns how many this run removed
+static int cache_evict(struct cache *c){
+    DIR *dir = opendir(c->dir);
+    struct dirent *de;
+    struct cache_file *files = NULL, *grown;
+    size_t count = 0, capacity = 0, length, suffix = strlen(CACHE_SUFFIX);
+    uint64_t total = 0;
+    int evicted = 0;
+    char path[512];
+    struct stat st;
+    
+    if(dir == NULL){
+        fprintf(stderr,"Cache directory %s could not be read: %s\n", c->dir, strerror(errno));
+        return 0;
+    }
+    while((de = readdir(dir)) != NULL){
+        length = strlen(de->d_name);
+        if(length <= suffix || length >= sizeof(files->name) || strcmp(de->d_name + length - suffix, CACHE_SUFFIX) != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", c->dir, de->d_name);
+        if(stat(path, &st) == -1)
+            continue;
+        if(count == capacity){
+            capacity = capacity ? 2 * capacity : 64;
+            if((grown = realloc(files, capacity * sizeof(*files))) == NULL)
+                break;
+            files = grown;
+        }
+        snprintf(files[count].name, sizeof(files->name), "%s", de->d_name);
+        files[count].size = st.st_size;
+        files[count].used = st.st_mtim;
+        total += st.st_size;
+        count++;
+    }
+    closedir(dir);
+    
+    qsort(files, count, sizeof(*files), by_use);
+    c->entries = (long) count;
+    for(size_t i = 0; i < count && total > c->limit; i++){
+        snprintf(path, sizeof(path), "%s/%s", c->dir, files[i].name);
+        // Another run may have removed it already, it is gone either way
+        if(unlink(path) == 0)
+            evicted++;
+        total -= files[i].size;
+        c->entries--;
+    }
+    c->bytes = total;
+    free(files);
+    return evicted;
+}
+
+/**
+ Creates the cache directory when it is not there yet.
+return:
+   0 on success
+  -1 after reporting the failure
+*/
+int cache_open(struct cache *c, const char *dir, size_t limit){
+    struct stat st;
+    
+    memset(c, 0, sizeof(*c));
+    snprintf(c->dir, sizeof(c->dir), "%s", dir);
+    c->limit = limit;
+    if(mkdir(c->dir, 0755) == -1 && errno != EEXIST){
+        fprintf(stderr,"Cache directory %s could not be created: %s\n", c->dir, strerror(errno));
+        return -1;
+    }
+    if(stat(c->dir, &st) == -1 || !S_ISDIR(st.st_mode)){
+        fprintf(stderr,"Cache directory %s is not a directory\n", c->dir);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ Reads C [m x n] and the values of key into result and values, at most
+ capacity values. An entry that does not match in every field is a
+ miss. A hit becomes the most recently used entry.
+return:
+   the value count on a hit
+  -1 on a miss
+*/
+int cache_lookup(struct cache *c, const struct cache_key *key, int m, int n, int *result, double *values, int capacity){
+    struct cache_entry e;
+    size_t c_bytes = (size_t) m * n * sizeof(int);
+    char path[512];
+    int fd, hit = 0;
+    
+    cache_path(c, key, path, sizeof(path));
+    fd = open(path, O_RDONLY);
+    if(fd != -1 && read_full(fd, &e, sizeof(e)) == sizeof(e) && e.magic == CACHE_MAGIC && e.version == CACHE_VERSION &&
+       e.key[0] == key->h[0] && e.key[1] == key->h[1] && e.m == m && e.n == n && e.value_count >= 0 && e.value_count <= capacity &&
+       read_full(fd, result, c_bytes) == (ssize_t) c_bytes &&
+       read_full(fd, values, e.value_count * sizeof(double)) == (ssize_t) (e.value_count * sizeof(double)))
+        hit = 1;
+    // The mtime is the last use
+    if(hit)
+        futimens(fd, NULL);
+    if(fd != -1)
+        close(fd);
+    cache_count(c, hit, !hit, 0, 0);
+    return hit ? e.value_count : -1;
+}
+
+/**
+ Writes the entry of key to a file of its own and renames it into
+ place, then evicts down to the limit. An entry larger than the whole
+ limit is not kept.
+return:
+   0 on success
+  -1 after reporting the failure, the run goes on without it
+*/
+int cache_store(struct cache *c, const struct cache_key *key, int m, int n, const int *result, const double *values, int value_count){
+    struct cache_entry e;
+    size_t c_bytes = (size_t) m * n * sizeof(int), v_bytes = value_count * sizeof(double);
+    char path[512], temp[528];
+    int fd, status = 0;
+    
+    if(sizeof(e) + c_bytes + v_bytes > c->limit)
+        return 0;
+    memset(&e, 0, sizeof(e));
+    e.magic = CACHE_MAGIC;
+    e.version = CACHE_VERSION;
+    e.key[0] = key->h[0];
+    e.key[1] = key->h[1];
+    e.m = m;
+    e.n = n;
+    e.value_count = value_count;
+    
+    cache_path(c, key, path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.%d", path, (int) getpid());
+    fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1)
+        status = -1;
+    else{
+        if(write_full(fd, &e, sizeof(e)) == -1 || write_full(fd, result, c_bytes) == -1 || write_full(fd, values, v_bytes) == -1)
+            status = -1;
+        if(close(fd) == -1)
+            status = -1;
+    }
+    if(status == 0 && rename(temp, path) == -1)
+        status = -1;
+    if(status == -1){
+        fprintf(stderr,"Cache entry %s could not be written: %s\n", path, strerror(errno));
+        unlink(temp);
+        return -1;
+    }
+    cache_count(c, 0, 0, 1, cache_evict(c));
+    return 0;
+}
@@ -0,0 +1,65 @@
+//
+//  cache.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef cache_h
+#define cache_h
+
+#include "globals.h"
+#include <stdint.h>
+/*
+ Result cache: C and the squared singular values of a run, kept in a
+ directory under a hash of everything they depend on. A run whose key
+ is there reads them back and does not fork, multiply or decompose.
+ Each entry is one file named after its key, replaced by rename() so
+ a reader never sees half of one. The mtime of an entry is its last
+ use; when the entries add up to more than the limit the least
+ recently used go first. Hit, miss and eviction counts of all runs are
+ kept in the directory too.
+ */
+
+#define CACHE_MAGIC 0x48434150  // "PACH" at the start of an entry
+#define CACHE_VERSION 1
+#define CACHE_LIMIT (1L << 30)  // Default --cache-size
+#define CACHE_SUFFIX ".entry"
+
+// 128 bits, two independent 64 bit lanes
+struct cache_key {
+    uint64_t h[2];
+};
+
+// Start of an entry file, then C as [m x n] int32 and value_count doubles
+struct cache_entry {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t key[2];
+    int32_t m, n;
+    int32_t value_count;
+    int32_t pad;
+};
+
+// Totals of the directory, kept in its "counters" file
+struct cache_counts {
+    uint64_t hits, misses, stores, evictions;
+};
+
+struct cache {
+    char dir[255];
+    size_t limit;           // Bytes of all entries together
+    struct cache_counts counts; // As of this run's last update
+    uint64_t bytes;         // Entries in the directory after the last eviction pass
+    long entries;
+};
+
+void cache_hash(struct cache_key *key, const void *data, size_t size);
+void cache_key_name(const struct cache_key *key, char *name, size_t size);
+int cache_open(struct cache *c, const char *dir, size_t limit);
+int cache_lookup(struct cache *c, const struct cache_key *key, int m, int n, int *result, double *values, int capacity);
+int cache_store(struct cache *c, const struct cache_key *key, int m, int n, const int *result, const double *values, int value_count);
+
+#endif /* cache_h */
@@ -0,0 +1,89 @@
+//
+//  chain.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "chain.h"
+
+/**
+ Matrix chain order: matrix i is [dims[i] x dims[i+1]], count of them.
+ split[i*count + j] gets the s for which (Ai..As)(As+1..Aj) is the
+ cheapest way to multiply Ai..Aj, filled for i < j. Costs are doubles,
+ products of three dimensions can pass 64 bits.
+return:
+   multiply-adds of the whole chain in that order
+*/
+double chain_order(const int *dims, int count, int *split){
+    double cost[CHAIN_MAX][CHAIN_MAX], c;
+    
+    for(int i = 0; i < count; i++)
+        cost[i][i] = 0.0;
+    // Shorter runs first, each one splits into two cheaper ones already known
+    for(int length = 2; length <= count; length++){
+        for(int i = 0; i + length - 1 < count; i++){
+            int j = i + length - 1;
+            
+            cost[i][j] = HUGE_VAL;
+            for(int s = i; s < j; s++){
+                c = cost[i][s] + cost[s+1][j] + (double) dims[i] * dims[s+1] * dims[j+1];
+                if(c < cost[i][j]){
+                    cost[i][j] = c;
+                    split[i*count + j] = s;
+                }
+            }
+        }
+    }
+    return cost[0][count-1];
+}
+
+// Multiply-adds of ((A1 A2) A3) ..., for comparison
+double chain_left_cost(const int *dims, int count){
+    double cost = 0.0;
+    
+    for(int j = 1; j < count; j++)
+        cost += (double) dims[0] * dims[j] * dims[j+1];
+    return cost;
+}
+
+/**
+ [rows x inner] . [inner x cols] -> [rows x cols] of int64, lda, ldb and
+ ldc are the row strides. Unsigned arithmetic, so overflow wraps around
+ instead of being undefined. B is taken WIDE_BLOCK rows at a time and
+ each row of C is swept once per block, the loop the compiler vectorizes.
+ */
+void multiply_wide(const int64_t *a, int lda, const int64_t *b, int ldb, int64_t *c, int ldc, int rows, int cols, int inner){
+    for(int i = 0; i < rows; i++)
+        memset(c + (size_t) i*ldc, 0, cols * sizeof(int64_t));
+    for(int p0 = 0; p0 < inner; p0 += WIDE_BLOCK){
+        int p1 = inner - p0 < WIDE_BLOCK ? inner : p0 + WIDE_BLOCK;
+        
+        for(int i = 0; i < rows; i++){
+            uint64_t *ci = (uint64_t *) (c + (size_t) i*ldc);
+            
+            for(int p = p0; p < p1; p++){
+                uint64_t aip = (uint64_t) a[(size_t) i*lda + p];
+                const uint64_t *bp = (const uint64_t *) (b + (size_t) p*ldb);
+                
+                if(aip == 0)
+                    continue;
+                for(int j = 0; j < cols; j++)
+                    ci[j] += aip * bp[j];
+            }
+        }
+    }
+}
+
+// Largest magnitude among count elements, as a double
+double wide_bound(const int64_t *data, size_t count){
+    double bound = 0.0, v;
+    
+    for(size_t i = 0; i < count; i++){
+        v = fabs((double) data[i]);
+        if(v > bound)
+            bound = v;
+    }
+    return bound;
+}
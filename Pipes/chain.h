@@ -0,0 +1,41 @@
+//
+//  chain.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef chain_h
+#define chain_h
+
+#include "globals.h"
+#include <stdint.h>
+/*
+ Products of several matrices, A1 A2 ... Am or A^p, with every
+ intermediate kept as int64 in memory. The char inputs are widened
+ once; after that the operands are int64 tiles, so a product of
+ products loses nothing an int or a double would. Arithmetic wraps
+ around past 64 bits. A chain is ordered by the classic matrix chain
+ dynamic program, fewest multiply-adds over all parenthesizations; a
+ power is squared and multiplied along the bits of p.
+ */
+
+#define CHAIN_MAX 64            // Matrices in one chain
+#define WIDE_BLOCK 128          // Rows of B per pass of multiply_wide(), 128 x 256 int64 stay in L2
+
+// One multiply of a chain, the ctx of its tile requests, results and thread tasks
+struct chain_step {
+    const int64_t *a, *b;       // [m x k] and [k x n], row major
+    int64_t *c;                 // [m x n]
+    int m, k, n;
+    int grid_rows, grid_cols;
+    int64_t *gather;            // [k x tile cols] of B, for the request being built
+};
+
+double chain_order(const int *dims, int count, int *split);
+double chain_left_cost(const int *dims, int count);
+void multiply_wide(const int64_t *a, int lda, const int64_t *b, int ldb, int64_t *c, int ldc, int rows, int cols, int inner);
+double wide_bound(const int64_t *data, size_t count);
+
+#endif /* chain_h */
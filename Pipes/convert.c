@@ -0,0 +1,305 @@
+//
+//  convert.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+/*
+ pipes-convert: binary matrix files (matfile.h) to and from the text
+ forms pipes already knows. An int8 matrix is the raw bytes of an input
+ file, any other type is numbers as pipes prints them, "[1.000, 2.000]"
+ rows or whitespace separated, whatever is not a number is skipped.
+ */
+
+#include "globals.h"
+#include "matfile.h"
+#include "protocol.h"
+
+enum {
+    OPT_TO_BIN = 256,
+    OPT_TO_TEXT,
+    OPT_INFO,
+    OPT_DIMS,
+    OPT_DTYPE,
+    OPT_ROW_ALIGN
+};
+
+static const struct option long_options[] = {
+    {"to-bin", no_argument, NULL, OPT_TO_BIN},
+    {"to-text", no_argument, NULL, OPT_TO_TEXT},
+    {"info", no_argument, NULL, OPT_INFO},
+    {"dims", required_argument, NULL, OPT_DIMS},
+    {"dtype", required_argument, NULL, OPT_DTYPE},
+    {"row-align", required_argument, NULL, OPT_ROW_ALIGN},
+    {NULL, 0, NULL, 0}
+};
+
+static void print_usage(void){
+    printf("\nUsage:\n"
+           "./pipes-convert --to-bin --dims=RxC [--dtype=int8|int16|int32|float|double|int64] [--row-align=BYTES] IN OUT\n"
+           "./pipes-convert --to-text IN OUT\n"
+           "./pipes-convert --info IN\n"
+           "int8 text is raw bytes, one per element like the -i/-j inputs, other types are printed numbers\n");
+}
+
+/**
+ Whole file in a buffer with a '\0' after it.
+return:
+   the buffer on success, size set
+   NULL after reporting the failure
+*/
+static char *read_file(const char *path, size_t *size){
+    struct stat st;
+    char *buffer;
+    int fd = open(path, O_RDONLY);
+
+    if(fd == -1 || fstat(fd, &st) == -1){
+        fprintf(stderr,"%s could not be opened: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    *size = st.st_size;
+    buffer = malloc(*size + 1);
+    if(buffer == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in read_file()\n");
+        close(fd);
+        return NULL;
+    }
+    if(read_full(fd, buffer, *size) != (ssize_t) *size){
+        fprintf(stderr,"%s could not be read: %s\n", path, strerror(errno));
+        free(buffer);
+        close(fd);
+        return NULL;
+    }
+    buffer[*size] = '\0';
+    close(fd);
+    return buffer;
+}
+
+// Stores value as element `index` of a dense dtype array, -1 when it does not fit
+static int store(void *data, int dtype, size_t index, double value){
+    double low = 0.0, high = 0.0;
+
+    switch(dtype){
+        case DTYPE_INT8: low = -128.0; high = 127.0; break;
+        case DTYPE_INT16: low = INT16_MIN; high = INT16_MAX; break;
+        case DTYPE_INT32: low = INT32_MIN; high = INT32_MAX; break;
+        case DTYPE_FLOAT: ((float *) data)[index] = (float) value; return 0;
+        case DTYPE_DOUBLE: ((double *) data)[index] = value; return 0;
+        case DTYPE_INT64:
+            // 2^63 itself is a double, but not an int64
+            if(value != floor(value) || value < -0x1p63 || value >= 0x1p63)
+                return -1;
+            ((int64_t *) data)[index] = (int64_t) value;
+            return 0;
+    }
+    if(value != floor(value) || value < low || value > high)
+        return -1;
+    if(dtype == DTYPE_INT8)
+        ((signed char *) data)[index] = (signed char) value;
+    else if(dtype == DTYPE_INT16)
+        ((int16_t *) data)[index] = (int16_t) value;
+    else
+        ((int32_t *) data)[index] = (int32_t) value;
+    return 0;
+}
+
+// Element (i, j) as "%.3f" and end, int64 ones are printed exactly, not through a double
+static void print_element(FILE *fp, const char *data, const struct matfile_header *h, size_t i, size_t j, const char *end){
+    int64_t l;
+    
+    if(h->dtype == DTYPE_INT64){
+        memcpy(&l, data + i * h->row_stride + j * h->col_stride, sizeof(l));
+        fprintf(fp, "%lld.000%s", (long long) l, end);
+    }
+    else
+        fprintf(fp, "%.3f%s", matfile_get(data, h, i, j), end);
+}
+
+/**
+ Text input -> binary matrix file. Like pipes, elements past
+ rows x cols are ignored.
+return:
+   0 on success
+  -1 after reporting the failure
+*/
+static int to_bin(const char *in, const char *out, int dtype, size_t rows, size_t cols, size_t row_align){
+    struct matfile_header h;
+    size_t size, count = rows * cols, done = 0;
+    char *text, *p, *end;
+    void *data;
+    double value;
+    int fd, status = -1;
+
+    text = read_file(in, &size);
+    if(text == NULL)
+        return -1;
+    data = malloc(count * dtype_size(dtype));
+    if(data == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in to_bin()\n");
+        free(text);
+        return -1;
+    }
+
+    if(dtype == DTYPE_INT8){
+        // Raw bytes, the element is the character code
+        if(size < count)
+            fprintf(stderr,"Not enough characters in %s: %zu bytes, expected : %zu bytes\n", in, size, count);
+        else{
+            memcpy(data, text, count);
+            done = count;
+        }
+    }
+    else{
+        for(p = text; *p != '\0' && done < count; ){
+            value = strtod(p, &end);
+            if(end == p){
+                p++;
+                continue;
+            }
+            if(store(data, dtype, done, value) == -1){
+                fprintf(stderr,"Element %zu = %g does not fit %s\n", done, value, dtype_name(dtype));
+                break;
+            }
+            done++;
+            p = end;
+        }
+        if(done < count && *p == '\0')
+            fprintf(stderr,"Not enough numbers in %s: %zu, expected : %zu\n", in, done, count);
+    }
+
+    if(done == count){
+        matfile_init(&h, dtype, rows, cols, row_align);
+        fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd == -1 || matfile_write(fd, &h, data) == -1)
+            fprintf(stderr,"%s could not be written: %s\n", out, strerror(errno));
+        else
+            status = 0;
+        if(fd != -1)
+            close(fd);
+    }
+    free(data);
+    free(text);
+    return status;
+}
+
+/**
+ Binary matrix file -> raw bytes for int8, rows of numbers otherwise.
+return:
+   0 on success
+  -1 after reporting the failure
+*/
+static int to_text(const char *in, const char *out, int info){
+    struct matfile_header h;
+    size_t size;
+    char *file, *data;
+    FILE *fp;
+    int fd, status;
+
+    file = read_file(in, &size);
+    if(file == NULL)
+        return -1;
+    fd = open(in, O_RDONLY);
+    status = matfile_probe(fd, size, &h);
+    close(fd);
+    if(status != 1){
+        if(status == 0)
+            fprintf(stderr,"%s is not a binary matrix file\n", in);
+        free(file);
+        return -1;
+    }
+    data = file + h.offset;
+
+    if(info){
+        printf("%s: %s %llux%llu, row stride %llu, column stride %llu, data at %llu\n", in, dtype_name(h.dtype),
+               (unsigned long long) h.rows, (unsigned long long) h.cols, (unsigned long long) h.row_stride,
+               (unsigned long long) h.col_stride, (unsigned long long) h.offset);
+        free(file);
+        return 0;
+    }
+
+    fp = fopen(out, "w");
+    if(fp == NULL){
+        fprintf(stderr,"%s could not be written: %s\n", out, strerror(errno));
+        free(file);
+        return -1;
+    }
+    if(h.dtype == DTYPE_INT8){
+        for(size_t i = 0; i < h.rows; i++){
+            for(size_t j = 0; j < h.cols; j++)
+                fputc(data[i * h.row_stride + j * h.col_stride], fp);
+        }
+    }
+    // Same layout as display_arr() for one row and display_result() for more
+    else if(h.rows == 1){
+        fprintf(fp, "[");
+        for(size_t j = 0; j < h.cols; j++)
+            print_element(fp, data, &h, 0, j, j + 1 < h.cols ? ", " : "]\n");
+    }
+    else{
+        fprintf(fp, "[\n");
+        for(size_t i = 0; i < h.rows; i++){
+            fprintf(fp, "[");
+            for(size_t j = 0; j < h.cols; j++)
+                print_element(fp, data, &h, i, j, j + 1 < h.cols ? ", " : "],\n");
+        }
+        fprintf(fp, "]\n");
+    }
+    status = fclose(fp) == 0 ? 0 : -1;
+    if(status == -1)
+        fprintf(stderr,"%s could not be written: %s\n", out, strerror(errno));
+    free(file);
+    return status;
+}
+
+int main(int argc, char *argv[]){
+    int option, mode = 0, dtype = DTYPE_INT8;
+    long rows = 0, cols = 0, row_align = 0;
+    char *end;
+
+    while((option = getopt_long(argc, argv, "", long_options, NULL)) != -1){
+        switch(option){
+            case OPT_TO_BIN:
+            case OPT_TO_TEXT:
+            case OPT_INFO:
+                mode = option;
+                break;
+            case OPT_DIMS: // RxC
+                rows = strtol(optarg, &end, 10);
+                if(*end == 'x' || *end == 'X')
+                    cols = strtol(end+1, &end, 10);
+                if(*end != '\0' || rows < 1 || cols < 1){
+                    fprintf(stderr,"Dimensions must be given as RxC: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_DTYPE:
+                dtype = dtype_parse(optarg);
+                if(dtype == -1){
+                    fprintf(stderr,"Unknown type: %s (int8, int16, int32, float or double)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_ROW_ALIGN:
+                row_align = strtol(optarg, &end, 10);
+                if(*end != '\0' || row_align < 0){
+                    fprintf(stderr,"Row alignment must be 0 or more bytes: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                print_usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if(mode == OPT_TO_BIN && rows > 0 && argc - optind == 2)
+        return to_bin(argv[optind], argv[optind+1], dtype, rows, cols, row_align) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    if(mode == OPT_TO_TEXT && argc - optind == 2)
+        return to_text(argv[optind], argv[optind+1], 0) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    if(mode == OPT_INFO && argc - optind == 1)
+        return to_text(argv[optind], NULL, 1) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    print_usage();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,99 @@
+//
+//  delta.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "delta.h"
+#include "matrix.h"
+#include "protocol.h"
+
+/**
+ Keys of the row blocks of A [m x k] and the column blocks of B [k x n].
+ A row block is one run of bytes; a column block is hashed a row of B
+ at a time, so B is read once, front to back.
+ */
+void delta_hash(const char *a, const char *b, int m, int k, int n, int grid_rows, int grid_cols,
+                struct cache_key *row_keys, struct cache_key *col_keys){
+    struct tile t;
+
+    for(int r = 0; r < grid_rows; r++){
+        grid_tile(m, n, grid_rows, grid_cols, r * grid_cols, &t);
+        memset(&row_keys[r], 0, sizeof(row_keys[r]));
+        cache_hash(&row_keys[r], a + (size_t) t.row0 * k, (size_t) t.rows * k);
+    }
+    memset(col_keys, 0, grid_cols * sizeof(*col_keys));
+    for(int i = 0; i < k; i++){
+        for(int c = 0; c < grid_cols; c++){
+            grid_tile(m, n, grid_rows, grid_cols, c, &t);
+            cache_hash(&col_keys[c], b + (size_t) i * n + t.col0, t.cols);
+        }
+    }
+}
+
+/**
+ Reads the state of the last run into the keys and result, when it was
+ a multiply of the same sizes on the same grid as h.
+return:
+   0 on success
+  -1 when there is no such state, all tiles are to be computed
+*/
+int delta_load(const char *path, const struct delta_header *h, struct cache_key *row_keys, struct cache_key *col_keys, int *result){
+    struct delta_header saved;
+    size_t c_bytes = (size_t) h->m * h->n * sizeof(int);
+    int fd = open(path, O_RDONLY), status = -1;
+    
+    if(fd == -1){
+        // The first run has none
+        return -1;
+    }
+    if(read_full(fd, &saved, sizeof(saved)) != sizeof(saved) || saved.magic != DELTA_MAGIC || saved.version != DELTA_VERSION)
+        fprintf(stderr,"State %s is not a state file, computing all tiles\n", path);
+    else if(saved.m != h->m || saved.k != h->k || saved.n != h->n || saved.grid_rows != h->grid_rows || saved.grid_cols != h->grid_cols)
+        printf("State %s is of a %dx%dx%d multiply on a %dx%d grid, computing all tiles\n", path,
+               saved.m, saved.k, saved.n, saved.grid_rows, saved.grid_cols);
+    else if(read_full(fd, row_keys, h->grid_rows * sizeof(*row_keys)) != (ssize_t) (h->grid_rows * sizeof(*row_keys)) ||
+            read_full(fd, col_keys, h->grid_cols * sizeof(*col_keys)) != (ssize_t) (h->grid_cols * sizeof(*col_keys)) ||
+            read_full(fd, result, c_bytes) != (ssize_t) c_bytes)
+        fprintf(stderr,"State %s is cut short, computing all tiles\n", path);
+    else
+        status = 0;
+    close(fd);
+    return status;
+}
+
+/**
+ Writes the state for the next run to a file of its own and renames it
+ over path, a run that fails halfway leaves the old state intact.
+return:
+   0 on success
+  -1 after reporting the failure
+*/
+int delta_save(const char *path, const struct delta_header *h, const struct cache_key *row_keys, const struct cache_key *col_keys,
+               const int *result){
+    char temp[300];
+    int fd, status = 0;
+
+    snprintf(temp, sizeof(temp), "%s.%d", path, (int) getpid());
+    fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1)
+        status = -1;
+    else{
+        if(write_full(fd, h, sizeof(*h)) == -1 || write_full(fd, row_keys, h->grid_rows * sizeof(*row_keys)) == -1 ||
+           write_full(fd, col_keys, h->grid_cols * sizeof(*col_keys)) == -1 ||
+           write_full(fd, result, (size_t) h->m * h->n * sizeof(int)) == -1)
+            status = -1;
+        if(close(fd) == -1)
+            status = -1;
+    }
+    if(status == 0 && rename(temp, path) == -1)
+        status = -1;
+    if(status == -1){
+        fprintf(stderr,"State %s could not be written: %s\n", path, strerror(errno));
+        unlink(temp);
+        return -1;
+    }
+    return 0;
+}
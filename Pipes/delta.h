@@ -0,0 +1,42 @@
+//
+//  delta.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef delta_h
+#define delta_h
+
+#include "globals.h"
+#include "cache.h"
+/*
+ --incremental: a state file of the last multiply, so the next one only
+ recomputes what changed. It holds a hash of every row block of A and
+ every column block of B of the tile grid (the rows and columns
+ grid_tile() gives a tile), and C. Tile (r, c) of C depends on row
+ block r of A and column block c of B alone; when both hash as they
+ did, that tile of the saved C is still right and is kept.
+ */
+
+#define DELTA_MAGIC 0x544c4450  // "PDLT" at the start of a state file
+#define DELTA_VERSION 1
+
+// Then grid_rows A keys, grid_cols B keys and C as [m x n] int32
+struct delta_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    int32_t m, k, n;
+    int32_t grid_rows, grid_cols;
+    int32_t pad;
+};
+
+void delta_hash(const char *a, const char *b, int m, int k, int n, int grid_rows, int grid_cols,
+                struct cache_key *row_keys, struct cache_key *col_keys);
+int delta_load(const char *path, const struct delta_header *h, struct cache_key *row_keys, struct cache_key *col_keys, int *result);
+int delta_save(const char *path, const struct delta_header *h, const struct cache_key *row_keys, const struct cache_key *col_keys,
+               const int *result);
+
+#endif /* delta_h */
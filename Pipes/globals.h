@@ -14,6 +14,8 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
@@ -23,6 +25,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <errno.h>
 
 #endif /* globals_h */
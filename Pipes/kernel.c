@@ -0,0 +1,779 @@
+//
+//  kernel.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNEL_X86
+#endif
+
+// B[k0.., j0..] -> panel, column j is panel[j*kc .. j*kc+kc)
+static void pack_b(const char *b, int ldb, int kc, int nc, char *panel){
+    for(int j = 0; j < nc; j++){
+        for(int k = 0; k < kc; k++)
+            panel[j*kc + k] = b[(size_t) k*ldb + j];
+    }
+}
+
+// A[i0.., k0..] -> block, row i is block[i*kc .. i*kc+kc)
+static void pack_a(const char *a, int lda, int mc, int kc, char *block){
+    for(int i = 0; i < mc; i++)
+        memcpy(block + i*kc, a + (size_t) i*lda, kc);
+}
+
+// Same two for int16 operands
+static void pack_b16(const int16_t *b, int ldb, int kc, int nc, int16_t *panel){
+    for(int j = 0; j < nc; j++){
+        for(int k = 0; k < kc; k++)
+            panel[j*kc + k] = b[(size_t) k*ldb + j];
+    }
+}
+
+static void pack_a16(const int16_t *a, int lda, int mc, int kc, int16_t *block){
+    for(int i = 0; i < mc; i++)
+        memcpy(block + i*kc, a + (size_t) i*lda, kc * sizeof(int16_t));
+}
+
+// C[4x4] += A[4 x kc] . B[kc x 4], both packed
+static void micro_kernel_scalar(const char *ap, const char *bp, int kc, int *c, int ldc){
+    int c00 = 0, c01 = 0, c02 = 0, c03 = 0;
+    int c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+    int c20 = 0, c21 = 0, c22 = 0, c23 = 0;
+    int c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+    const char *a0 = ap, *a1 = ap + kc, *a2 = ap + 2*kc, *a3 = ap + 3*kc;
+    const char *b0 = bp, *b1 = bp + kc, *b2 = bp + 2*kc, *b3 = bp + 3*kc;
+    int x0, x1, x2, x3, y0, y1, y2, y3;
+    
+    for(int k = 0; k < kc; k++){
+        x0 = a0[k]; x1 = a1[k]; x2 = a2[k]; x3 = a3[k];
+        y0 = b0[k]; y1 = b1[k]; y2 = b2[k]; y3 = b3[k];
+        c00 += x0*y0; c01 += x0*y1; c02 += x0*y2; c03 += x0*y3;
+        c10 += x1*y0; c11 += x1*y1; c12 += x1*y2; c13 += x1*y3;
+        c20 += x2*y0; c21 += x2*y1; c22 += x2*y2; c23 += x2*y3;
+        c30 += x3*y0; c31 += x3*y1; c32 += x3*y2; c33 += x3*y3;
+    }
+    c[0] += c00; c[1] += c01; c[2] += c02; c[3] += c03; c += ldc;
+    c[0] += c10; c[1] += c11; c[2] += c12; c[3] += c13; c += ldc;
+    c[0] += c20; c[1] += c21; c[2] += c22; c[3] += c23; c += ldc;
+    c[0] += c30; c[1] += c31; c[2] += c32; c[3] += c33;
+}
+
+// Products over [k0, kc) of a 4x4 tile, the part a vector loop left over
+static void micro_tail(const char *ap, const char *bp, int kc, int k0, int *sums){
+    for(int i = 0; i < KERNEL_MR; i++){
+        for(int j = 0; j < KERNEL_NR; j++){
+            for(int k = k0; k < kc; k++)
+                sums[i*KERNEL_NR + j] += ap[i*kc + k] * bp[j*kc + k];
+        }
+    }
+}
+
+static void micro_tail16(const int16_t *ap, const int16_t *bp, int kc, int k0, int *sums){
+    for(int i = 0; i < KERNEL_MR; i++){
+        for(int j = 0; j < KERNEL_NR; j++){
+            for(int k = k0; k < kc; k++)
+                sums[i*KERNEL_NR + j] += ap[i*kc + k] * bp[j*kc + k];
+        }
+    }
+}
+
+static void micro_store(const int *sums, int *c, int ldc){
+    for(int i = 0; i < KERNEL_MR; i++){
+        for(int j = 0; j < KERNEL_NR; j++)
+            c[(size_t) i*ldc + j] += sums[i*KERNEL_NR + j];
+    }
+}
+
+// The scalar kernel on int16 operands, the tail loop over the whole tile
+static void micro_kernel16_scalar(const int16_t *ap, const int16_t *bp, int kc, int *c, int ldc){
+    int sums[KERNEL_MR * KERNEL_NR] = {0};
+    
+    micro_tail16(ap, bp, kc, 0, sums);
+    micro_store(sums, c, ldc);
+}
+
+/*
+ Batch kernels: element e of lane l is at [e*KERNEL_LANES + l] in the
+ packed operands and in C, see multiply_batch().
+ */
+static void batch_kernel_scalar(const int *ap, const int *bp, int m, int k, int n, int *cp){
+    int sums[KERNEL_LANES];
+    const int *a, *b;
+    
+    for(int i = 0; i < m; i++){
+        for(int j = 0; j < n; j++){
+            memset(sums, 0, sizeof(sums));
+            for(int p = 0; p < k; p++){
+                a = ap + (i*k + p) * KERNEL_LANES;
+                b = bp + (p*n + j) * KERNEL_LANES;
+                for(int l = 0; l < KERNEL_LANES; l++)
+                    sums[l] += a[l] * b[l];
+            }
+            memcpy(cp + (i*n + j) * KERNEL_LANES, sums, sizeof(sums));
+        }
+    }
+}
+
+static int always_supported(void){
+    return 1;
+}
+
+#ifdef KERNEL_X86
+/*
+ The x86 variants sign extend 8/16/32 chars to 16 bit lanes, multiply
+ pairs of lanes into 32 bit sums (pmaddwd, or vpdpwssd with VNNI) and
+ reduce each accumulator horizontally at the end. Products of two chars
+ and pairs of them fit in 32 bits, so the sums match the scalar kernel.
+ The int16 ones load their lanes as they are, their sums may wrap in 32
+ bits, which still leaves C exact as long as it fits an int.
+ */
+
+static int sse41_supported(void){
+    return __builtin_cpu_supports("sse4.1");
+}
+
+__attribute__((target("sse4.1")))
+static int hsum_128(__m128i v){
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+// Two rows of A against four columns of B per pass, 8 accumulators
+__attribute__((target("sse4.1")))
+static void micro_kernel_sse41(const char *ap, const char *bp, int kc, int *c, int ldc){
+    int sums[KERNEL_MR * KERNEL_NR] = {0};
+    int k8 = kc & ~7;
+    __m128i acc[2][KERNEL_NR], x0, x1, y;
+    
+    for(int i = 0; i < KERNEL_MR; i += 2){
+        const char *a0 = ap + i*kc, *a1 = a0 + kc;
+        for(int j = 0; j < KERNEL_NR; j++)
+            acc[0][j] = acc[1][j] = _mm_setzero_si128();
+        for(int k = 0; k < k8; k += 8){
+            x0 = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i *) (a0 + k)));
+            x1 = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i *) (a1 + k)));
+            for(int j = 0; j < KERNEL_NR; j++){
+                y = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i *) (bp + j*kc + k)));
+                acc[0][j] = _mm_add_epi32(acc[0][j], _mm_madd_epi16(x0, y));
+                acc[1][j] = _mm_add_epi32(acc[1][j], _mm_madd_epi16(x1, y));
+            }
+        }
+        for(int j = 0; j < KERNEL_NR; j++){
+            sums[i*KERNEL_NR + j] = hsum_128(acc[0][j]);
+            sums[(i+1)*KERNEL_NR + j] = hsum_128(acc[1][j]);
+        }
+    }
+    micro_tail(ap, bp, kc, k8, sums);
+    micro_store(sums, c, ldc);
+}
+
+// int16 operands need no sign extension, eight per load
+__attribute__((target("sse4.1")))
+static void micro_kernel16_sse41(const int16_t *ap, const int16_t *bp, int kc, int *c, int ldc){
+    int sums[KERNEL_MR * KERNEL_NR] = {0};
+    int k8 = kc & ~7;
+    __m128i acc[2][KERNEL_NR], x0, x1, y;
+    
+    for(int i = 0; i < KERNEL_MR; i += 2){
+        const int16_t *a0 = ap + i*kc, *a1 = a0 + kc;
+        for(int j = 0; j < KERNEL_NR; j++)
+            acc[0][j] = acc[1][j] = _mm_setzero_si128();
+        for(int k = 0; k < k8; k += 8){
+            x0 = _mm_loadu_si128((const __m128i *) (a0 + k));
+            x1 = _mm_loadu_si128((const __m128i *) (a1 + k));
+            for(int j = 0; j < KERNEL_NR; j++){
+                y = _mm_loadu_si128((const __m128i *) (bp + j*kc + k));
+                acc[0][j] = _mm_add_epi32(acc[0][j], _mm_madd_epi16(x0, y));
+                acc[1][j] = _mm_add_epi32(acc[1][j], _mm_madd_epi16(x1, y));
+            }
+        }
+        for(int j = 0; j < KERNEL_NR; j++){
+            sums[i*KERNEL_NR + j] = hsum_128(acc[0][j]);
+            sums[(i+1)*KERNEL_NR + j] = hsum_128(acc[1][j]);
+        }
+    }
+    micro_tail16(ap, bp, kc, k8, sums);
+    micro_store(sums, c, ldc);
+}
+
+// Lanes 0-3 and 4-7 in two registers
+__attribute__((target("sse4.1")))
+static void batch_kernel_sse41(const int *ap, const int *bp, int m, int k, int n, int *cp){
+    __m128i lo, hi;
+    const int *a, *b;
+    
+    for(int i = 0; i < m; i++){
+        for(int j = 0; j < n; j++){
+            lo = hi = _mm_setzero_si128();
+            for(int p = 0; p < k; p++){
+                a = ap + (i*k + p) * KERNEL_LANES;
+                b = bp + (p*n + j) * KERNEL_LANES;
+                lo = _mm_add_epi32(lo, _mm_mullo_epi32(_mm_load_si128((const __m128i *) a), _mm_load_si128((const __m128i *) b)));
+                hi = _mm_add_epi32(hi, _mm_mullo_epi32(_mm_load_si128((const __m128i *) (a + 4)), _mm_load_si128((const __m128i *) (b + 4))));
+            }
+            _mm_store_si128((__m128i *) (cp + (i*n + j) * KERNEL_LANES), lo);
+            _mm_store_si128((__m128i *) (cp + (i*n + j) * KERNEL_LANES + 4), hi);
+        }
+    }
+}
+
+static int avx2_supported(void){
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static int hsum_256(__m256i v){
+    __m128i h = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2)));
+    h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(h);
+}
+
+// Two rows of A against four columns of B per pass, 16 chars per step
+__attribute__((target("avx2")))
+static void micro_kernel_avx2(const char *ap, const char *bp, int kc, int *c, int ldc){
+    int sums[KERNEL_MR * KERNEL_NR] = {0};
+    int k16 = kc & ~15;
+    __m256i acc[2][KERNEL_NR], x0, x1, y;
+    
+    for(int i = 0; i < KERNEL_MR; i += 2){
+        const char *a0 = ap + i*kc, *a1 = a0 + kc;
+        for(int j = 0; j < KERNEL_NR; j++)
+            acc[0][j] = acc[1][j] = _mm256_setzero_si256();
+        for(int k = 0; k < k16; k += 16){
+            x0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (a0 + k)));
+            x1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (a1 + k)));
+            for(int j = 0; j < KERNEL_NR; j++){
+                y = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (bp + j*kc + k)));
+                acc[0][j] = _mm256_add_epi32(acc[0][j], _mm256_madd_epi16(x0, y));
+                acc[1][j] = _mm256_add_epi32(acc[1][j], _mm256_madd_epi16(x1, y));
+            }
+        }
+        for(int j = 0; j < KERNEL_NR; j++){
+            sums[i*KERNEL_NR + j] = hsum_256(acc[0][j]);
+            sums[(i+1)*KERNEL_NR + j] = hsum_256(acc[1][j]);
+        }
+    }
+    // gcc leaves the upper halves dirty here, the SSE code that runs next would stall on them
+    _mm256_zeroupper();
+    micro_tail(ap, bp, kc, k16, sums);
+    micro_store(sums, c, ldc);
+}
+
+__attribute__((target("avx2")))
+static void micro_kernel16_avx2(const int16_t *ap, const int16_t *bp, int kc, int *c, int ldc){
+    int sums[KERNEL_MR * KERNEL_NR] = {0};
+    int k16 = kc & ~15;
+    __m256i acc[2][KERNEL_NR], x0, x1, y;
+    
+    for(int i = 0; i < KERNEL_MR; i += 2){
+        const int16_t *a0 = ap + i*kc, *a1 = a0 + kc;
+        for(int j = 0; j < KERNEL_NR; j++)
+            acc[0][j] = acc[1][j] = _mm256_setzero_si256();
+        for(int k = 0; k < k16; k += 16){
+            x0 = _mm256_loadu_si256((const __m256i *) (a0 + k));
+            x1 = _mm256_loadu_si256((const __m256i *) (a1 + k));
+            for(int j = 0; j < KERNEL_NR; j++){
+                y = _mm256_loadu_si256((const __m256i *) (bp + j*kc + k));
+                acc[0][j] = _mm256_add_epi32(acc[0][j], _mm256_madd_epi16(x0, y));
+                acc[1][j] = _mm256_add_epi32(acc[1][j], _mm256_madd_epi16(x1, y));
+            }
+        }
+        for(int j = 0; j < KERNEL_NR; j++){
+            sums[i*KERNEL_NR + j] = hsum_256(acc[0][j]);
+            sums[(i+1)*KERNEL_NR + j] = hsum_256(acc[1][j]);
+        }
+    }
+    _mm256_zeroupper();
+    micro_tail16(ap, bp, kc, k16, sums);
+    micro_store(sums, c, ldc);
+}
+
+// Four columns of C per pass share each load of A, leftover columns one at a time
+__attribute__((target("avx2")))
+static void batch_kernel_avx2(const int *ap, const int *bp, int m, int k, int n, int *cp){
+    __m256i c0, c1, c2, c3, x;
+    const int *a, *b;
+    int j;
+    
+    for(int i = 0; i < m; i++){
+        a = ap + i*k * KERNEL_LANES;
+        for(j = 0; j + 4 <= n; j += 4){
+            c0 = c1 = c2 = c3 = _mm256_setzero_si256();
+            for(int p = 0; p < k; p++){
+                x = _mm256_load_si256((const __m256i *) (a + p * KERNEL_LANES));
+                b = bp + (p*n + j) * KERNEL_LANES;
+                c0 = _mm256_add_epi32(c0, _mm256_mullo_epi32(x, _mm256_load_si256((const __m256i *) b)));
+                c1 = _mm256_add_epi32(c1, _mm256_mullo_epi32(x, _mm256_load_si256((const __m256i *) (b + KERNEL_LANES))));
+                c2 = _mm256_add_epi32(c2, _mm256_mullo_epi32(x, _mm256_load_si256((const __m256i *) (b + 2*KERNEL_LANES))));
+                c3 = _mm256_add_epi32(c3, _mm256_mullo_epi32(x, _mm256_load_si256((const __m256i *) (b + 3*KERNEL_LANES))));
+            }
+            _mm256_store_si256((__m256i *) (cp + (i*n + j) * KERNEL_LANES), c0);
+            _mm256_store_si256((__m256i *) (cp + (i*n + j + 1) * KERNEL_LANES), c1);
+            _mm256_store_si256((__m256i *) (cp + (i*n + j + 2) * KERNEL_LANES), c2);
+            _mm256_store_si256((__m256i *) (cp + (i*n + j + 3) * KERNEL_LANES), c3);
+        }
+        for(; j < n; j++){
+            c0 = _mm256_setzero_si256();
+            for(int p = 0; p < k; p++)
+                c0 = _mm256_add_epi32(c0, _mm256_mullo_epi32(_mm256_load_si256((const __m256i *) (a + p * KERNEL_LANES)),
+                                                             _mm256_load_si256((const __m256i *) (bp + (p*n + j) * KERNEL_LANES))));
+            _mm256_store_si256((__m256i *) (cp + (i*n + j) * KERNEL_LANES), c0);
+        }
+    }
+    _mm256_zeroupper();
+}
+
+static int avx512vnni_supported(void){
+    return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+}
+
+// Whole 4x4 tile per pass, 16 accumulators fit the 32 zmm registers
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void micro_kernel_avx512vnni(const char *ap, const char *bp, int kc, int *c, int ldc){
+    int sums[KERNEL_MR * KERNEL_NR] = {0};
+    int k32 = kc & ~31;
+    __m512i acc[KERNEL_MR][KERNEL_NR], x[KERNEL_MR], y;
+    
+    for(int i = 0; i < KERNEL_MR; i++){
+        for(int j = 0; j < KERNEL_NR; j++)
+            acc[i][j] = _mm512_setzero_si512();
+    }
+    for(int k = 0; k < k32; k += 32){
+        for(int i = 0; i < KERNEL_MR; i++)
+            x[i] = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *) (ap + i*kc + k)));
+        for(int j = 0; j < KERNEL_NR; j++){
+            y = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *) (bp + j*kc + k)));
+            for(int i = 0; i < KERNEL_MR; i++)
+                acc[i][j] = _mm512_dpwssd_epi32(acc[i][j], x[i], y);
+        }
+    }
+    for(int i = 0; i < KERNEL_MR; i++){
+        for(int j = 0; j < KERNEL_NR; j++)
+            sums[i*KERNEL_NR + j] = _mm512_reduce_add_epi32(acc[i][j]);
+    }
+    _mm256_zeroupper();
+    micro_tail(ap, bp, kc, k32, sums);
+    micro_store(sums, c, ldc);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void micro_kernel16_avx512vnni(const int16_t *ap, const int16_t *bp, int kc, int *c, int ldc){
+    int sums[KERNEL_MR * KERNEL_NR] = {0};
+    int k32 = kc & ~31;
+    __m512i acc[KERNEL_MR][KERNEL_NR], x[KERNEL_MR], y;
+    
+    for(int i = 0; i < KERNEL_MR; i++){
+        for(int j = 0; j < KERNEL_NR; j++)
+            acc[i][j] = _mm512_setzero_si512();
+    }
+    for(int k = 0; k < k32; k += 32){
+        for(int i = 0; i < KERNEL_MR; i++)
+            x[i] = _mm512_loadu_si512((const void *) (ap + i*kc + k));
+        for(int j = 0; j < KERNEL_NR; j++){
+            y = _mm512_loadu_si512((const void *) (bp + j*kc + k));
+            for(int i = 0; i < KERNEL_MR; i++)
+                acc[i][j] = _mm512_dpwssd_epi32(acc[i][j], x[i], y);
+        }
+    }
+    for(int i = 0; i < KERNEL_MR; i++){
+        for(int j = 0; j < KERNEL_NR; j++)
+            sums[i*KERNEL_NR + j] = _mm512_reduce_add_epi32(acc[i][j]);
+    }
+    _mm256_zeroupper();
+    micro_tail16(ap, bp, kc, k32, sums);
+    micro_store(sums, c, ldc);
+}
+#endif /* KERNEL_X86 */
+
+// Fastest last, "auto" picks the last supported entry
+static const struct kernel_variant variants[] = {
+    {"scalar", always_supported, micro_kernel_scalar, micro_kernel16_scalar, batch_kernel_scalar},
+#ifdef KERNEL_X86
+    {"sse4.1", sse41_supported, micro_kernel_sse41, micro_kernel16_sse41, batch_kernel_sse41},
+    {"avx2", avx2_supported, micro_kernel_avx2, micro_kernel16_avx2, batch_kernel_avx2},
+    {"avx512vnni", avx512vnni_supported, micro_kernel_avx512vnni, micro_kernel16_avx512vnni, batch_kernel_avx2}, // Eight lanes fill a ymm, the AVX2 one is as fast
+#endif
+};
+static const int variant_count = sizeof(variants) / sizeof(variants[0]);
+static const struct kernel_variant *selected = &variants[0];
+
+/**
+ Picks the micro-kernel by name, "auto" for the best one this CPU runs.
+ Must be called before the workers are forked.
+return:
+   0 on success
+  -1 when the name is unknown or the CPU lacks the instructions
+*/
+int kernel_select(const char *name){
+    if(strcmp(name, "auto") == 0){
+        for(int i = variant_count - 1; i >= 0; i--){
+            if(variants[i].supported()){
+                selected = &variants[i];
+                return 0;
+            }
+        }
+    }
+    for(int i = 0; i < variant_count; i++){
+        if(strcmp(name, variants[i].name) == 0 && variants[i].supported()){
+            selected = &variants[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *kernel_name(void){
+    return selected->name;
+}
+
+#define BATCH_COUNT 19 // Pairs per self check batch, not a multiple of KERNEL_LANES
+
+/**
+ Runs every supported variant against the scalar kernel on random
+ char and int16 operands, including sizes that leave ragged edges and
+ k tails, and every batch kernel against products done one by one.
+return:
+   0 when all variants agree
+   1 on any mismatch
+*/
+int kernel_self_check(void){
+    static const int sizes[][3] = {{4, 4, 4}, {8, 8, 8}, {37, 29, 53}, {64, 64, 300}, {130, 70, 257}};
+    static const int batch_sizes[][3] = {{4, 4, 4}, {8, 8, 8}, {3, 7, 5}};
+    const struct kernel_variant *saved = selected;
+    int failed = 0, rows, cols, inner, mismatch;
+    size_t pair;
+    char *a, *b;
+    int16_t *a16, *b16;
+    int *expected, *got;
+    
+    srand(1);
+    for(int s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])); s++){
+        rows = sizes[s][0]; cols = sizes[s][1]; inner = sizes[s][2];
+        a = malloc((size_t) rows * inner);
+        b = malloc((size_t) inner * cols);
+        expected = malloc((size_t) rows * cols * sizeof(int));
+        got = malloc((size_t) rows * cols * sizeof(int));
+        if(a == NULL || b == NULL || expected == NULL || got == NULL){
+            fprintf(stderr, "Failed allocated memory : malloc() in kernel_self_check()\n");
+            exit(EXIT_FAILURE);
+        }
+        // Whole signed char range, not only printable input
+        for(int i = 0; i < rows * inner; i++)
+            a[i] = (char) (rand() % 256 - 128);
+        for(int i = 0; i < inner * cols; i++)
+            b[i] = (char) (rand() % 256 - 128);
+        
+        selected = &variants[0];
+        multiply_blocked(a, inner, b, cols, expected, cols, rows, cols, inner);
+        
+        for(int v = 1; v < variant_count; v++){
+            if(!variants[v].supported()){
+                printf("%-12s %dx%dx%d skipped, not supported by this CPU\n", variants[v].name, rows, inner, cols);
+                continue;
+            }
+            selected = &variants[v];
+            multiply_blocked(a, inner, b, cols, got, cols, rows, cols, inner);
+            mismatch = memcmp(expected, got, (size_t) rows * cols * sizeof(int)) != 0;
+            printf("%-12s %dx%dx%d %s\n", variants[v].name, rows, inner, cols, mismatch ? "FAIL" : "ok");
+            failed |= mismatch;
+        }
+        free(a); free(b); free(expected); free(got);
+    }
+    
+    // int16 operands as Strassen forms them, a few levels of sums of chars
+    for(int s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])); s++){
+        rows = sizes[s][0]; cols = sizes[s][1]; inner = sizes[s][2];
+        a16 = malloc((size_t) rows * inner * sizeof(int16_t));
+        b16 = malloc((size_t) inner * cols * sizeof(int16_t));
+        expected = malloc((size_t) rows * cols * sizeof(int));
+        got = malloc((size_t) rows * cols * sizeof(int));
+        if(a16 == NULL || b16 == NULL || expected == NULL || got == NULL){
+            fprintf(stderr, "Failed allocated memory : malloc() in kernel_self_check()\n");
+            exit(EXIT_FAILURE);
+        }
+        for(int i = 0; i < rows * inner; i++)
+            a16[i] = (int16_t) (rand() % 4096 - 2048);
+        for(int i = 0; i < inner * cols; i++)
+            b16[i] = (int16_t) (rand() % 4096 - 2048);
+        
+        selected = &variants[0];
+        multiply_blocked_int16(a16, inner, b16, cols, expected, cols, rows, cols, inner);
+        
+        for(int v = 1; v < variant_count; v++){
+            if(!variants[v].supported())
+                continue;
+            selected = &variants[v];
+            multiply_blocked_int16(a16, inner, b16, cols, got, cols, rows, cols, inner);
+            mismatch = memcmp(expected, got, (size_t) rows * cols * sizeof(int)) != 0;
+            printf("%-12s int16 %dx%dx%d %s\n", variants[v].name, rows, inner, cols, mismatch ? "FAIL" : "ok");
+            failed |= mismatch;
+        }
+        free(a16); free(b16); free(expected); free(got);
+    }
+    
+    // Batches of BATCH_COUNT pairs, the last group of lanes only partly filled
+    for(int s = 0; s < (int) (sizeof(batch_sizes) / sizeof(batch_sizes[0])); s++){
+        rows = batch_sizes[s][0]; inner = batch_sizes[s][1]; cols = batch_sizes[s][2];
+        pair = (size_t) rows * inner + (size_t) inner * cols;
+        a = malloc(BATCH_COUNT * pair);
+        expected = malloc(BATCH_COUNT * (size_t) rows * cols * sizeof(int));
+        got = malloc(BATCH_COUNT * (size_t) rows * cols * sizeof(int));
+        if(a == NULL || expected == NULL || got == NULL){
+            fprintf(stderr, "Failed allocated memory : malloc() in kernel_self_check()\n");
+            exit(EXIT_FAILURE);
+        }
+        for(size_t i = 0; i < BATCH_COUNT * pair; i++)
+            a[i] = (char) (rand() % 256 - 128);
+        
+        selected = &variants[0];
+        for(int p = 0; p < BATCH_COUNT; p++)
+            multiply_blocked(a + p*pair, inner, a + p*pair + rows*inner, cols, expected + p*rows*cols, cols, rows, cols, inner);
+        
+        for(int v = 0; v < variant_count; v++){
+            if(!variants[v].supported())
+                continue;
+            selected = &variants[v];
+            multiply_batch(a, BATCH_COUNT, rows, inner, cols, got);
+            mismatch = memcmp(expected, got, BATCH_COUNT * (size_t) rows * cols * sizeof(int)) != 0;
+            printf("%-12s batch of %d %dx%dx%d %s\n", variants[v].name, BATCH_COUNT, rows, inner, cols, mismatch ? "FAIL" : "ok");
+            failed |= mismatch;
+        }
+        free(a); free(expected); free(got);
+    }
+    selected = saved;
+    return failed;
+}
+
+// Ragged right/bottom edge of a block, fewer than 4 rows or columns
+static void edge_kernel(const char *ap, const char *bp, int kc, int mr, int nr, int *c, int ldc){
+    int sum;
+    
+    for(int i = 0; i < mr; i++){
+        for(int j = 0; j < nr; j++){
+            sum = 0;
+            for(int k = 0; k < kc; k++)
+                sum += ap[i*kc + k] * bp[j*kc + k];
+            c[(size_t) i*ldc + j] += sum;
+        }
+    }
+}
+
+/**
+ [rows x inner] . [inner x cols] -> [rows x cols], same contract as
+ multiply_matrices(). Integer results are identical to the naive loop,
+ only the order of the additions changes.
+ */
+void multiply_blocked(const char *a, int lda, const char *b, int ldb, int *c, int ldc, int rows, int cols, int inner){
+    char panel[KERNEL_KC * KERNEL_NC] __attribute__((aligned(64)));
+    char block[KERNEL_MC * KERNEL_KC] __attribute__((aligned(64)));
+    int kc, nc, mc, mr, nr;
+    
+    for(int i = 0; i < rows; i++)
+        memset(c + (size_t) i*ldc, 0, cols * sizeof(int));
+    
+    for(int j0 = 0; j0 < cols; j0 += KERNEL_NC){
+        nc = cols - j0 < KERNEL_NC ? cols - j0 : KERNEL_NC;
+        for(int k0 = 0; k0 < inner; k0 += KERNEL_KC){
+            kc = inner - k0 < KERNEL_KC ? inner - k0 : KERNEL_KC;
+            pack_b(b + (size_t) k0*ldb + j0, ldb, kc, nc, panel);
+            
+            for(int i0 = 0; i0 < rows; i0 += KERNEL_MC){
+                mc = rows - i0 < KERNEL_MC ? rows - i0 : KERNEL_MC;
+                pack_a(a + (size_t) i0*lda + k0, lda, mc, kc, block);
+                
+                for(int i = 0; i < mc; i += KERNEL_MR){
+                    mr = mc - i < KERNEL_MR ? mc - i : KERNEL_MR;
+                    for(int j = 0; j < nc; j += KERNEL_NR){
+                        nr = nc - j < KERNEL_NR ? nc - j : KERNEL_NR;
+                        if(mr == KERNEL_MR && nr == KERNEL_NR)
+                            selected->micro(block + i*kc, panel + j*kc, kc, c + (size_t) (i0+i)*ldc + j0 + j, ldc);
+                        else
+                            edge_kernel(block + i*kc, panel + j*kc, kc, mr, nr, c + (size_t) (i0+i)*ldc + j0 + j, ldc);
+                    }
+                }
+            }
+        }
+    }
+}
+
+#ifdef KERNEL_X86
+// Sixteen chars -> two elements of KERNEL_LANES sign extended ints each
+static void widen_store(__m128i v, int *dst){
+    __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), v), w;
+    
+    w = _mm_unpacklo_epi8(v, sign);
+    _mm_store_si128((__m128i *) dst, _mm_unpacklo_epi16(w, _mm_srai_epi16(w, 15)));
+    _mm_store_si128((__m128i *) (dst + 4), _mm_unpackhi_epi16(w, _mm_srai_epi16(w, 15)));
+    w = _mm_unpackhi_epi8(v, sign);
+    _mm_store_si128((__m128i *) (dst + 8), _mm_unpacklo_epi16(w, _mm_srai_epi16(w, 15)));
+    _mm_store_si128((__m128i *) (dst + 12), _mm_unpackhi_epi16(w, _mm_srai_epi16(w, 15)));
+}
+#endif
+
+/*
+ Operand at the same offset in each of lanes pairs -> element e of lane l
+ at dst[e*KERNEL_LANES + l]. A full group goes through 8x8 byte transposes,
+ SSE2 only so every x86-64 takes it, the rest one element at a time.
+ */
+static void batch_pack(const char *src, size_t pair, size_t size, int lanes, int *dst){
+    size_t e = 0;
+    
+    // Lanes past the end of the batch multiply zeros
+    if(lanes < KERNEL_LANES)
+        memset(dst, 0, size * KERNEL_LANES * sizeof(int));
+#ifdef KERNEL_X86
+    __m128i r[KERNEL_LANES], t0, t1, t2, t3, u0, u1, u2, u3;
+    
+    for(; lanes == KERNEL_LANES && e + 8 <= size; e += 8){
+        for(int l = 0; l < KERNEL_LANES; l++)
+            r[l] = _mm_loadl_epi64((const __m128i *) (src + l*pair + e));
+        t0 = _mm_unpacklo_epi8(r[0], r[1]);
+        t1 = _mm_unpacklo_epi8(r[2], r[3]);
+        t2 = _mm_unpacklo_epi8(r[4], r[5]);
+        t3 = _mm_unpacklo_epi8(r[6], r[7]);
+        u0 = _mm_unpacklo_epi16(t0, t1);
+        u1 = _mm_unpackhi_epi16(t0, t1);
+        u2 = _mm_unpacklo_epi16(t2, t3);
+        u3 = _mm_unpackhi_epi16(t2, t3);
+        widen_store(_mm_unpacklo_epi32(u0, u2), dst + e * KERNEL_LANES);
+        widen_store(_mm_unpackhi_epi32(u0, u2), dst + (e + 2) * KERNEL_LANES);
+        widen_store(_mm_unpacklo_epi32(u1, u3), dst + (e + 4) * KERNEL_LANES);
+        widen_store(_mm_unpackhi_epi32(u1, u3), dst + (e + 6) * KERNEL_LANES);
+    }
+#endif
+    for(int l = 0; l < lanes; l++){
+        for(size_t i = e; i < size; i++)
+            dst[i*KERNEL_LANES + l] = src[l*pair + i];
+    }
+}
+
+// Inverse of batch_pack() for the products, 4x4 int transposes on x86
+static void batch_unpack(const int *cp, size_t size, int lanes, int *c){
+    size_t e = 0;
+    
+#ifdef KERNEL_X86
+    __m128i x0, x1, x2, x3, t0, t1, t2, t3;
+    
+    for(; lanes == KERNEL_LANES && e + 4 <= size; e += 4){
+        for(int h = 0; h < KERNEL_LANES; h += 4){
+            x0 = _mm_load_si128((const __m128i *) (cp + e * KERNEL_LANES + h));
+            x1 = _mm_load_si128((const __m128i *) (cp + (e + 1) * KERNEL_LANES + h));
+            x2 = _mm_load_si128((const __m128i *) (cp + (e + 2) * KERNEL_LANES + h));
+            x3 = _mm_load_si128((const __m128i *) (cp + (e + 3) * KERNEL_LANES + h));
+            t0 = _mm_unpacklo_epi32(x0, x1);
+            t1 = _mm_unpacklo_epi32(x2, x3);
+            t2 = _mm_unpackhi_epi32(x0, x1);
+            t3 = _mm_unpackhi_epi32(x2, x3);
+            _mm_storeu_si128((__m128i *) (c + h*size + e), _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128((__m128i *) (c + (h + 1) * size + e), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128((__m128i *) (c + (h + 2) * size + e), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128((__m128i *) (c + (h + 3) * size + e), _mm_unpackhi_epi64(t2, t3));
+        }
+    }
+#endif
+    for(int l = 0; l < lanes; l++){
+        for(size_t i = e; i < size; i++)
+            c[l*size + i] = cp[i*KERNEL_LANES + l];
+    }
+}
+
+/**
+ C of every pair of a batch, pairs are [m x k] A then [k x n] B back to
+ back, the products are [m x n] each, back to back in c. Small pairs go
+ KERNEL_LANES at a time through the batch kernel, larger ones one by one
+ through the blocked kernel.
+ */
+void multiply_batch(const char *pairs, int count, int m, int k, int n, int *c){
+    size_t a_size = (size_t) m * k, b_size = (size_t) k * n, c_size = (size_t) m * n, pair = a_size + b_size;
+    int *ap, *bp, *cp, lanes;
+    const char *src;
+    
+    if(m > KERNEL_BATCH_MAX || k > KERNEL_BATCH_MAX || n > KERNEL_BATCH_MAX){
+        for(int p = 0; p < count; p++)
+            multiply_blocked(pairs + p*pair, k, pairs + p*pair + a_size, n, c + p*c_size, n, m, n, k);
+        return;
+    }
+    
+    // Lane l of element e at [e*KERNEL_LANES + l], a whole number of cache lines each
+    ap = aligned_alloc(64, (a_size * KERNEL_LANES * sizeof(int) + 63) & ~(size_t) 63);
+    bp = aligned_alloc(64, (b_size * KERNEL_LANES * sizeof(int) + 63) & ~(size_t) 63);
+    cp = aligned_alloc(64, (c_size * KERNEL_LANES * sizeof(int) + 63) & ~(size_t) 63);
+    if(ap == NULL || bp == NULL || cp == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in multiply_batch()\n");
+        _exit(EXIT_FAILURE);
+    }
+    
+    for(int p0 = 0; p0 < count; p0 += KERNEL_LANES){
+        lanes = count - p0 < KERNEL_LANES ? count - p0 : KERNEL_LANES;
+        src = pairs + p0 * pair;
+        batch_pack(src, pair, a_size, lanes, ap);
+        batch_pack(src + a_size, pair, b_size, lanes, bp);
+        
+        selected->batch(ap, bp, m, k, n, cp);
+        
+        batch_unpack(cp, c_size, lanes, c + p0 * c_size);
+    }
+    free(ap);
+    free(bp);
+    free(cp);
+}
+
+// edge_kernel() on int16 operands
+static void edge_kernel16(const int16_t *ap, const int16_t *bp, int kc, int mr, int nr, int *c, int ldc){
+    int sum;
+    
+    for(int i = 0; i < mr; i++){
+        for(int j = 0; j < nr; j++){
+            sum = 0;
+            for(int k = 0; k < kc; k++)
+                sum += ap[i*kc + k] * bp[j*kc + k];
+            c[(size_t) i*ldc + j] += sum;
+        }
+    }
+}
+
+/**
+ multiply_blocked() for int16 operands, used where the operands are sums
+ of input elements (Strassen). Same blocking, the selected variant's
+ int16 micro-kernel.
+ */
+void multiply_blocked_int16(const int16_t *a, int lda, const int16_t *b, int ldb, int *c, int ldc, int rows, int cols, int inner){
+    int16_t panel[KERNEL_KC * KERNEL_NC] __attribute__((aligned(64)));
+    int16_t block[KERNEL_MC * KERNEL_KC] __attribute__((aligned(64)));
+    int kc, nc, mc, mr, nr;
+    
+    for(int i = 0; i < rows; i++)
+        memset(c + (size_t) i*ldc, 0, cols * sizeof(int));
+    
+    for(int j0 = 0; j0 < cols; j0 += KERNEL_NC){
+        nc = cols - j0 < KERNEL_NC ? cols - j0 : KERNEL_NC;
+        for(int k0 = 0; k0 < inner; k0 += KERNEL_KC){
+            kc = inner - k0 < KERNEL_KC ? inner - k0 : KERNEL_KC;
+            pack_b16(b + (size_t) k0*ldb + j0, ldb, kc, nc, panel);
+            
+            for(int i0 = 0; i0 < rows; i0 += KERNEL_MC){
+                mc = rows - i0 < KERNEL_MC ? rows - i0 : KERNEL_MC;
+                pack_a16(a + (size_t) i0*lda + k0, lda, mc, kc, block);
+                
+                for(int i = 0; i < mc; i += KERNEL_MR){
+                    mr = mc - i < KERNEL_MR ? mc - i : KERNEL_MR;
+                    for(int j = 0; j < nc; j += KERNEL_NR){
+                        nr = nc - j < KERNEL_NR ? nc - j : KERNEL_NR;
+                        if(mr == KERNEL_MR && nr == KERNEL_NR)
+                            selected->micro16(block + i*kc, panel + j*kc, kc, c + (size_t) (i0+i)*ldc + j0 + j, ldc);
+                        else
+                            edge_kernel16(block + i*kc, panel + j*kc, kc, mr, nr, c + (size_t) (i0+i)*ldc + j0 + j, ldc);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,53 @@
+//
+//  kernel.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef kernel_h
+#define kernel_h
+
+#include "globals.h"
+#include <stdint.h>
+/*
+ Cache blocked char matrix multiply.
+ B is packed column by column into panels so the inner product of a row
+ of A and a column of B walks both operands with unit stride, A is packed
+ block by block, and a 4x4 register tile of C is updated per pass.
+ The 4x4 micro-kernel has SIMD variants picked at startup from cpuid.
+ Strassen operands are sums of input elements, they go through the same
+ blocking and micro-kernels with int16 elements in place of chars.
+ Batches of small products are vectorized across matrices instead:
+ KERNEL_LANES pairs are interleaved element by element, so one vector
+ operation does the same multiply-add in KERNEL_LANES products at once.
+ */
+
+// Block sizes: KC x NC panel of B stays in L2, MC x KC block of A in L1
+#define KERNEL_MC 64
+#define KERNEL_KC 256
+#define KERNEL_NC 256
+#define KERNEL_MR 4     // Register tile, rows of C
+#define KERNEL_NR 4     // Register tile, columns of C
+#define KERNEL_LANES 8  // Products of a batch computed side by side, one per 32 bit lane of an AVX2 register
+#define KERNEL_BATCH_MAX 32 // Largest side the batch kernel takes, bigger pairs go through the blocked kernel
+
+// A micro-kernel implementation, C[4x4] += A[4 x kc] . B[kc x 4] on packed char or int16 operands,
+// and the batch kernel, C = A . B for KERNEL_LANES interleaved [m x k] . [k x n] pairs
+struct kernel_variant {
+    const char *name;
+    int (*supported)(void);
+    void (*micro)(const char *ap, const char *bp, int kc, int *c, int ldc);
+    void (*micro16)(const int16_t *ap, const int16_t *bp, int kc, int *c, int ldc);
+    void (*batch)(const int *ap, const int *bp, int m, int k, int n, int *cp);
+};
+
+int kernel_select(const char *name);
+const char *kernel_name(void);
+int kernel_self_check(void);
+void multiply_blocked(const char *a, int lda, const char *b, int ldb, int *c, int ldc, int rows, int cols, int inner);
+void multiply_batch(const char *pairs, int count, int m, int k, int n, int *c);
+void multiply_blocked_int16(const int16_t *a, int lda, const int16_t *b, int ldb, int *c, int ldc, int rows, int cols, int inner);
+
+#endif /* kernel_h */
@@ -8,24 +8,132 @@
 
 #include "globals.h"
 #include "parser.h"
+#include "matrix.h"
+#include "kernel.h"
+#include "shm.h"
+#include "protocol.h"
+#include "pool.h"
+#include "strassen.h"
+#include "svd.h"
+#include "tpool.h"
+#include "sock.h"
+#include "matfile.h"
+#include "writer.h"
+#include "stats.h"
+#include "stream.h"
+#include "cache.h"
+#include "delta.h"
+#include "chain.h"
+
+#define TILE_WINDOW 2 // Tiles queued per worker, the next one is ready when a tile finishes
+#define REMOTE_WINDOW 4 // Tiles queued per remote worker, more to cover the network round trip
+#define BATCH_SLICE_BYTES (256 * 1024) // Input bytes of one batch task, thousands of small pairs
+#define THREAD_TILE KERNEL_NC // Default tile side with threads, one packed panel of B, small enough for stealing to even out the load
 
 // Allocated buffers & file pointers needs to be visible to exit handler, cleanup()
 char *matrix1_buffer, *matrix2_buffer, *required_quarters1, *required_quarters2;
-double **combined_result, * singular_values;
+double *combined_result, * singular_values; // SVD workspace, column major with leading dimension svd_ld
+int *result_c;          // C [dim_m x dim_n], filled as tiles arrive
 int i1_fd, i2_fd;
-int n2;
-pid_t pid[4];
+struct matfile_header header1, header2; // Binary inputs, all zero for raw text ones
+int dim_m, dim_k, dim_n; // A is [dim_m x dim_k], B is [dim_k x dim_n]
+int svd_rows, svd_cols, svd_ld; // C, or C' when it is wide, as the SVD sees it
+size_t input1_size, input2_size;
+struct pool pool;
+int worker_count, tile_count;
+int grid_rows, grid_cols; // Grid of the current multiply, -g or the backend's default
+enum algo algo;         // opts.algo, unless the sizes rule Strassen out
+int value_count;        // Singular values in singular_values
+int serve_fd;           // Listening socket of --serve
+volatile sig_atomic_t serving; // Cleared by SIGINT/SIGTERM to stop the server between jobs
+int batch_count, batch_slice; // --batch: pairs in matrix1_buffer, pairs per task, 0 when not batching
+struct options opts;
+struct writer out;      // Formatted matrices on their way to stdout
+struct cache cache;     // --cache
+int cached;             // C and the values came from the cache, nothing was computed
+int *tile_map;          // --incremental: grid index of every tile to compute, NULL to compute all of them
+struct cache_key *row_keys, *col_keys; // --incremental: this run's keys of the A row blocks and B column blocks
+
+// Wall clock phases of a run, printed by --timings in this order
+enum phase {PHASE_INGEST, PHASE_DISTRIBUTE, PHASE_MULTIPLY, PHASE_GATHER, PHASE_SVD, PHASE_OUTPUT, PHASE_COUNT};
+const char *phase_names[PHASE_COUNT] = {"ingest", "distribute", "multiply", "gather", "svd", "output"};
+double phase_seconds[PHASE_COUNT];
+double phase_first[PHASE_COUNT], phase_last[PHASE_COUNT]; // --stats: first start and last end of each phase, 0 when it never ran
+double epoch;           // Start of the run, --stats times are relative to it
+pid_t main_pid;         // Only the parent writes the --stats document
+struct counters parent_counters;
+struct worker_stats *worker_stats; // One per worker process, filled when the pool stops
+struct thread_stats *thread_stats; // One per thread of the last threaded multiply
+int thread_stats_count;
+int topk_iterations;    // Power iterations of the last svd_top_k()
+struct shm_region shm;
+int *products;          // Strassen: M1..M7 as they arrive
+int16_t *product_ops;   // Operands of the request being built
+const char *shared_a, *shared_b; // A and B as the workers see them when they need not be shipped, else NULL
 // Prototypes =============================================================
 
 // Input parsing and processing
-int get_i_j(int i, int j, char * matrix, int n);
-void get_quarter_column(char * matrix, char * column, int L_R);
-void get_quarter_row(char * matrix, char * row, int T_B);
-void process_quarter(int *cfd_p, int *fd_p, const char *name_str);
-void multiply_matrices(char *m1, char *m2, int *result);
+int tile_request(void *ctx, int index, struct msgbuf *out);
+int tile_result(void *ctx, const struct frame *f, const void *payload);
+int product_request(void *ctx, int index, struct msgbuf *out);
+int product_result(void *ctx, const struct frame *f, const void *payload);
+void combine_products(void);
+char *map_input(int fd, size_t offset, size_t size);
+int open_input(const char *path, int number, struct matfile_header *h, size_t *file_size);
+int load_input(int fd, const struct matfile_header *h, char *buffer, size_t size);
+void save_matrix(const char *path, int dtype, const void *data, int rows, int cols);
+void process_tiles(int worker, int in_fd, int out_fd);
+void process_product(struct frame *f, int in_fd, int out_fd, int *result);
+void process_batch(struct frame *f, int in_fd, int out_fd, int *result);
+void tile_compute(void *ctx, int index);
+void product_compute(void *ctx, int index);
+int plan_job(void);
+size_t tile_frame_bytes(int rows, int cols);
+int alloc_buffers(void);
+void free_buffers(void);
+int multiply(void);
+int run_threads(void);
+int grow_buffer(void **buffer, size_t *capacity, size_t size);
+
+//Batches of small products
+void run_batch(void);
+int batch_request(void *ctx, int index, struct msgbuf *out);
+int batch_result(void *ctx, const struct frame *f, const void *payload);
+void batch_compute(void *ctx, int index);
+
+//Out of core multiply
+void run_stream(size_t file_size1, size_t file_size2);
+
+//Result cache
+void run_key(struct cache_key *key);
+int lookup_run(const struct cache_key *key);
+
+//Incremental multiply
+void delta_header_of_run(struct delta_header *h);
+int plan_delta(void);
+
+//Chains and powers
+void run_chain(void);
+int64_t *load_chain_input(const char *path, int number, int *rows, int *cols);
+int64_t *chain_product(int64_t **leaves, const int *dims, const int *split, int count, int i, int j);
+int64_t *power_product(const int64_t *a, int n, int p);
+int64_t *multiply_step(const int64_t *a, const int64_t *b, int m, int k, int n);
+int wide_request(void *ctx, int index, struct msgbuf *out);
+int wide_result(void *ctx, const struct frame *f, const void *payload);
+void wide_compute(void *ctx, int index);
+void process_wide(struct frame *f, int in_fd, int out_fd, int64_t *result);
+void print_order(const int *split, int count, int i, int j);
+
+//Job server
+void serve(void);
+void serve_client(int client);
+int serve_job(int client, const struct frame *f);
+int reply_error(int client, const char *message);
+int remote_job(void);
 
 //Singular Value Decomposition
-void svd(double **A, double *S2, int n);
+void load_workspace(void);
+int singular_values_of_c(void);
 
 //Exit handler
 void cleanup(void);
@@ -34,24 +142,34 @@ void cleanup(void);
 void handle_SIGINT(int sig_no);
 
 //Utility
-void print_matrix(char *matrix, int n2, int ascii);
+void print_matrix(char *matrix, int rows, int cols, int ascii);
 void display_arr(double *array, int n);
-void display_arr_2d(double **array, int n);
+void display_result(int *array, int rows, int cols);
+void display_wide(const int64_t *array, int rows, int cols);
+void print_values(void);
+void display_vectors(double *v, int ld, int n);
+double seconds_now(void);
+double phase_mark(enum phase phase, double start);
+void multiply_phases(void);
+void print_timings(void);
+void attach_worker_stats(void);
+void start_workers(void);
+int connect_hosts(int window);
+void serve_tiles(void);
+void write_stats(void);
 // ============================================================= Prototypes
 
 int main(int argc, char * argv[]) {
-    char input1_path[255], input2_path[255];
-    int status, n, n2_x_n2, buffer_int;
-    int fd_p2[2], fd_p3[2], fd_p4[2], fd_p5[2];
-    int cfd_p2[2], cfd_p3[2], cfd_p4[2], cfd_p5[2];
-    ssize_t required_size;
-    pid_t  wpid;
-    struct stat st1;
-    struct stat st2;
+    struct cache_key key;
+    struct delta_header header;
+    int status, n2;
+    size_t a_size, b_size, c_size, file_size1 = 0, file_size2 = 0;
     struct sigaction sa;
+    double t;
     
     //Set up exit handler
     atexit(cleanup);
+    writer_init(&out, STDOUT_FILENO);
     
     //Set up singal handler
     memset(&sa, 0, sizeof(sa));
@@ -59,232 +177,238 @@ int main(int argc, char * argv[]) {
     sigaction(SIGINT, &sa, NULL);
     
     // Test argument validity and open files==================================
-    status = parse_arguments(input1_path, input2_path, &n, argc, argv);
+    status = parse_arguments(&opts, argc, argv);
     if(status == 0){ // Successful parse
+        epoch = seconds_now();
+        main_pid = getpid();
+        if(opts.stats){
+            stats_enabled = 1;
+            counters_open(&parent_counters);
+        }
         
-        if(n < 2){
-            fprintf(stderr,"N must be greater or equal to 2\n");
+        // Workers inherit the kernel picked here
+        if(kernel_select(opts.kernel) == -1){
+            fprintf(stderr,"Kernel %s is unknown or not supported by this CPU\n", opts.kernel);
+            exit(EXIT_FAILURE);
+        }
+        if(svd_select(opts.svd_kernel) == -1){
+            fprintf(stderr,"SVD kernel %s is unknown or not supported by this CPU\n", opts.svd_kernel);
             exit(EXIT_FAILURE);
         }
-        n2 = pow(2,n);
-        n2_x_n2 = n2*n2;
-        required_size = (ssize_t) n2_x_n2;
+        if(opts.self_check){
+            status = kernel_self_check();
+            printf("Kernel self check %s, default kernel: %s\n", status ? "FAILED" : "passed", kernel_name());
+            exit(status ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
         
-        // Create pipes ======================================================
+        // Jobs come over the socket, the server never returns
+        if(opts.serve_path[0] != '\0'){
+            sigaction(SIGTERM, &sa, NULL);
+            serve();
+            exit(EXIT_SUCCESS);
+        }
+        if(opts.worker_address[0] != '\0'){
+            sigaction(SIGTERM, &sa, NULL);
+            serve_tiles();
+            exit(EXIT_SUCCESS);
+        }
+        // A chain opens its own files, a power its one input
+        if(opts.chain[0] != '\0' || opts.power > 0){
+            run_chain();
+            exit(EXIT_SUCCESS);
+        }
         
-        if (pipe(fd_p2) == -1 || pipe(fd_p3) == -1 || pipe(fd_p4) == -1 || pipe(fd_p5) == -1)
-            exit(EXIT_FAILURE);
+        // Binary inputs are recognized by their header, anything else is raw text
+        t = seconds_now();
+        if(opts.batch_path[0] == '\0'){
+            i1_fd = open_input(opts.input1_path, 1, &header1, &file_size1);
+            i2_fd = open_input(opts.input2_path, 2, &header2, &file_size2);
+            if(i1_fd == -1 || i2_fd == -1)
+                exit(EXIT_FAILURE);
+        }
         
-        if (pipe(cfd_p2) == -1 || pipe(cfd_p3) == -1 || pipe(cfd_p4) == -1 || pipe(cfd_p5) == -1)
+        // Explicit --dims wins, then the sizes of two binary inputs, otherwise square 2^n matrices
+        if(opts.dim_m > 0){
+            dim_m = opts.dim_m; dim_k = opts.dim_k; dim_n = opts.dim_n;
+        }
+        else if(opts.n == 0 && header1.magic != 0 && header2.magic != 0){
+            dim_m = (int) header1.rows; dim_k = (int) header1.cols; dim_n = (int) header2.cols;
+        }
+        else{
+            if(opts.n < 2){
+                fprintf(stderr,"N must be greater or equal to 2\n");
+                exit(EXIT_FAILURE);
+            }
+            n2 = pow(2,opts.n);
+            dim_m = dim_k = dim_n = n2;
+        }
+        if((header1.magic != 0 && (header1.rows != (uint64_t) dim_m || header1.cols != (uint64_t) dim_k)) ||
+           (header2.magic != 0 && (header2.rows != (uint64_t) dim_k || header2.cols != (uint64_t) dim_n))){
+            fprintf(stderr,"Binary inputs do not hold a %dx%d A and a %dx%d B\n", dim_m, dim_k, dim_k, dim_n);
+            exit(EXIT_FAILURE);
+        }
+        if(opts.batch_path[0] != '\0'){
+            run_batch();
+            exit(EXIT_SUCCESS);
+        }
+        if(opts.stream_budget > 0){
+            run_stream(file_size1, file_size2);
+            exit(EXIT_SUCCESS);
+        }
+        if(plan_job() == -1)
             exit(EXIT_FAILURE);
         
-        // ===================================================================
+        // The mapping is only used as it is for a dense char matrix, other binary inputs are converted
+        if(opts.ingest == INGEST_MMAP && ((header1.magic != 0 && !matfile_is_dense_int8(&header1)) ||
+                                          (header2.magic != 0 && !matfile_is_dense_int8(&header2)))){
+            printf("Binary input is not a dense int8 matrix, reading it instead of mapping\n");
+            opts.ingest = INGEST_READ;
+        }
         
-        // Create 4 childeren process=========================================
-        for (int i=0;i<4;i++) {
-            pid[i] = fork();
-            if (pid[i] == 0)
-                break;
+        // Shared region must exist before fork() to be inherited, Strassen keeps M1..M7 in the C part
+        // A mapped input needs no copy in it
+        a_size = opts.ingest == INGEST_MMAP ? 0 : input1_size;
+        b_size = opts.ingest == INGEST_MMAP ? 0 : input2_size;
+        c_size = (size_t) dim_m * dim_n;
+        if(algo == ALGO_STRASSEN)
+            c_size = STRASSEN_PRODUCTS * (c_size / 4);
+        if(opts.transport == TRANSPORT_SHM && shm_create(&shm, a_size, b_size, c_size) == -1){
+            fprintf(stderr, "Shared memory could not be created: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
         }
-        // ===================================================================
         
-        // Parent process ====================================================
-        if (pid[0] != 0 && pid[1] != 0 && pid[2] != 0 && pid[3] != 0) {
-            // That's the father, it waits for all the childs
-            printf("I'm the father [pid: %d, ppid: %d]\n",getpid(),getppid());
-            
-            // File 1 access and size validity====================================
-            i1_fd = open(input1_path, O_RDONLY);
-            
-            if(i1_fd == -1){
-                fprintf(stderr,"Input 1 file could not be opened: %s\n", strerror(errno));
-                exit(EXIT_FAILURE);
-            }
-            
-            
-            stat(input1_path, &st1);
-            ssize_t file_size1 = st1.st_size;
-            
-            if(file_size1 < required_size){
-                fprintf(stderr,"Not enough characters to read in file 1: %lu bytes, expected : %lu bytes, \n", file_size1, required_size);
-                exit(EXIT_FAILURE);
-            }
-            // ===================================================================
-
-            // File 2 access and size validity====================================
-            i2_fd = open(input2_path, O_RDONLY);
-            
-            if(i2_fd == -1){
-                fprintf(stderr,"Input 2 file could not be opened: %s\n", strerror(errno));
-                exit(EXIT_FAILURE);
-            }
-            
-            
-            stat(input2_path, &st2);
-            ssize_t file_size2 = st2.st_size;
-            
-            if(file_size2 < required_size){
-                fprintf(stderr,"Not enough characters to read in file 2: %lu bytes, expected : %lu bytes, \n", file_size2, required_size);
+        // File sizes, a binary header was checked against its file already
+        if(header1.magic == 0 && file_size1 < input1_size){
+            fprintf(stderr,"Not enough characters to read in file 1: %lu bytes, expected : %lu bytes, \n", file_size1, input1_size);
+            exit(EXIT_FAILURE);
+        }
+        if(header2.magic == 0 && file_size2 < input2_size){
+            fprintf(stderr,"Not enough characters to read in file 2: %lu bytes, expected : %lu bytes, \n", file_size2, input2_size);
+            exit(EXIT_FAILURE);
+        }
+        
+        // Allocate buffers, with shm the inputs are read straight into the shared region
+        if(opts.ingest == INGEST_MMAP){
+            matrix1_buffer = map_input(i1_fd, header1.offset, input1_size);
+            matrix2_buffer = map_input(i2_fd, header2.offset, input2_size);
+            if(matrix1_buffer == NULL || matrix2_buffer == NULL){
+                fprintf(stderr, "Input files could not be mapped: %s\n", strerror(errno));
                 exit(EXIT_FAILURE);
             }
+        }
+        else if(opts.transport == TRANSPORT_SHM){
+            matrix1_buffer = shm.a;
+            matrix2_buffer = shm.b;
+        }
+        if(alloc_buffers() == -1)
+            exit(EXIT_FAILURE);
+        
+    // =======================================================================
+        
+        // Read files into allocated char arrays==============================
+        if(opts.ingest == INGEST_READ && load_input(i1_fd, &header1, matrix1_buffer, input1_size) == -1){
+            fprintf(stderr,"Error when reading file 1 : not enough bytes to fill matrix\n");
+            exit(EXIT_FAILURE);
+        }
+        
+        if(opts.ingest == INGEST_READ && load_input(i2_fd, &header2, matrix2_buffer, input2_size) == -1){
+            fprintf(stderr,"Error when reading file 2 : not enough bytes to fill matrix\n");
+            exit(EXIT_FAILURE);
+        }
+        
+        // Workers no longer check every access, '\0' is a valid element of a binary input
+        if((header1.magic == 0 && check_matrix(matrix1_buffer, dim_m, dim_k) == -1) ||
+           (header2.magic == 0 && check_matrix(matrix2_buffer, dim_k, dim_n) == -1))
+            exit(EXIT_FAILURE);
+        
+        // Workers forked below see these, so tiles need not be shipped; remote ones do not
+        if((opts.ingest == INGEST_MMAP || opts.transport == TRANSPORT_SHM) && opts.host_count == 0){
+            shared_a = matrix1_buffer;
+            shared_b = matrix2_buffer;
+        }
+        // An earlier run of the same inputs and options has left C and the values
+        if(opts.cache_dir[0] != '\0'){
+            run_key(&key);
+            cached = lookup_run(&key);
+        }
+        // Only the tiles whose inputs changed since the state was written
+        if(opts.incremental_path[0] != '\0' && !cached && plan_delta() == -1)
+            exit(EXIT_FAILURE);
+        t = phase_mark(PHASE_INGEST, t);
+        // ===================================================================
+        
+        if(opts.connect_path[0] != '\0'){
+            // The server does the multiply and the SVD, all of it counts as the multiply
+            value_count = remote_job();
+            t = phase_mark(PHASE_MULTIPLY, t);
+        }
+        else if(!cached && tile_count > 0){
+            // Create worker processes, only the parent returns=================
+            start_workers();
             // ===================================================================
             
-            // Allocate buffers
-            matrix1_buffer = malloc(required_size * sizeof(char)+1);
-            matrix2_buffer = malloc(required_size * sizeof(char)+1);
-            required_quarters1 = malloc((n2_x_n2/2+1) * sizeof(char) +1); // I.E A11, A21 for C11
-            required_quarters2 = malloc((n2_x_n2/2+1) * sizeof(char) +1); // I.E B11, A12 for C11
+            // Parent process ====================================================
+            // That's the father, it feeds and drains all the childs
+            if(opts.backend == BACKEND_FORK)
+                printf("I'm the father [pid: %d, ppid: %d]\n",getpid(),getppid());
             
-            // Check if allocation is successful
-            if(matrix1_buffer == NULL || matrix2_buffer == NULL || required_quarters1 == NULL || required_quarters2 == NULL){
-                fprintf(stderr, "Failed allocated memory : malloc() in main()\n");
-                exit(EXIT_FAILURE);
-            }
+            t = phase_mark(PHASE_DISTRIBUTE, t);
             
-        // =======================================================================
-            
-            // Read files into allocated char arrays==============================
-            if(read(i1_fd, matrix1_buffer, n2_x_n2) != required_size){
-                fprintf(stderr,"Error when reading file 1 : not enough bytes to fill matrix\n");
+            // Distribute tiles and gather childeren outputs as they arrive=====
+            if(multiply() == -1){
+                fprintf(stderr, "Multiplication failed\n");
                 exit(EXIT_FAILURE);
             }
+            t = phase_mark(PHASE_MULTIPLY, t);
+            multiply_phases();
             
-            if(read(i2_fd, matrix2_buffer, n2_x_n2) != required_size){
-                fprintf(stderr,"Error when reading file 2 : not enough bytes to fill matrix\n");
-                exit(EXIT_FAILURE);
+            // Wait for all the childeren
+            if(opts.backend == BACKEND_FORK)
+                pool_stop(&pool);
+            t = phase_mark(PHASE_DISTRIBUTE, t);
+            if(opts.incremental_path[0] != '\0'){
+                delta_header_of_run(&header);
+                delta_save(opts.incremental_path, &header, row_keys, col_keys, result_c);
             }
             // ===================================================================
-            
-            
-            if(close(fd_p2[0]) == -1 || close(fd_p3[0]) == -1 || close(fd_p4[0]) == -1 || close(fd_p5[0]) == -1){
-                fprintf(stderr, "Unused read close error : Children > Parent\n");
-                exit(EXIT_FAILURE);
-            }
-            
-            if(close(cfd_p2[1]) == -1 || close(cfd_p3[1]) == -1 || close(cfd_p4[1]) == -1 || close(cfd_p5[1]) == -1){
-                fprintf(stderr, "Unused write close error : Parent > Childred\n");
-                exit(EXIT_FAILURE);
-            }
+        }
         
-            // Parent is writing
-            // [A11, A12] [B11, B21] combined in required_quarters
-            get_quarter_row(matrix1_buffer, required_quarters1, 0);
-            get_quarter_column(matrix2_buffer, required_quarters2, 0);
-            write(fd_p2[1], required_quarters1, strlen(required_quarters1));
-            write(fd_p2[1], required_quarters2, strlen(required_quarters2));
-           
-            // Parent is writing
-            // [A11, A12] [B12, B22] combined in required_quarters
-            get_quarter_row(matrix1_buffer, required_quarters1, 0);
-            get_quarter_column(matrix2_buffer, required_quarters2, 1);
-            write(fd_p3[1], required_quarters1, strlen(required_quarters1));
-            write(fd_p3[1], required_quarters2, strlen(required_quarters2));
+        //Display Matrix A and B, unless only the results are wanted
+        if(opts.output == OUTPUT_TEXT && !opts.quiet){
+            writer_text(&out, "Matrix A:\n");
+            print_matrix(matrix1_buffer, dim_m, dim_k, header1.magic == 0);
+            writer_text(&out, "Matrix B:\n");
+            print_matrix(matrix2_buffer, dim_k, dim_n, header2.magic == 0);
+        }
         
-            // Parent is writing
-            // [A12, A22] [B11, B21] combined in required_quarters
-            get_quarter_row(matrix1_buffer, required_quarters1, 1);
-            get_quarter_column(matrix2_buffer, required_quarters2, 0);
-            write(fd_p4[1], required_quarters1, strlen(required_quarters1));
-            write(fd_p4[1], required_quarters2, strlen(required_quarters2));
-
-            // Parent is writing
-            // [A12, A22] [B12, B22] combined in required_quarters
-            get_quarter_row(matrix1_buffer, required_quarters1, 1);
-            get_quarter_column(matrix2_buffer, required_quarters2, 1);
-            write(fd_p5[1], required_quarters1, strlen(required_quarters1));
-            write(fd_p5[1], required_quarters2, strlen(required_quarters2));
-       
-            if(close(fd_p2[1]) == -1 || close(fd_p3[1]) == -1 || close(fd_p4[1]) == -1 || close(fd_p5[1]) == -1){
-                fprintf(stderr, "Used write close error : Parent > Childeren\n");
-                exit(EXIT_FAILURE);
-            }
-
-            // Wait for all the childeren=====================================
-            do{
-                wpid = wait(NULL);
-            }
-            while (wpid == -1 && errno == EINTR);
-            
-            if (wpid == -1){
-                perror("Wait error\n");
-                exit(EXIT_FAILURE);
-            }
-            // =====================================Wait for all the childeren
-            
-            // Gather childeren outputs=======================================
-            
-            combined_result = malloc(sizeof(double*)*n2*2);
-            for(int i=0;i<2*n2;i++)
-                 combined_result[i] = malloc(sizeof(double)*n2);
+        //Display multiplication result, or write it out as it is
+        if((opts.reply & JOB_C) && opts.c_out[0] != '\0'){
+            save_matrix(opts.c_out, DTYPE_INT32, result_c, dim_m, dim_n);
+            printf("Matrix C: %s\n", opts.c_out);
+        }
+        else if((opts.reply & JOB_C) && opts.output == OUTPUT_TEXT){
+            writer_text(&out, "Matrix C:\n");
+            display_result(result_c, dim_m, dim_n);
+        }
+        // Everything so far is out before the SVD starts
+        writer_flush(&out);
+        t = phase_mark(PHASE_OUTPUT, t);
         
-            singular_values = malloc(n2 * sizeof(double));
-            
-            for(int i = 0; i < n2; i++){
-                for(int j = 0; j < n2; j++){
-                    if(i < n2/2 && j < n2/2) // TOP LEFT
-                        read(cfd_p2[0], &buffer_int, sizeof(int));
-                    else if(i < n2/2 && j >= n2/2) // TOP RIGHT
-                        read(cfd_p3[0], &buffer_int, sizeof(int));
-                    else if(i >= n2/2 && j < n2/2 ) // BOT LEFT
-                        read(cfd_p4[0], &buffer_int, sizeof(int));
-                    else                            //BOT RIGHT
-                        read(cfd_p5[0], &buffer_int, sizeof(int));
-                    combined_result[i][j] = buffer_int;
-                }
-            }
-
-            // ======================================= Gather childeren outputs
-            
-            //Display Matrix A
-            printf("Matrix A:\n");
-            print_matrix(matrix1_buffer, n2, 1);
-            
-            //Display Matrix B
-            printf("Matrix B:\n");
-            print_matrix(matrix2_buffer, n2, 1);
-            
-            //Display multiplication result
-            printf("Matrix C:\n");
-            display_arr_2d(combined_result, n2);
-            
-            //SVD
-            printf("Singular Values Squared:\n");
-            svd(combined_result, singular_values, n2);
-            display_arr(singular_values, n2);
-            
-            if(close(cfd_p2[0]) == -1 || close(cfd_p3[0]) == -1 || close(cfd_p4[0]) == -1 || close(cfd_p5[0]) == -1){
-                fprintf(stderr, "Used write close error : Children > Parent\n");
-                exit(EXIT_FAILURE);
-            }
-            
-        // ===================================================================
-            
-        // Child processes ===================================================
-        } else {
-
-            if(pid[0] == 0){
-                printf("I'm P2 [pid: %d, ppid: %d]\n",getpid(),getppid());
-                process_quarter(cfd_p2, fd_p2, "P2");
-                _exit(EXIT_SUCCESS);
-            }
-            else if(pid[1] == 0){
-                printf("I'm P3 [pid: %d, ppid: %d]\n",getpid(),getppid());
-                process_quarter(cfd_p3, fd_p3, "P3");
-                _exit(EXIT_SUCCESS);
-            }
-            else if(pid[2] == 0){
-                printf("I'm P4 [pid: %d, ppid: %d]\n",getpid(),getppid());
-                process_quarter(cfd_p4, fd_p4, "P4");
-                _exit(EXIT_SUCCESS);
-                
-            }
-            else if(pid[3] == 0){
-                printf("I'm P5 [pid: %d, ppid: %d]\n",getpid(),getppid());
-                process_quarter(cfd_p5, fd_p5, "P5");
-                _exit(EXIT_SUCCESS);
-            }
+        //SVD, a wide C is decomposed as C' which has the same singular values
+        if(opts.connect_path[0] == '\0' && !cached){
+            load_workspace();
+            value_count = singular_values_of_c();
         }
-        // ===================================================================
+        t = phase_mark(PHASE_SVD, t);
+        if(opts.cache_dir[0] != '\0' && !cached)
+            cache_store(&cache, &key, dim_m, dim_n, result_c, singular_values, value_count);
+        print_values();
+        writer_flush(&out);
+        phase_mark(PHASE_OUTPUT, t);
+        if(opts.timings)
+            print_timings();
+        
+    // ===================================================================
         
         exit(EXIT_SUCCESS);
     }
@@ -292,11 +416,29 @@ int main(int argc, char * argv[]) {
 }
 
 void cleanup(){
+    write_stats();
+    if(opts.ingest == INGEST_MMAP && matrix1_buffer != NULL){
+        printf("Unmapping input 1: matrix1_buffer\n");
+        munmap(matrix1_buffer - header1.offset, input1_size + header1.offset);
+        matrix1_buffer = NULL;
+    }
+    if(opts.ingest == INGEST_MMAP && matrix2_buffer != NULL){
+        printf("Unmapping input 2: matrix2_buffer\n");
+        munmap(matrix2_buffer - header2.offset, input2_size + header2.offset);
+        matrix2_buffer = NULL;
+    }
+    if(shm.base != NULL){
+        printf("Unmapping shared memory: %zu bytes\n", shm.size);
+        if(result_c == shm.c)
+            result_c = NULL;
+        shm_destroy(&shm);
+        matrix1_buffer = matrix2_buffer = NULL;
+    }
     if(matrix1_buffer != NULL){
         printf("Freeing buffer 1: matrix1_buffer\n");
         free(matrix1_buffer);
     }
-
+    
     if(matrix2_buffer != NULL){
         printf("Freeing buffer 2: matrix2_buffer\n");
         free(matrix2_buffer);
@@ -309,10 +451,6 @@ void cleanup(){
         printf("Freeing buffer 4: required_quarters2\n");
         free(required_quarters2);
     }
-    for(int i = 0; i <2*n2; i++){
-        if(combined_result[i] != NULL)
-            free(combined_result[i]);
-    }
     if(combined_result != NULL){
         printf("Freeing buffer 5: combined_result\n");
         free(combined_result);
@@ -321,6 +459,25 @@ void cleanup(){
         printf("Freeing buffer 6: singular_values\n");
         free(singular_values);
     }
+    if(result_c != NULL){
+        printf("Freeing buffer 7: result_c\n");
+        free(result_c);
+    }
+    if(products != NULL){
+        printf("Freeing buffer 8: products\n");
+        free(products);
+        free(product_ops);
+    }
+    if(tile_map != NULL){
+        printf("Freeing buffer 10: tile_map\n");
+        free(tile_map);
+        free(row_keys);
+    }
+    if(out.data != NULL){
+        writer_flush(&out);
+        printf("Freeing buffer 9: output\n");
+        writer_free(&out);
+    }
     if(i1_fd >= 1){
         printf("Closing input file 1, descriptor: %d\n",i1_fd);
         close(i1_fd);
@@ -331,231 +488,1987 @@ void cleanup(){
         close(i2_fd);
     }
     
-    if(errno != 0 && errno != EINTR && errno != 34) // Ignore interrupted syscall error
-        fprintf(stderr,"Uncaught error occured: %s\n", strerror(errno));
+    if(serve_fd > 0){
+        printf("Closing socket %s, descriptor: %d\n", opts.serve_path[0] != '\0' ? opts.serve_path : opts.worker_address, serve_fd);
+        close(serve_fd);
+        if(opts.serve_path[0] != '\0')
+            unlink(opts.serve_path);
+    }
 }
 
-
-void get_quarter_column(char * matrix, char * column, int L_R){
-    int k = 0, m = 0;
-    int current_L_R = 0; // 0 Left, 1 Right
+/**
+ Sizes the current multiply from dim_m, dim_k and dim_n: tile grid,
+ algorithm and, unless a pool is already running, the worker count.
+return:
+   0 on success
+  -1 when the grid does not fit the matrix
+*/
+int plan_job(void){
+    input1_size = (size_t) dim_m * dim_k;
+    input2_size = (size_t) dim_k * dim_n;
+    svd_rows = dim_m >= dim_n ? dim_m : dim_n;
+    svd_cols = dim_m >= dim_n ? dim_n : dim_m;
     
-    for(int i = 0; i < n2; i++){
-        for(int j = 0; j < n2; j++){
-            if(j >= n2/2)
-                current_L_R = 1;
+    // Threads cost nothing to feed, so they get many small tiles; so do remote workers, to fill their windows,
+    // and --incremental, for a change to touch few of them
+    grid_rows = opts.grid_rows;
+    grid_cols = opts.grid_cols;
+    if(grid_rows == 0 && (opts.backend == BACKEND_THREADS || opts.host_count > 0 || opts.incremental_path[0] != '\0')){
+        grid_rows = (dim_m + THREAD_TILE - 1) / THREAD_TILE;
+        grid_cols = (dim_n + THREAD_TILE - 1) / THREAD_TILE;
+    }
+    else if(grid_rows == 0){
+        grid_rows = dim_m >= 2 ? 2 : 1;
+        grid_cols = dim_n >= 2 ? 2 : 1;
+    }
+    if(grid_rows > dim_m || grid_cols > dim_n){
+        fprintf(stderr,"Grid %dx%d is larger than the %dx%d matrix\n", grid_rows, grid_cols, dim_m, dim_n);
+        return -1;
+    }
+    // Forked or remote workers that do not share C get a tile's operands and its result in one frame of at most 4 GiB,
+    // the longer side of the largest tile is halved until both fit
+    if(opts.backend == BACKEND_FORK && opts.transport != TRANSPORT_SHM && tile_frame_bytes(grid_rows, grid_cols) > UINT32_MAX){
+        int rows = grid_rows, cols = grid_cols;
+        
+        while(tile_frame_bytes(rows, cols) > UINT32_MAX && (rows < dim_m || cols < dim_n)){
+            if(rows < dim_m && ((dim_m + rows - 1) / rows >= (dim_n + cols - 1) / cols || cols == dim_n))
+                rows = 2 * rows < dim_m ? 2 * rows : dim_m;
             else
-                current_L_R = 0;
-            if(current_L_R == L_R)
-                column[m++] = matrix[k];
-            k++;
+                cols = 2 * cols < dim_n ? 2 * cols : dim_n;
         }
+        printf("Tiles of a %dx%d grid do not fit one frame, using a %dx%d grid\n", grid_rows, grid_cols, rows, cols);
+        grid_rows = rows;
+        grid_cols = cols;
+    }
+    // Quadrants need even sizes, odd ones still work tile by tile
+    algo = opts.algo;
+    if(algo == ALGO_STRASSEN && (dim_m % 2 || dim_k % 2 || dim_n % 2)){
+        fprintf(stderr,"Strassen needs even dimensions, using the classic algorithm for %dx%dx%d\n", dim_m, dim_k, dim_n);
+        algo = ALGO_CLASSIC;
+    }
+    // A product ships its int16 operands and its int result whole, it cannot be split like a tile
+    if(algo == ALGO_STRASSEN && opts.backend == BACKEND_FORK && opts.transport != TRANSPORT_SHM &&
+       (((size_t) dim_m / 2 * dim_k / 2 + (size_t) dim_k / 2 * dim_n / 2) * sizeof(int16_t) > UINT32_MAX ||
+        (size_t) dim_m / 2 * dim_n / 2 * sizeof(int) > UINT32_MAX)){
+        fprintf(stderr,"Strassen products of %dx%dx%d do not fit one frame, using the classic algorithm\n", dim_m, dim_k, dim_n);
+        algo = ALGO_CLASSIC;
+    }
+    tile_count = algo == ALGO_STRASSEN ? STRASSEN_PRODUCTS : grid_rows * grid_cols;
+    
+    // A running pool keeps its size from job to job
+    if(pool.count == 0){
+        worker_count = opts.workers;
+        if(worker_count == 0)
+            worker_count = opts.backend == BACKEND_THREADS || opts.incremental_path[0] != '\0' ? (int) sysconf(_SC_NPROCESSORS_ONLN) : tile_count;
+        // -w is the connections per host, each one a worker process on that host
+        if(opts.host_count > 0)
+            worker_count = opts.host_count * (opts.workers ? opts.workers : 1);
+        if(worker_count > tile_count)
+            worker_count = tile_count;
     }
-    column[m] = '\0';
-    //printf("col: %s\n", column);
+    return 0;
 }
 
-void get_quarter_row(char * matrix, char * row, int T_B){
-    int k = 0, m = 0;
-    int current_T_B = 0; // 0 Top, 1 Bot
+// Largest frame a tile of a rows x cols grid takes, its operands or its result
+size_t tile_frame_bytes(int rows, int cols){
+    size_t tile_rows = (dim_m + rows - 1) / rows, tile_cols = (dim_n + cols - 1) / cols;
+    size_t operands = (tile_rows + tile_cols) * dim_k, result = tile_rows * tile_cols * sizeof(int);
     
-    for(int i = 0; i < n2; i++){
-        for(int j = 0; j < n2; j++){
-            if(i >= n2/2)
-                current_T_B = 1;
-            else
-                current_T_B = 0;
-            if(current_T_B == T_B)
-                row[m++] = matrix[k];
-            k++;
+    return operands > result ? operands : result;
+}
+
+/**
+ Allocates the buffers of the current multiply. Inputs that are
+ already mapped or in shared memory are kept.
+return:
+   0 on success
+  -1 on failure
+*/
+int alloc_buffers(void){
+    // Remote workers get their tiles shipped even when the inputs are mapped or shared
+    if(matrix1_buffer == NULL || opts.host_count > 0){
+        if(matrix1_buffer == NULL){
+            matrix1_buffer = malloc(input1_size * sizeof(char)+1);
+            matrix2_buffer = malloc(input2_size * sizeof(char)+1);
+        }
+        required_quarters1 = malloc((input1_size+1) * sizeof(char)); // I.E A11, A12 for C11
+        required_quarters2 = malloc((input2_size+1) * sizeof(char)); // I.E B11, B21 for C11
+        
+        // Check if allocation is successful
+        if(matrix1_buffer == NULL || matrix2_buffer == NULL || required_quarters1 == NULL || required_quarters2 == NULL){
+            fprintf(stderr, "Failed allocated memory : malloc() in alloc_buffers()\n");
+            return -1;
+        }
+    }
+    
+    // With shm the workers write C in place, only Strassen keeps M1..M7 there and needs a C of its own
+    // SVD workspace holds C (or C') on top and V below, one column after the other
+    if(opts.transport == TRANSPORT_SHM && algo != ALGO_STRASSEN)
+        result_c = shm.c;
+    else
+        result_c = malloc((size_t) dim_m * dim_n * sizeof(int));
+    combined_result = svd_workspace(svd_rows, svd_cols, opts.svd_vectors, &svd_ld);
+    singular_values = malloc(svd_cols * sizeof(double));
+    if(result_c == NULL || combined_result == NULL || singular_values == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in alloc_buffers()\n");
+        return -1;
+    }
+    
+    if(algo == ALGO_STRASSEN){
+        products = malloc(STRASSEN_PRODUCTS * (size_t) dim_m / 2 * dim_n / 2 * sizeof(int));
+        product_ops = malloc(((size_t) dim_m / 2 * dim_k / 2 + (size_t) dim_k / 2 * dim_n / 2) * sizeof(int16_t));
+        if(products == NULL || product_ops == NULL){
+            fprintf(stderr, "Failed allocated memory : malloc() in alloc_buffers()\n");
+            return -1;
         }
     }
-    row[m] = '\0';
-    //printf("row: %s\n", row);
+    return 0;
 }
 
+// Job server: what alloc_buffers() gave one job goes before the next
+void free_buffers(void){
+    free(matrix1_buffer);
+    free(matrix2_buffer);
+    free(required_quarters1);
+    free(required_quarters2);
+    free(result_c);
+    free(combined_result);
+    free(singular_values);
+    free(products);
+    free(product_ops);
+    matrix1_buffer = matrix2_buffer = required_quarters1 = required_quarters2 = NULL;
+    result_c = products = NULL;
+    product_ops = NULL;
+    combined_result = singular_values = NULL;
+}
 
-void process_quarter(int *cfd_p, int *fd_p, const char *name_str){
-    int n2_x_n2 = n2 * n2;
+/**
+ C = A x B, tiles or Strassen products go to the worker pool or to the
+ threads, products are combined into C here.
+return:
+   0 on success
+  -1 on failure
+*/
+int multiply(void){
+    struct job job;
     
-    // Allocated spaces
-    char * buffer1 = malloc(n2_x_n2 * sizeof(char)+1);
-    char * buffer2 = malloc(n2_x_n2/2 * sizeof(char)+1);
-    int *result = malloc(n2_x_n2/4*sizeof(int));
-    //Check if allocation is successful
-    if(result == NULL || buffer1 == NULL || buffer2 == NULL){
-        fprintf(stderr, "Failed allocated memory : malloc() in process_quarter()\n");
-        exit(EXIT_FAILURE);
+    if(opts.backend == BACKEND_THREADS){
+        if(run_threads() == -1)
+            return -1;
+    }
+    else{
+        memset(&job, 0, sizeof(job));
+        job.tile_count = tile_count;
+        job.request = algo == ALGO_STRASSEN ? product_request : tile_request;
+        job.result = algo == ALGO_STRASSEN ? product_result : tile_result;
+        if(batch_count > 0){
+            job.request = batch_request;
+            job.result = batch_result;
+        }
+        if(pool_run(&pool, &job) == -1)
+            return -1;
     }
+    if(algo == ALGO_STRASSEN)
+        combine_products();
+    return 0;
+}
+
+/**
+ Parent side of a tile: the frame header, followed by the operands
+ unless they are already shared with the worker.
+ */
+int tile_request(void *ctx, int index, struct msgbuf *out){
+    struct tile t;
+    struct frame f;
     
-    //Close not needed ends
-    close(fd_p[1]);
-    close(cfd_p[0]);
+    grid_tile(dim_m, dim_n, grid_rows, grid_cols, tile_map != NULL ? tile_map[index] : index, &t);
+    memset(&f, 0, sizeof(f));
+    f.kind = FRAME_TILE;
+    f.index = index;
+    f.row0 = t.row0; f.col0 = t.col0;
+    f.rows = t.rows; f.cols = t.cols;
+    f.inner = dim_k;
     
-    // Child reading from pipe
+    // Worker already sees A and B, the tile is ready to be computed
+    if(shared_a != NULL)
+        return frame_append(out, &f, NULL, 0, NULL, 0);
     
-    if(read(fd_p[0], buffer1, n2_x_n2/2) < n2_x_n2/2){
-        fprintf(stderr,"Not enough bytes to read: process_quarter() buf1\n");
-        _exit(EXIT_FAILURE);
+    // [tile rows of A] [tile columns of B] combined in required_quarters
+    get_tile_rows(matrix1_buffer, required_quarters1, dim_k, &t);
+    get_tile_columns(matrix2_buffer, required_quarters2, dim_k, dim_n, &t);
+    return frame_append(out, &f, required_quarters1, (size_t) t.rows * dim_k, required_quarters2, (size_t) dim_k * t.cols);
+}
+
+// Places a finished tile in C, position comes from the header
+int tile_result(void *ctx, const struct frame *f, const void *payload){
+    const int *tile_buffer = payload;
+    
+    if(f->kind != FRAME_RESULT || f->rows < 0 || f->cols < 0 || f->row0 < 0 || f->col0 < 0 ||
+       f->row0 + f->rows > dim_m || f->col0 + f->cols > dim_n){
+        fprintf(stderr,"Malformed result frame for tile %d\n", f->index);
+        return -1;
     }
-    if(read(fd_p[0], buffer2, n2_x_n2/2) < n2_x_n2/2){
-        fprintf(stderr,"Not enough bytes to read: process_quarter() buf2\n");
-        _exit(EXIT_FAILURE);
+    // shm: the worker wrote the tile into C itself
+    if(f->length == 0 && result_c == shm.c)
+        return 0;
+    if(f->length != (uint32_t) (f->rows * f->cols * sizeof(int))){
+        fprintf(stderr,"Not enough bytes to read: result of tile %d\n", f->index);
+        return -1;
+    }
+    for(int r = 0; r < f->rows; r++)
+        memcpy(result_c + (size_t) (f->row0 + r)*dim_n + f->col0, tile_buffer + (size_t) r*f->cols, f->cols * sizeof(int));
+    return 0;
+}
+
+/**
+ Parent side of a Strassen product: operands are formed from the
+ quadrants here, or by the worker itself when it sees A and B.
+ */
+int product_request(void *ctx, int index, struct msgbuf *out){
+    int hm = dim_m / 2, hk = dim_k / 2, hn = dim_n / 2;
+    struct frame f;
+    
+    memset(&f, 0, sizeof(f));
+    f.kind = FRAME_PRODUCT;
+    f.index = index;
+    f.rows = hm; f.cols = hn; f.inner = hk;
+    
+    if(shared_a != NULL)
+        return frame_append(out, &f, NULL, 0, NULL, 0);
+    
+    strassen_operands(matrix1_buffer, dim_k, matrix2_buffer, dim_n, hm, hk, hn, index, product_ops, product_ops + (size_t) hm*hk);
+    return frame_append(out, &f, product_ops, (size_t) hm * hk * sizeof(int16_t), product_ops + (size_t) hm*hk, (size_t) hk * hn * sizeof(int16_t));
+}
+
+int product_result(void *ctx, const struct frame *f, const void *payload){
+    size_t count = (size_t) (dim_m / 2) * (dim_n / 2), size = count * sizeof(int);
+    
+    if(f->kind != FRAME_RESULT || f->index < 0 || f->index >= STRASSEN_PRODUCTS ||
+       f->rows != dim_m / 2 || f->cols != dim_n / 2 || (f->length != 0 && f->length != size)){
+        fprintf(stderr,"Malformed result frame for product M%d\n", f->index + 1);
+        return -1;
     }
+    // shm: the worker left it in its slot of the C part
+    memcpy(products + (size_t) f->index * count,
+           f->length == 0 ? (const void *) (shm.c + (size_t) f->index * count) : payload, size);
+    return 0;
+}
+
+// C11 = M1 + M4 - M5 + M7, C12 = M3 + M5, C21 = M2 + M4, C22 = M1 - M2 + M3 + M6
+void combine_products(void){
+    int hm = dim_m / 2, hn = dim_n / 2;
+    
+    memset(result_c, 0, (size_t) dim_m * dim_n * sizeof(int));
+    for(int p = 0; p < STRASSEN_PRODUCTS; p++)
+        strassen_accumulate(products + (size_t) p * hm * hn, p, hm, hn, result_c, dim_n);
+}
 
-    multiply_matrices(buffer1, buffer2, result);
+/**
+ Worker loop: answers FRAME_TILE and FRAME_PRODUCT messages until the
+ parent closes its end. Operands come in the payload, or are read in
+ place when the inputs are shared or mapped (empty request). The result
+ goes back in one frame, or is written in place when C is in shm.
+ Sizes come from the frames, so the workers of the job server serve
+ jobs of any size.
+ */
+void process_tiles(int worker, int in_fd, int out_fd){
+    int got, lda, ldb;
+    size_t size1, size2, capacity1 = 0, capacity2 = 0, capacity_result = 0, products_in_frame;
+    const char *a, *b;
+    char *buffer1 = NULL, *buffer2 = NULL;
+    int *result = NULL;
+    struct frame f;
+    struct worker_stats stats;
+    struct counters counters;
+    double t;
     
-    //Child writing to pipe
-    //write(cfd_p[1], "Hello father\n", strlen("Hello father\n"));
+    memset(&stats, 0, sizeof(stats));
+    stats.pid = getpid();
+    stats.start = seconds_now();
+    if(opts.stats)
+        counters_open(&counters);
+    
+    printf("I'm P%d [pid: %d, ppid: %d]\n",worker+2,getpid(),getppid());
+    
+    if(shm.base != NULL && shm_protect_inputs(&shm) == -1)
+        perror("mprotect() in process_tiles()");
+    
+    // Time between frames is spent waiting on the parent, every path back to recv_frame() passes the clock
+    for(t = seconds_now(); (got = recv_frame(in_fd, &f)) == 1; t = seconds_now()){
+        stats.wait_seconds += seconds_now() - t;
+        stats.tiles++;
+        if(f.rows < 1 || f.cols < 1 || f.inner < 1 || (f.kind == FRAME_BATCH && f.row0 < 1)){
+            fprintf(stderr,"Malformed tile frame: process_tiles()\n");
+            _exit(EXIT_FAILURE);
+        }
+        // Sized per frame, and only for a result that goes back in the payload (shm takes all but chain tiles in place).
+        // A batch slice answers with the product of every pair in it, a chain tile with int64 elements
+        products_in_frame = f.kind == FRAME_BATCH ? f.row0 : 1;
+        if((shm.base == NULL || f.kind == FRAME_WIDE) &&
+           grow_buffer((void **) &result, &capacity_result, products_in_frame * f.rows * f.cols *
+                       (f.kind == FRAME_WIDE ? sizeof(int64_t) : sizeof(int))) == -1){
+            fprintf(stderr, "Failed allocated memory : malloc() in process_tiles()\n");
+            _exit(EXIT_FAILURE);
+        }
+        if(f.kind == FRAME_PRODUCT){
+            process_product(&f, in_fd, out_fd, result);
+            continue;
+        }
+        if(f.kind == FRAME_BATCH){
+            process_batch(&f, in_fd, out_fd, result);
+            continue;
+        }
+        if(f.kind == FRAME_WIDE){
+            process_wide(&f, in_fd, out_fd, (int64_t *) result);
+            continue;
+        }
+        if(f.kind != FRAME_TILE || f.row0 < 0 || f.col0 < 0){
+            fprintf(stderr,"Malformed tile frame: process_tiles()\n");
+            _exit(EXIT_FAILURE);
+        }
+        f.kind = FRAME_RESULT;
+        
+        if(f.length == 0 && shared_a != NULL){
+            // Operands are read in place from the shared or mapped inputs
+            if(f.inner != dim_k || f.row0 + f.rows > dim_m || f.col0 + f.cols > dim_n){
+                fprintf(stderr,"Malformed tile frame: process_tiles()\n");
+                _exit(EXIT_FAILURE);
+            }
+            a = shared_a + (size_t) f.row0*dim_k; lda = dim_k;
+            b = shared_b + f.col0; ldb = dim_n;
+        }
+        else{
+            // Child reading from pipe
+            size1 = (size_t) f.rows * f.inner;
+            size2 = (size_t) f.inner * f.cols;
+            if(grow_buffer((void **) &buffer1, &capacity1, size1+1) == -1 || grow_buffer((void **) &buffer2, &capacity2, size2+1) == -1){
+                fprintf(stderr, "Failed allocated memory : malloc() in process_tiles()\n");
+                _exit(EXIT_FAILURE);
+            }
+            if(f.length != size1 + size2 ||
+               read_full(in_fd, buffer1, size1) != size1 || read_full(in_fd, buffer2, size2) != size2){
+                fprintf(stderr,"Not enough bytes to read: process_tiles()\n");
+                _exit(EXIT_FAILURE);
+            }
+            buffer1[size1] = '\0';
+            buffer2[size2] = '\0';
+            a = buffer1; lda = f.inner;
+            b = buffer2; ldb = f.cols;
+        }
+        
+        if(shm.base != NULL){
+            // Written in place, only the header goes back
+            multiply_matrices(a, lda, b, ldb, shm.c + (size_t) f.row0*dim_n + f.col0, dim_n, f.rows, f.cols, f.inner);
+            send_frame(out_fd, &f, NULL, 0, NULL, 0);
+            continue;
+        }
+        multiply_matrices(a, lda, b, ldb, result, f.cols, f.rows, f.cols, f.inner);
+        
+        //Child writing to pipe, whole tile in one frame
+        if(send_frame(out_fd, &f, result, (size_t) f.rows * f.cols * sizeof(int), NULL, 0) == -1){
+            perror("Write error : Children > Parent\n");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    if(got == -1)
+        fprintf(stderr,"Truncated tile frame: process_tiles()\n");
+    stats.wait_seconds += seconds_now() - t;
     
-    for(int i = 0; i < n2_x_n2/4; i++){
-        write(cfd_p[1], &result[i], sizeof(int));
+    // Left in the result pipe for pool_stop(), the parent reads nothing else any more
+    if(opts.stats){
+        stats.end = seconds_now();
+        stats.busy_seconds = stats.end - stats.start - stats.wait_seconds;
+        counters_read(&counters, stats.events);
+        counters_close(&counters);
+        f.kind = FRAME_STATS;
+        send_frame(out_fd, &f, &stats, sizeof(stats), NULL, 0);
     }
     
     // Close remaining ends
-    close(fd_p[0]);
-    close(cfd_p[1]);
+    close(in_fd);
+    close(out_fd);
     
     free(buffer1);
     free(buffer2);
     free(result);
 }
 
-void multiply_matrices(char *m1, char *m2, int *result){
-    int temp = 0;
-    int c = 0;
-    for(int i = 0; i < n2/2; i++){
-        for(int j = 0; j < n2/2; j++){
-            temp = 0;
-            for(int k = 0; k < n2; k++){
-                //printf("%c . %c\n", get_i_j(i, k, m1, n2), get_i_j(k, j, m2, n2/2));
-                temp += get_i_j(i, k, m1, n2) * get_i_j(k, j, m2, n2/2);
-            }
-            //printf("%d ",temp);
-            result[c++] = temp;
+// One Strassen product, recursing down to the crossover inside this worker, same placement rules as a tile
+void process_product(struct frame *f, int in_fd, int out_fd, int *result){
+    int hm = f->rows, hk = f->inner, hn = f->cols;
+    size_t size = ((size_t) hm * hk + (size_t) hk * hn) * sizeof(int16_t);
+    int16_t *ops = malloc(size);
+    
+    if(ops == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in process_product()\n");
+        _exit(EXIT_FAILURE);
+    }
+    if(f->index < 0 || f->index >= STRASSEN_PRODUCTS){
+        fprintf(stderr,"Malformed product frame: process_product()\n");
+        _exit(EXIT_FAILURE);
+    }
+    
+    if(f->length == 0 && shared_a != NULL){
+        // Quadrants of the shared inputs
+        if(hm != dim_m / 2 || hk != dim_k / 2 || hn != dim_n / 2){
+            fprintf(stderr,"Malformed product frame: process_product()\n");
+            _exit(EXIT_FAILURE);
         }
-        //printf("\n");
+        strassen_operands(shared_a, dim_k, shared_b, dim_n, hm, hk, hn, f->index, ops, ops + (size_t) hm*hk);
+    }
+    else if(f->length != size || read_full(in_fd, ops, size) != size){
+        fprintf(stderr,"Not enough bytes to read: process_product()\n");
+        _exit(EXIT_FAILURE);
     }
     
-}
-
-void print_matrix(char *matrix, int n2, int ascii){
-    int k = 0;
-    for(int i = 0; i < n2; i++){
-        for(int j = 0; j < n2; j++){
-            if(ascii)
-                printf("%c ", matrix[k++]);
-            else
-                printf("%d ", matrix[k++]);
+    f->kind = FRAME_RESULT;
+    if(shm.base != NULL){
+        strassen_multiply(ops, hk, ops + (size_t) hm*hk, hn, shm.c + (size_t) f->index * hm * hn, hn, hm, hk, hn, opts.crossover);
+        send_frame(out_fd, f, NULL, 0, NULL, 0);
+    }
+    else{
+        strassen_multiply(ops, hk, ops + (size_t) hm*hk, hn, result, hn, hm, hk, hn, opts.crossover);
+        if(send_frame(out_fd, f, result, (size_t) hm * hn * sizeof(int), NULL, 0) == -1){
+            perror("Write error : Children > Parent\n");
+            _exit(EXIT_FAILURE);
         }
-        printf("\n");
     }
+    free(ops);
 }
 
-int get_i_j(int i, int j, char * matrix, int rows){
-    if(matrix[i*rows+j] != '\0')
-        return (int) matrix[i*rows+j];
-    else{
-        fprintf(stderr, "FATAL ERROR\nIndex ij out of range : (%d, %d)\n", i, j);
+// A tile of a chain, its int64 operands always come in the frame
+void process_wide(struct frame *f, int in_fd, int out_fd, int64_t *result){
+    size_t size = ((size_t) f->rows * f->inner + (size_t) f->inner * f->cols) * sizeof(int64_t);
+    int64_t *ops = malloc(size);
+    
+    if(ops == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in process_wide()\n");
         _exit(EXIT_FAILURE);
     }
-}
-
-// output: [1, 2, 3, 4]
-void display_arr(double *array, int n){
-    printf("[");
-    for(int i = 0; i < n-1; i++){
-        printf("%.3f, ", array[i]);
+    if(f->length != size || read_full(in_fd, ops, size) != size){
+        fprintf(stderr,"Not enough bytes to read: process_wide()\n");
+        _exit(EXIT_FAILURE);
+    }
+    
+    f->kind = FRAME_RESULT;
+    multiply_wide(ops, f->inner, ops + (size_t) f->rows * f->inner, f->cols, result, f->cols, f->rows, f->cols, f->inner);
+    if(send_frame(out_fd, f, result, (size_t) f->rows * f->cols * sizeof(int64_t), NULL, 0) == -1){
+        perror("Write error : Children > Parent\n");
+        _exit(EXIT_FAILURE);
     }
-    printf("%.3f]\n", array[n-1]);
+    free(ops);
 }
 
-void display_arr_2d(double **array, int n){
-    printf("[\n");
-    for(int i = 0; i <n; i++){
-        printf("[");
-        for(int j = 0; j <n-1; j++){
-            printf("%.3f, ", array[i][j]);
+// A slice of a batch, same placement rules as a tile
+void process_batch(struct frame *f, int in_fd, int out_fd, int *result){
+    size_t pair = (size_t) f->rows * f->inner + (size_t) f->inner * f->cols, size = f->row0 * pair;
+    const char *pairs;
+    char *buffer = NULL;
+    
+    if(f->length == 0 && shared_a != NULL){
+        // Pairs are read in place from the shared or mapped batch
+        if(f->index < 0 || f->index + f->row0 > batch_count || f->rows != dim_m || f->inner != dim_k || f->cols != dim_n){
+            fprintf(stderr,"Malformed batch frame: process_batch()\n");
+            _exit(EXIT_FAILURE);
+        }
+        pairs = shared_a + (size_t) f->index * pair;
+    }
+    else{
+        buffer = malloc(size);
+        if(buffer == NULL){
+            fprintf(stderr, "Failed allocated memory : malloc() in process_batch()\n");
+            _exit(EXIT_FAILURE);
+        }
+        if(f->length != size || read_full(in_fd, buffer, size) != size){
+            fprintf(stderr,"Not enough bytes to read: process_batch()\n");
+            _exit(EXIT_FAILURE);
         }
-        printf("%.3f],\n", array[i][n-1]);
+        pairs = buffer;
     }
-    printf("]\n");
+    
+    f->kind = FRAME_RESULT;
+    if(shm.base != NULL){
+        multiply_batch(pairs, f->row0, f->rows, f->inner, f->cols, shm.c + (size_t) f->index * f->rows * f->cols);
+        send_frame(out_fd, f, NULL, 0, NULL, 0);
+    }
+    else{
+        multiply_batch(pairs, f->row0, f->rows, f->inner, f->cols, result);
+        if(send_frame(out_fd, f, result, (size_t) f->row0 * f->rows * f->cols * sizeof(int), NULL, 0) == -1){
+            perror("Write error : Children > Parent\n");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    free(buffer);
 }
 
+/**
+ Makes sure *buffer holds at least size bytes.
+return:
+   0 on success
+  -1 on failure, the old buffer is kept
+*/
+int grow_buffer(void **buffer, size_t *capacity, size_t size){
+    void *grown;
+    
+    if(size <= *capacity)
+        return 0;
+    grown = realloc(*buffer, size);
+    if(grown == NULL)
+        return -1;
+    *buffer = grown;
+    *capacity = size;
+    return 0;
+}
 
+/**
+ Thread backend: every thread reads A and B in place and writes its
+ tiles, or its Strassen products, straight into the result buffers.
+return:
+   0 on success
+  -1 on failure
+ */
+int run_threads(void){
+    struct thread_job job;
+    struct thread_stats *stats = calloc(worker_count, sizeof(struct thread_stats));
+    
+    if(stats == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in run_threads()\n");
+        return -1;
+    }
+    job.task_count = tile_count;
+    job.ctx = NULL;
+    job.run = algo == ALGO_STRASSEN ? product_compute : tile_compute;
+    if(batch_count > 0)
+        job.run = batch_compute;
+    if(tpool_run(worker_count, &job, stats) == -1){
+        free(stats);
+        return -1;
+    }
+    for(int i = 0; i < worker_count; i++)
+        printf("Thread T%d ran %d tiles, %d stolen in %d steals\n", i, stats[i].tasks, stats[i].stolen, stats[i].steals);
+    // --stats reports the threads of the last multiply
+    if(opts.stats){
+        free(thread_stats);
+        thread_stats = stats;
+        thread_stats_count = worker_count;
+    }
+    else
+        free(stats);
+    return 0;
+}
 
-/* svd.c: Perform a singular value decomposition A = USV' of square matrix.
-*
-* This routine has been adapted with permission from a Pascal implementation
-* (c) 1988 J. C. Nash, "Compact numerical methods for computers", Hilger 1990.
-* The A matrix must be pre-allocated with 2n rows and n columns. On calling
-* the matrix to be decomposed is contained in the first n rows of A. On return
-* the n first rows of A contain the product US and the lower n rows contain V
-* (not V'). The S2 vector returns the square of the singular values.
-*
-* (c) Copyright 1996 by Carl Edward Rasmussen. */
-void svd(double **A, double *S2, int n){
-    int  i, j, k, EstColRank = n, RotCount = n, SweepCount = 0;
-    int slimit = (n<120) ? 30 : n/4;
-    double eps = 1e-15, e2 = 10.0*n*eps*eps, tol = 0.1*eps, vt, p, x0, y0, q, r, c0, s0, d1, d2;
+// One tile of C, computed in place
+void tile_compute(void *ctx, int index){
+    struct tile t;
+    
+    grid_tile(dim_m, dim_n, grid_rows, grid_cols, tile_map != NULL ? tile_map[index] : index, &t);
+    multiply_matrices(matrix1_buffer + (size_t) t.row0*dim_k, dim_k, matrix2_buffer + t.col0, dim_n,
+                      result_c + (size_t) t.row0*dim_n + t.col0, dim_n, t.rows, t.cols, dim_k);
+}
 
-    for (i=0; i<n; i++) {
-        for (j=0; j<n; j++) A[n+i][j] = 0.0;
-        A[n+i][i] = 1.0;
-    }
-   
-    while (RotCount != 0 && SweepCount++ <= slimit) {
-        RotCount = EstColRank*(EstColRank-1)/2;
-        for (j=0; j<EstColRank-1; j++)
-            
-        for (k=j+1; k<EstColRank; k++) {
-            p = q = r = 0.0;
-            for (i=0; i<n; i++) {
-                x0 = A[i][j]; y0 = A[i][k];
-                p += x0*y0; q += x0*x0; r += y0*y0;
-            }
-            S2[j] = q; S2[k] = r;
-            if (q >= r) {
-                if (q<=e2*S2[0] || fabs(p)<=tol*q)
-                    RotCount--;
-                else {
-                    p /= q;
-                    r = 1.0-r/q;
-                    vt = sqrt(4.0*p*p+r*r);
-                    c0 = sqrt(0.5*(1.0+r/vt));
-                    s0 = p/(vt*c0);
-                    for (i=0; i<2*n; i++) {
-                        d1 = A[i][j]; d2 = A[i][k];
-                        A[i][j] = d1*c0+d2*s0;
-                        A[i][k] = -d1*s0+d2*c0;
-                    }
-                }
-            }
-            else {
-                p /= r;
-                q = q/r-1.0;
-                vt = sqrt(4.0*p*p+q*q);
-                s0 = sqrt(0.5*(1.0-q/vt));
-                if (p<0.0) s0 = -s0;
-                c0 = p/(vt*s0);
-                for (i=0; i<2*n; i++) {
-                    d1 = A[i][j]; d2 = A[i][k];
-                    A[i][j] = d1*c0+d2*s0; A[i][k] = -d1*s0+d2*c0;
-                }
-            }
-        }
-        while (EstColRank>2 && S2[EstColRank-1]<=S2[0]*tol+tol*tol) EstColRank--;
+// One Strassen product into its slot of products, operands are private to the thread
+void product_compute(void *ctx, int index){
+    int hm = dim_m / 2, hk = dim_k / 2, hn = dim_n / 2;
+    int16_t *ops = malloc(((size_t) hm * hk + (size_t) hk * hn) * sizeof(int16_t));
+    
+    if(ops == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in product_compute()\n");
+        exit(EXIT_FAILURE);
     }
-    if (SweepCount > slimit)
-        printf("Warning: Reached maximum number of sweeps (%d) in SVD routine...\n" ,slimit);
+    strassen_operands(matrix1_buffer, dim_k, matrix2_buffer, dim_n, hm, hk, hn, index, ops, ops + (size_t) hm*hk);
+    strassen_multiply(ops, hk, ops + (size_t) hm*hk, hn, products + (size_t) index * hm * hn, hn, hm, hk, hn, opts.crossover);
+    free(ops);
 }
 
-void handle_SIGINT(int sig_no){
-    if(sig_no == SIGINT){
-        //Terminate children
-        for(int i = 0; i < 4; i++){
-            kill(pid[i], SIGTERM);
-        }
+/**
+ --batch: every [M x K] . [K x N] pair of the file is multiplied in
+ slices of about BATCH_SLICE_BYTES, on the workers or on threads, and
+ all products are written out at once. No SVD is done on them.
+ */
+void run_batch(void){
+    size_t pair = (size_t) dim_m * dim_k + (size_t) dim_k * dim_n, c_size = (size_t) dim_m * dim_n;
+    struct stat st;
+    double start, t;
+    int out_fd;
+    
+    t = seconds_now();
+    i1_fd = open(opts.batch_path, O_RDONLY);
+    if(i1_fd == -1 || fstat(i1_fd, &st) == -1){
+        fprintf(stderr,"Batch file could not be opened: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    // Trailing bytes short of a whole pair are ignored, like the tail of an input file
+    batch_count = (int) (st.st_size / pair);
+    if(batch_count < 1){
+        fprintf(stderr,"Not enough characters to read in the batch file: %ld bytes, one pair is %zu bytes\n", (long) st.st_size, pair);
+        exit(EXIT_FAILURE);
+    }
+    input1_size = batch_count * pair;
+    batch_slice = BATCH_SLICE_BYTES / pair > 0 ? BATCH_SLICE_BYTES / pair : 1;
+    // Workers that do not share C send the products of a slice back in one frame
+    if(opts.backend == BACKEND_FORK && opts.transport != TRANSPORT_SHM && batch_slice * c_size * sizeof(int) > UINT32_MAX)
+        batch_slice = UINT32_MAX / (c_size * sizeof(int));
+    if(opts.backend == BACKEND_FORK && opts.transport != TRANSPORT_SHM && (batch_slice < 1 || pair > UINT32_MAX)){
+        fprintf(stderr,"A pair of %dx%dx%d is too large for one frame, --transport=shm keeps it out of the pipes\n", dim_m, dim_k, dim_n);
+        exit(EXIT_FAILURE);
+    }
+    tile_count = (batch_count + batch_slice - 1) / batch_slice;
+    worker_count = opts.workers ? opts.workers : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if(opts.host_count > 0)
+        worker_count = opts.host_count * (opts.workers ? opts.workers : 1);
+    if(worker_count > tile_count)
+        worker_count = tile_count;
+    printf("Batch: %d pairs of %dx%dx%d, %d slices\n", batch_count, dim_m, dim_k, dim_n, tile_count);
+    
+    if(opts.transport == TRANSPORT_SHM && shm_create(&shm, opts.ingest == INGEST_MMAP ? 0 : input1_size, 0, batch_count * c_size) == -1){
+        fprintf(stderr, "Shared memory could not be created: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if(opts.ingest == INGEST_MMAP)
+        matrix1_buffer = map_input(i1_fd, 0, input1_size);
+    else if(opts.transport == TRANSPORT_SHM)
+        matrix1_buffer = shm.a;
+    else
+        matrix1_buffer = malloc(input1_size + 1);
+    // shm: the workers write the products in place
+    result_c = opts.transport == TRANSPORT_SHM ? shm.c : malloc(batch_count * c_size * sizeof(int));
+    if(matrix1_buffer == NULL || result_c == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in run_batch()\n");
+        exit(EXIT_FAILURE);
+    }
+    if(opts.ingest == INGEST_READ && read_full(i1_fd, matrix1_buffer, input1_size) != (ssize_t) input1_size){
+        fprintf(stderr,"Error when reading the batch file : not enough bytes to fill the pairs\n");
+        exit(EXIT_FAILURE);
+    }
+    if(check_matrix(matrix1_buffer, batch_count, (int) pair) == -1)
+        exit(EXIT_FAILURE);
+    if((opts.ingest == INGEST_MMAP || opts.transport == TRANSPORT_SHM) && opts.host_count == 0)
+        shared_a = matrix1_buffer;
+    start = t = phase_mark(PHASE_INGEST, t);
+    
+    start_workers();
+    t = phase_mark(PHASE_DISTRIBUTE, t);
+    if(multiply() == -1){
+        fprintf(stderr, "Multiplication failed\n");
+        exit(EXIT_FAILURE);
+    }
+    t = phase_mark(PHASE_MULTIPLY, t);
+    multiply_phases();
+    if(opts.backend == BACKEND_FORK)
+        pool_stop(&pool);
+    t = phase_mark(PHASE_DISTRIBUTE, t);
+    
+    // One write for the whole batch, or the same text as Matrix C for every pair
+    if(opts.batch_out[0] != '\0'){
+        out_fd = open(opts.batch_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(out_fd == -1 || write_full(out_fd, result_c, batch_count * c_size * sizeof(int)) == -1){
+            fprintf(stderr,"Batch output could not be written: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        close(out_fd);
+    }
+    else if(opts.output == OUTPUT_TEXT){
+        for(int p = 0; p < batch_count; p++){
+            writer_text(&out, "Matrix C");
+            writer_int(&out, p);
+            writer_text(&out, ":\n");
+            display_result(result_c + p * c_size, dim_m, dim_n);
+        }
+        writer_flush(&out);
+    }
+    phase_mark(PHASE_OUTPUT, t);
+    printf("Multiplied %d pairs in %.3f ms, %.0f products/s\n", batch_count, (t - start) * 1e3, batch_count / (t - start));
+    if(opts.timings)
+        print_timings();
+}
+
+// Parent side of a batch slice: the header, followed by the pairs unless they are shared
+int batch_request(void *ctx, int index, struct msgbuf *out){
+    size_t pair = (size_t) dim_m * dim_k + (size_t) dim_k * dim_n;
+    struct frame f;
+    
+    memset(&f, 0, sizeof(f));
+    f.kind = FRAME_BATCH;
+    f.index = index * batch_slice;
+    f.row0 = batch_count - f.index < batch_slice ? batch_count - f.index : batch_slice;
+    f.rows = dim_m; f.inner = dim_k; f.cols = dim_n;
+    
+    if(shared_a != NULL)
+        return frame_append(out, &f, NULL, 0, NULL, 0);
+    return frame_append(out, &f, matrix1_buffer + (size_t) f.index * pair, f.row0 * pair, NULL, 0);
+}
+
+int batch_result(void *ctx, const struct frame *f, const void *payload){
+    size_t c_size = (size_t) dim_m * dim_n;
+    
+    if(f->kind != FRAME_RESULT || f->index < 0 || f->row0 < 1 || f->index + f->row0 > batch_count ||
+       f->rows != dim_m || f->cols != dim_n || (f->length != 0 && f->length != f->row0 * c_size * sizeof(int))){
+        fprintf(stderr,"Malformed result frame for the batch slice at pair %d\n", f->index);
+        return -1;
+    }
+    // shm: the worker left them in place
+    if(f->length == 0 && result_c == shm.c)
+        return 0;
+    if(f->length == 0){
+        fprintf(stderr,"Not enough bytes to read: result of the batch slice at pair %d\n", f->index);
+        return -1;
+    }
+    memcpy(result_c + (size_t) f->index * c_size, payload, f->row0 * c_size * sizeof(int));
+    return 0;
+}
+
+// One batch slice, computed in place
+void batch_compute(void *ctx, int index){
+    size_t pair = (size_t) dim_m * dim_k + (size_t) dim_k * dim_n;
+    int first = index * batch_slice, count = batch_count - first < batch_slice ? batch_count - first : batch_slice;
+    
+    multiply_batch(matrix1_buffer + (size_t) first * pair, count, dim_m, dim_k, dim_n, result_c + (size_t) first * dim_m * dim_n);
+}
+
+/**
+ --stream: A and B stay in their files and C goes to --c-out panel by
+ panel, in no more memory than the budget, see stream.h. Binary inputs
+ are read in place, so they must be dense int8. No SVD is done, it
+ would need all of C in memory.
+ */
+void run_stream(size_t file_size1, size_t file_size2){
+    struct stream_job job;
+    struct stream_stats st;
+    struct matfile_header h;
+    double t = seconds_now(), start;
+    int out_fd;
+    
+    input1_size = (size_t) dim_m * dim_k;
+    input2_size = (size_t) dim_k * dim_n;
+    if((header1.magic != 0 && !matfile_is_dense_int8(&header1)) || (header2.magic != 0 && !matfile_is_dense_int8(&header2))){
+        fprintf(stderr,"--stream reads binary inputs in place, only dense int8 ones, pipes-convert can make them\n");
+        exit(EXIT_FAILURE);
+    }
+    if(header1.magic == 0 && file_size1 < input1_size){
+        fprintf(stderr,"Not enough characters to read in file 1: %lu bytes, expected : %lu bytes, \n", file_size1, input1_size);
+        exit(EXIT_FAILURE);
+    }
+    if(header2.magic == 0 && file_size2 < input2_size){
+        fprintf(stderr,"Not enough characters to read in file 2: %lu bytes, expected : %lu bytes, \n", file_size2, input2_size);
+        exit(EXIT_FAILURE);
+    }
+    
+    memset(&job, 0, sizeof(job));
+    job.a.fd = i1_fd;
+    job.a.offset = header1.offset;
+    job.a.text = header1.magic == 0;
+    job.b.fd = i2_fd;
+    job.b.offset = header2.offset;
+    job.b.text = header2.magic == 0;
+    job.m = dim_m;
+    job.k = dim_k;
+    job.n = dim_n;
+    job.budget = opts.stream_budget;
+    job.threads = worker_count = opts.workers ? opts.workers : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    
+    // No read ahead of the whole file as map_input() asks for, the panels are asked for one at a time
+    if(opts.ingest == INGEST_MMAP){
+        job.a.map = mmap(NULL, header1.offset + input1_size, PROT_READ, MAP_PRIVATE, i1_fd, 0);
+        job.b.map = mmap(NULL, header2.offset + input2_size, PROT_READ, MAP_PRIVATE, i2_fd, 0);
+        if(job.a.map == MAP_FAILED || job.b.map == MAP_FAILED){
+            fprintf(stderr, "Input files could not be mapped: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        // cleanup() unmaps them
+        matrix1_buffer = (char *) job.a.map + header1.offset;
+        matrix2_buffer = (char *) job.b.map + header2.offset;
+    }
+    
+    // The header goes out first, the panels land at their place behind it
+    matfile_init(&h, DTYPE_INT32, dim_m, dim_n, 0);
+    out_fd = open(opts.c_out, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(out_fd == -1 || write_full(out_fd, &h, sizeof(h)) == -1 || ftruncate(out_fd, h.offset + matfile_extent(&h)) == -1){
+        fprintf(stderr,"Output %s could not be written: %s\n", opts.c_out, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    job.out_fd = out_fd;
+    job.out_offset = h.offset;
+    start = t = phase_mark(PHASE_INGEST, t);
+    
+    if(stream_multiply(&job, &st) == -1){
+        fprintf(stderr, "Multiplication failed\n");
+        exit(EXIT_FAILURE);
+    }
+    t = phase_mark(PHASE_MULTIPLY, t);
+    // Time the compute threads stood waiting on reads and writes is I/O, it is counted as the ingest
+    phase_seconds[PHASE_MULTIPLY] -= st.wait_seconds;
+    phase_seconds[PHASE_INGEST] += st.wait_seconds;
+    grid_rows = (dim_m + st.panel_rows - 1) / st.panel_rows;
+    grid_cols = (dim_n + st.panel_cols - 1) / st.panel_cols;
+    tile_count = (int) st.panels;
+    
+    if(close(out_fd) == -1){
+        fprintf(stderr,"Output %s could not be written: %s\n", opts.c_out, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    phase_mark(PHASE_OUTPUT, t);
+    printf("Matrix C: %s\n", opts.c_out);
+    printf("Streamed %dx%dx%d in %ld panels of %dx%d in %.3f ms, %.1f MB read, %.1f MB written, %.1f%% waiting on I/O\n",
+           dim_m, dim_k, dim_n, st.panels, st.panel_rows, st.panel_cols, (t - start) * 1e3,
+           st.bytes_read / 1e6, st.bytes_written / 1e6, (t - start) > 0 ? st.wait_seconds / (t - start) * 100 : 0.0);
+    if(opts.timings)
+        print_timings();
+}
+
+/**
+ Key of the current run: A, B, their sizes and the options the values
+ depend on, the kernel among them as it picks the SVD's vector code.
+ The algorithm, backend and grid give the same integer C, so they are
+ left out and share an entry.
+ */
+void run_key(struct cache_key *key){
+    struct {
+        int32_t m, k, n;
+        int32_t svd_method, svd_threads, top_k;
+        double svd_tol;
+    } params;
+    
+    // Padding is hashed too, it has to be zero
+    memset(&params, 0, sizeof(params));
+    params.m = dim_m;
+    params.k = dim_k;
+    params.n = dim_n;
+    params.svd_method = opts.svd_method;
+    params.svd_threads = opts.svd_threads;
+    params.top_k = opts.top_k < svd_cols ? opts.top_k : 0;
+    params.svd_tol = params.top_k > 0 ? opts.svd_tol : 0.0;
+    memset(key, 0, sizeof(*key));
+    cache_hash(key, matrix1_buffer, input1_size);
+    cache_hash(key, matrix2_buffer, input2_size);
+    cache_hash(key, &params, sizeof(params));
+    cache_hash(key, svd_kernel_name(), strlen(svd_kernel_name()));
+}
+
+/**
+ Fills result_c, singular_values and value_count from the cache.
+return:
+   1 on a hit
+   0 on a miss or when the cache cannot be used, the run computes them
+*/
+int lookup_run(const struct cache_key *key){
+    char name[33];
+    int count;
+    
+    // The run goes on without it
+    if(cache_open(&cache, opts.cache_dir, opts.cache_limit) == -1){
+        opts.cache_dir[0] = '\0';
+        return 0;
+    }
+    cache_key_name(key, name, sizeof(name));
+    count = cache_lookup(&cache, key, dim_m, dim_n, result_c, singular_values, svd_cols);
+    printf("Cache %s: %s (%llu hits, %llu misses, %llu evictions)\n", count == -1 ? "miss" : "hit", name,
+           (unsigned long long) cache.counts.hits, (unsigned long long) cache.counts.misses, (unsigned long long) cache.counts.evictions);
+    if(count == -1)
+        return 0;
+    value_count = count;
+    return 1;
+}
+
+// Sizes and grid of the current multiply, a state file is only used for the same ones
+void delta_header_of_run(struct delta_header *h){
+    memset(h, 0, sizeof(*h));
+    h->magic = DELTA_MAGIC;
+    h->version = DELTA_VERSION;
+    h->m = dim_m;
+    h->k = dim_k;
+    h->n = dim_n;
+    h->grid_rows = grid_rows;
+    h->grid_cols = grid_cols;
+}
+
+/**
+ --incremental: keys of this run's blocks against those of the state
+ file. C starts as the saved one, tile_map lists the tiles whose row
+ block of A or column block of B changed and tile_count becomes their
+ count, with no more workers than that.
+return:
+   0 on success
+  -1 on failure
+*/
+int plan_delta(void){
+    struct delta_header h;
+    struct cache_key *old_rows, *old_cols;
+    int tiles = grid_rows * grid_cols, rows_changed = 0, cols_changed = 0, loaded;
+    
+    row_keys = malloc(2 * (grid_rows + grid_cols) * sizeof(struct cache_key));
+    tile_map = malloc(tiles * sizeof(int));
+    if(row_keys == NULL || tile_map == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in plan_delta()\n");
+        return -1;
+    }
+    col_keys = row_keys + grid_rows;
+    old_rows = col_keys + grid_cols;
+    old_cols = old_rows + grid_rows;
+    
+    delta_hash(matrix1_buffer, matrix2_buffer, dim_m, dim_k, dim_n, grid_rows, grid_cols, row_keys, col_keys);
+    delta_header_of_run(&h);
+    loaded = delta_load(opts.incremental_path, &h, old_rows, old_cols, result_c) == 0;
+    for(int r = 0; loaded && r < grid_rows; r++)
+        rows_changed += memcmp(&row_keys[r], &old_rows[r], sizeof(*row_keys)) != 0;
+    for(int c = 0; loaded && c < grid_cols; c++)
+        cols_changed += memcmp(&col_keys[c], &old_cols[c], sizeof(*col_keys)) != 0;
+    
+    tile_count = 0;
+    for(int i = 0; i < tiles; i++){
+        if(!loaded || memcmp(&row_keys[i / grid_cols], &old_rows[i / grid_cols], sizeof(*row_keys)) != 0 ||
+           memcmp(&col_keys[i % grid_cols], &old_cols[i % grid_cols], sizeof(*col_keys)) != 0)
+            tile_map[tile_count++] = i;
+    }
+    if(loaded)
+        printf("Incremental: %d of %d tiles to compute, %d of %d row blocks of A and %d of %d column blocks of B changed\n",
+               tile_count, tiles, rows_changed, grid_rows, cols_changed, grid_cols);
+    else
+        printf("Incremental: no state of this multiply in %s, computing all %d tiles\n", opts.incremental_path, tiles);
+    if(worker_count > tile_count)
+        worker_count = tile_count;
+    return 0;
+}
+
+/**
+ --chain and --power: a product of several matrices with int64
+ intermediates, see chain.h. The workers are started once and take the
+ tiles of every step, each step a pool_run() of its own; only the final
+ product is printed and decomposed.
+ */
+void run_chain(void){
+    int64_t *leaves[CHAIN_MAX], *result;
+    int dims[CHAIN_MAX + 1], split[CHAIN_MAX * CHAIN_MAX], count = opts.power > 0 ? 1 : opts.chain_count, rows, cols;
+    char paths[sizeof(opts.chain)], *path, *save;
+    double t = seconds_now(), start, cost;
+    
+    // Every input is widened once, the steps only see int64
+    snprintf(paths, sizeof(paths), "%s", opts.power > 0 ? opts.input1_path : opts.chain);
+    path = strtok_r(paths, ",", &save);
+    for(int i = 0; i < count; i++, path = strtok_r(NULL, ",", &save)){
+        if(path == NULL){
+            fprintf(stderr,"Chain file %d is missing\n", i + 1);
+            exit(EXIT_FAILURE);
+        }
+        if((leaves[i] = load_chain_input(path, i, &rows, &cols)) == NULL)
+            exit(EXIT_FAILURE);
+        if(i > 0 && rows != dims[i]){
+            fprintf(stderr,"Matrix %d of the chain is %dx%d, after a %dx%d one it needs %d rows\n", i + 1, rows, cols, dims[i-1], dims[i], dims[i]);
+            exit(EXIT_FAILURE);
+        }
+        dims[i] = rows;
+        dims[i+1] = cols;
+    }
+    if(opts.power > 0 && rows != cols){
+        fprintf(stderr,"A power needs a square matrix, %s is %dx%d\n", opts.input1_path, rows, cols);
+        exit(EXIT_FAILURE);
+    }
+    dim_m = dims[0];
+    dim_k = dims[1];
+    dim_n = opts.power > 0 ? dims[0] : dims[count];
+    t = phase_mark(PHASE_INGEST, t);
+    
+    // One pool for all the steps, the fork backend's workers or the --hosts connections
+    worker_count = opts.workers ? opts.workers : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if(opts.host_count > 0)
+        worker_count = opts.host_count * (opts.workers ? opts.workers : 1);
+    if(opts.backend == BACKEND_FORK){
+        start_workers();
+        printf("I'm the father [pid: %d, ppid: %d]\n",getpid(),getppid());
+    }
+    start = t = phase_mark(PHASE_DISTRIBUTE, t);
+    
+    if(opts.power > 0){
+        printf("Power: A^%d of a %dx%d A, %d multiplies\n", opts.power, dim_m, dim_m,
+               (int) floor(log2(opts.power)) + __builtin_popcount(opts.power) - 1);
+        result = power_product(leaves[0], dim_m, opts.power);
+    }
+    else{
+        cost = chain_order(dims, count, split);
+        printf("Chain: ");
+        print_order(split, count, 0, count - 1);
+        printf(", %.0f multiply-adds, %.0f left to right\n", cost, chain_left_cost(dims, count));
+        result = chain_product(leaves, dims, split, count, 0, count - 1);
+    }
+    t = seconds_now();
+    printf("Multiplied %dx%d in %.3f ms\n", dim_m, dim_n, (t - start) * 1e3);
+    
+    // Wait for all the childeren
+    if(opts.backend == BACKEND_FORK)
+        pool_stop(&pool);
+    t = phase_mark(PHASE_DISTRIBUTE, t);
+    
+    //Display the product, or write it out as it is
+    if(opts.c_out[0] != '\0'){
+        save_matrix(opts.c_out, DTYPE_INT64, result, dim_m, dim_n);
+        printf("Matrix C: %s\n", opts.c_out);
+    }
+    else if(opts.output == OUTPUT_TEXT){
+        writer_text(&out, "Matrix C:\n");
+        display_wide(result, dim_m, dim_n);
+    }
+    writer_flush(&out);
+    t = phase_mark(PHASE_OUTPUT, t);
+    
+    //SVD of the final product, laid out as load_workspace() does
+    svd_rows = dim_m >= dim_n ? dim_m : dim_n;
+    svd_cols = dim_m >= dim_n ? dim_n : dim_m;
+    combined_result = svd_workspace(svd_rows, svd_cols, opts.svd_vectors, &svd_ld);
+    singular_values = malloc(svd_cols * sizeof(double));
+    if(combined_result == NULL || singular_values == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in run_chain()\n");
+        exit(EXIT_FAILURE);
+    }
+    for(int i = 0; i < dim_m; i++){
+        for(int j = 0; j < dim_n; j++){
+            if(dim_m >= dim_n)
+                combined_result[(size_t) j*svd_ld + i] = (double) result[(size_t) i*dim_n + j];
+            else
+                combined_result[(size_t) i*svd_ld + j] = (double) result[(size_t) i*dim_n + j];
+        }
+    }
+    // A chain of one is its own product
+    if(result != leaves[0])
+        free(result);
+    for(int i = 0; i < count; i++)
+        free(leaves[i]);
+    value_count = singular_values_of_c();
+    t = phase_mark(PHASE_SVD, t);
+    print_values();
+    writer_flush(&out);
+    phase_mark(PHASE_OUTPUT, t);
+    if(opts.timings)
+        print_timings();
+}
+
+/**
+ Matrix `index` of a chain, or A of a power, widened to int64. A binary
+ input has its size in the header; a raw text one takes it from
+ --chain-dims, then --dims, then -n.
+return:
+   the matrix on success
+   NULL after reporting the failure
+*/
+int64_t *load_chain_input(const char *path, int index, int *rows, int *cols){
+    struct matfile_header h;
+    size_t file_size, size;
+    char *chars = NULL, *data = NULL;
+    int64_t *wide;
+    int fd = open_input(path, index + 1, &h, &file_size), status = -1;
+    
+    if(fd == -1)
+        return NULL;
+    if(h.magic != 0){
+        *rows = (int) h.rows; *cols = (int) h.cols;
+    }
+    else if(opts.chain_dim_count > 0){
+        *rows = opts.chain_dims[index]; *cols = opts.chain_dims[index+1];
+    }
+    else if(opts.dim_m > 0){
+        *rows = opts.dim_m; *cols = opts.dim_k;
+    }
+    else if(opts.n >= 2){
+        *rows = *cols = (int) pow(2, opts.n);
+    }
+    else{
+        fprintf(stderr,"Size of %s is unknown, give --chain-dims, --dims or -n\n", path);
+        close(fd);
+        return NULL;
+    }
+    size = (size_t) *rows * *cols;
+    wide = malloc(size * sizeof(int64_t));
+    if(h.magic == 0)
+        chars = malloc(size + 1);
+    if(wide == NULL || (h.magic == 0 && chars == NULL)){
+        fprintf(stderr, "Failed allocated memory : malloc() in load_chain_input()\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    // Binary inputs of any integer type, the int64 C of an earlier chain among them, are taken as they are
+    if(h.magic != 0){
+        data = map_input(fd, h.offset, matfile_extent(&h));
+        if(data == NULL)
+            fprintf(stderr,"Input %s could not be mapped: %s\n", path, strerror(errno));
+        else{
+            status = matfile_load_int64(data, &h, wide);
+            munmap(data - h.offset, h.offset + matfile_extent(&h));
+        }
+    }
+    else if(file_size < size)
+        fprintf(stderr,"Not enough characters to read in %s: %lu bytes, expected : %lu bytes, \n", path, file_size, size);
+    else if(load_input(fd, &h, chars, size) == -1)
+        fprintf(stderr,"Error when reading %s : not enough bytes to fill matrix\n", path);
+    else if(check_matrix(chars, *rows, *cols) == 0){
+        // Same elements as the char kernels see
+        for(size_t e = 0; e < size; e++)
+            wide[e] = chars[e];
+        status = 0;
+    }
+    close(fd);
+    free(chars);
+    if(status == -1){
+        free(wide);
+        return NULL;
+    }
+    return wide;
+}
+
+/**
+ Ai..Aj in the order chain_order() left in split, the leaves are
+ matrices [dims[i] x dims[i+1]]. Intermediates are freed as soon as
+ the step that needs them is done, the leaves are not.
+return:
+   the product, a leaf when i == j
+*/
+int64_t *chain_product(int64_t **leaves, const int *dims, const int *split, int count, int i, int j){
+    int64_t *x, *y, *c;
+    int s;
+    
+    if(i == j)
+        return leaves[i];
+    s = split[i*count + j];
+    x = chain_product(leaves, dims, split, count, i, s);
+    y = chain_product(leaves, dims, split, count, s + 1, j);
+    c = multiply_step(x, y, dims[i], dims[s+1], dims[j+1]);
+    if(s > i)
+        free(x);
+    if(j > s + 1)
+        free(y);
+    return c;
+}
+
+/**
+ A^p of an n x n A, p >= 1, squaring along the bits of p: at most
+ 2 log2(p) multiplies instead of p - 1. A is left as it is.
+return:
+   the power, a buffer of its own
+*/
+int64_t *power_product(const int64_t *a, int n, int p){
+    const int64_t *base = a;
+    int64_t *result = NULL, *next;
+    
+    for(;;){
+        if(p & 1){
+            if(result == NULL){
+                next = malloc((size_t) n * n * sizeof(int64_t));
+                if(next == NULL){
+                    fprintf(stderr, "Failed allocated memory : malloc() in power_product()\n");
+                    exit(EXIT_FAILURE);
+                }
+                memcpy(next, base, (size_t) n * n * sizeof(int64_t));
+            }
+            else
+                next = multiply_step(result, base, n, n, n);
+            free(result);
+            result = next;
+        }
+        p >>= 1;
+        if(p == 0)
+            break;
+        next = multiply_step(base, base, n, n, n);
+        if(base != a)
+            free((int64_t *) base);
+        base = next;
+    }
+    if(base != a)
+        free((int64_t *) base);
+    return result;
+}
+
+/**
+ One step of a chain, C = A x B of int64, on the running pool or on
+ threads. The grid is -g, cut down to the step, or THREAD_TILE tiles.
+return:
+   C [m x n], the caller frees it; ends the program on failure
+*/
+int64_t *multiply_step(const int64_t *a, const int64_t *b, int m, int k, int n){
+    static int warned;
+    struct chain_step step;
+    struct job job;
+    struct thread_job tasks;
+    double t = seconds_now();
+    int status;
+    
+    memset(&step, 0, sizeof(step));
+    step.a = a; step.b = b;
+    step.m = m; step.k = k; step.n = n;
+    step.grid_rows = opts.grid_rows ? opts.grid_rows : (m + THREAD_TILE - 1) / THREAD_TILE;
+    step.grid_cols = opts.grid_cols ? opts.grid_cols : (n + THREAD_TILE - 1) / THREAD_TILE;
+    if(step.grid_rows > m)
+        step.grid_rows = m;
+    if(step.grid_cols > n)
+        step.grid_cols = n;
+    grid_rows = step.grid_rows;
+    grid_cols = step.grid_cols;
+    tile_count += step.grid_rows * step.grid_cols;
+    
+    // Every element of C is a sum of k products, none of them larger than the largest of A times the largest of B
+    if(!warned && wide_bound(a, (size_t) m * k) * wide_bound(b, (size_t) k * n) * k >= 0x1p63){
+        printf("Warning: elements of the %dx%dx%d step can pass 2^63, int64 wraps around\n", m, k, n);
+        warned = 1;
+    }
+    step.c = malloc((size_t) m * n * sizeof(int64_t));
+    if(step.c == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in multiply_step()\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    if(opts.backend == BACKEND_THREADS){
+        tasks.task_count = step.grid_rows * step.grid_cols;
+        tasks.ctx = &step;
+        tasks.run = wide_compute;
+        status = tpool_run(worker_count, &tasks, NULL);
+    }
+    else{
+        // A tile ships its rows of A and its columns of B, the largest one has to fit a frame
+        size_t tile = ((size_t) (m + step.grid_rows - 1) / step.grid_rows + (size_t) (n + step.grid_cols - 1) / step.grid_cols) * k;
+        
+        if(tile * sizeof(int64_t) > UINT32_MAX){
+            fprintf(stderr,"Tiles of the %dx%dx%d step are too large for a frame, a finer -g splits them\n", m, k, n);
+            exit(EXIT_FAILURE);
+        }
+        step.gather = malloc((size_t) k * ((n + step.grid_cols - 1) / step.grid_cols) * sizeof(int64_t));
+        if(step.gather == NULL){
+            fprintf(stderr, "Failed allocated memory : malloc() in multiply_step()\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(&job, 0, sizeof(job));
+        job.tile_count = step.grid_rows * step.grid_cols;
+        job.ctx = &step;
+        job.request = wide_request;
+        job.result = wide_result;
+        status = pool_run(&pool, &job);
+        free(step.gather);
+    }
+    if(status == -1){
+        fprintf(stderr, "Multiplication failed\n");
+        exit(EXIT_FAILURE);
+    }
+    phase_mark(PHASE_MULTIPLY, t);
+    multiply_phases();
+    printf("Step %dx%dx%d: %d tiles in %.3f ms\n", m, k, n, step.grid_rows * step.grid_cols, (seconds_now() - t) * 1e3);
+    return step.c;
+}
+
+// Parent side of a chain tile: its rows of A, then its columns of B gathered into rows
+int wide_request(void *ctx, int index, struct msgbuf *out){
+    struct chain_step *step = ctx;
+    struct tile t;
+    struct frame f;
+    
+    grid_tile(step->m, step->n, step->grid_rows, step->grid_cols, index, &t);
+    memset(&f, 0, sizeof(f));
+    f.kind = FRAME_WIDE;
+    f.index = index;
+    f.row0 = t.row0;
+    f.col0 = t.col0;
+    f.rows = t.rows;
+    f.cols = t.cols;
+    f.inner = step->k;
+    for(int i = 0; i < step->k; i++)
+        memcpy(step->gather + (size_t) i*t.cols, step->b + (size_t) i*step->n + t.col0, t.cols * sizeof(int64_t));
+    return frame_append(out, &f, step->a + (size_t) t.row0*step->k, (size_t) t.rows * step->k * sizeof(int64_t),
+                        step->gather, (size_t) step->k * t.cols * sizeof(int64_t));
+}
+
+// Places a finished chain tile in C, position comes from the header
+int wide_result(void *ctx, const struct frame *f, const void *payload){
+    struct chain_step *step = ctx;
+    
+    if(f->kind != FRAME_RESULT || f->row0 < 0 || f->col0 < 0 || f->rows < 1 || f->cols < 1 ||
+       f->row0 + f->rows > step->m || f->col0 + f->cols > step->n || f->length != (size_t) f->rows * f->cols * sizeof(int64_t)){
+        fprintf(stderr,"Malformed result frame for chain tile %d\n", f->index);
+        return -1;
+    }
+    for(int r = 0; r < f->rows; r++)
+        memcpy(step->c + (size_t) (f->row0 + r)*step->n + f->col0, (const int64_t *) payload + (size_t) r*f->cols, f->cols * sizeof(int64_t));
+    return 0;
+}
+
+// One tile of a chain step, computed in place
+void wide_compute(void *ctx, int index){
+    struct chain_step *step = ctx;
+    struct tile t;
+    
+    grid_tile(step->m, step->n, step->grid_rows, step->grid_cols, index, &t);
+    multiply_wide(step->a + (size_t) t.row0*step->k, step->k, step->b + t.col0, step->n,
+                  step->c + (size_t) t.row0*step->n + t.col0, step->n, t.rows, t.cols, step->k);
+}
+
+// ((A1 A2) A3) for the order chain_order() left in split
+void print_order(const int *split, int count, int i, int j){
+    if(i == j){
+        printf("A%d", i + 1);
+        return;
+    }
+    printf("(");
+    print_order(split, count, i, split[i*count + j]);
+    printf(" ");
+    print_order(split, count, split[i*count + j] + 1, j);
+    printf(")");
+}
+
+/**
+ Job server: the workers are forked once, then jobs are taken from the
+ clients of the Unix socket, one connection at a time, until SIGINT or
+ SIGTERM. A job costs its compute time and a round trip.
+ */
+void serve(void){
+    int client;
+    
+    // One log line per job, readable as it happens
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    // A client hanging up must not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+    // Set before the fork, so workers leave signals to the parent
+    serving = 1;
+    
+    // Workers first, they must not inherit the listening socket
+    if(opts.backend == BACKEND_FORK){
+        worker_count = opts.workers ? opts.workers : (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if(opts.host_count > 0)
+            worker_count = opts.host_count * (opts.workers ? opts.workers : 1);
+        start_workers();
+    }
+    serve_fd = sock_listen_unix(opts.serve_path);
+    if(serve_fd == -1){
+        fprintf(stderr,"Socket %s could not be opened: %s\n", opts.serve_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    printf("Serving jobs on %s [pid: %d]\n", opts.serve_path, getpid());
+    
+    while(serving){
+        client = accept(serve_fd, NULL, NULL);
+        if(client == -1 && errno == EINTR)
+            continue;
+        if(client == -1){
+            perror("accept() in serve()");
+            break;
+        }
+        serve_client(client);
+        close(client);
+    }
+    
+    printf("Stopping the server\n");
+    if(pool.count > 0)
+        pool_stop(&pool);
+}
+
+// Jobs of one connection, answered in order until the client hangs up
+void serve_client(int client){
+    struct pollfd pfd;
+    struct frame f;
+    int got;
+    
+    pfd.fd = client;
+    pfd.events = POLLIN;
+    while(serving){
+        // A signal ends the wait, serving tells whether to go on
+        if(poll(&pfd, 1, -1) == -1)
+            continue;
+        got = recv_frame(client, &f);
+        if(got == -1)
+            fprintf(stderr,"Truncated job frame: serve_client()\n");
+        if(got != 1 || serve_job(client, &f) == -1)
+            break;
+    }
+}
+
+// FRAME_ERROR with a message for the client
+int reply_error(int client, const char *message){
+    struct frame f;
+    
+    memset(&f, 0, sizeof(f));
+    f.kind = FRAME_ERROR;
+    return send_frame(client, &f, message, strlen(message), NULL, 0);
+}
+
+/**
+ One job: A and B are read from the client, multiplied like a local
+ run and C and/or the singular values are sent back.
+return:
+   0 when the connection can take the next job, a refused job included
+  -1 when the connection is to be dropped
+*/
+int serve_job(int client, const struct frame *f){
+    const char *error = NULL;
+    struct frame reply;
+    int status = 0;
+    
+    if(f->kind != FRAME_JOB || f->rows < 1 || f->inner < 1 || f->cols < 1 ||
+       f->length != (size_t) f->rows * f->inner + (size_t) f->inner * f->cols){
+        fprintf(stderr,"Malformed job frame: serve_job()\n");
+        reply_error(client, "Malformed job");
+        return -1;
+    }
+    dim_m = f->rows; dim_k = f->inner; dim_n = f->cols;
+    
+    if(plan_job() == -1)
+        error = "Tile grid larger than the matrix";
+    else if((f->index & JOB_C) && (size_t) dim_m * dim_n * sizeof(int) > UINT32_MAX)
+        error = "C does not fit in one frame";
+    else if(alloc_buffers() == -1)
+        error = "Out of memory";
+    if(error != NULL){
+        status = discard_full(client, f->length);
+        reply_error(client, error);
+        printf("Job %dx%dx%d refused: %s\n", dim_m, dim_k, dim_n, error);
+        free_buffers();
+        return status;
+    }
+    
+    if(read_full(client, matrix1_buffer, input1_size) != (ssize_t) input1_size ||
+       read_full(client, matrix2_buffer, input2_size) != (ssize_t) input2_size){
+        fprintf(stderr,"Not enough bytes to read: serve_job()\n");
+        free_buffers();
+        return -1;
+    }
+    
+    if(!(f->index & JOB_BINARY) && (check_matrix(matrix1_buffer, dim_m, dim_k) == -1 || check_matrix(matrix2_buffer, dim_k, dim_n) == -1))
+        error = "Matrix elements out of range";
+    else if(multiply() == -1){
+        // The pool is out of step with its workers, no further job can trust it
+        error = "Multiplication failed";
+        serving = 0;
+    }
+    else if(f->index & JOB_VALUES){
+        load_workspace();
+        value_count = singular_values_of_c();
+    }
+    
+    if(error != NULL)
+        status = reply_error(client, error);
+    memset(&reply, 0, sizeof(reply));
+    if(error == NULL && (f->index & JOB_C)){
+        reply.kind = FRAME_RESULT;
+        reply.rows = dim_m; reply.cols = dim_n; reply.inner = dim_k;
+        status = send_frame(client, &reply, result_c, (size_t) dim_m * dim_n * sizeof(int), NULL, 0);
+    }
+    if(error == NULL && status == 0 && (f->index & JOB_VALUES)){
+        reply.kind = FRAME_VALUES;
+        reply.rows = 1; reply.cols = value_count;
+        status = send_frame(client, &reply, singular_values, value_count * sizeof(double), NULL, 0);
+    }
+    printf("Job %dx%dx%d %s\n", dim_m, dim_k, dim_n, error != NULL ? error : "done");
+    free_buffers();
+    return status;
+}
+
+/**
+ Client side of --connect: A and B go to the server in one job, C and
+ the singular values come back as --reply asks.
+return:
+   how many singular values came back
+*/
+int remote_job(void){
+    int fd, count = 0, pending = opts.reply;
+    struct frame f;
+    char message[256];
+    size_t size;
+    
+    signal(SIGPIPE, SIG_IGN);
+    fd = sock_connect_unix(opts.connect_path);
+    if(fd == -1){
+        fprintf(stderr,"Job server %s could not be reached: %s\n", opts.connect_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    
+    memset(&f, 0, sizeof(f));
+    f.kind = FRAME_JOB;
+    f.index = opts.reply;
+    if(header1.magic != 0 || header2.magic != 0)
+        f.index |= JOB_BINARY;
+    f.rows = dim_m; f.inner = dim_k; f.cols = dim_n;
+    if(send_frame(fd, &f, matrix1_buffer, input1_size, matrix2_buffer, input2_size) == -1){
+        perror("Write error : Client > Server\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    while(pending != 0){
+        if(recv_frame(fd, &f) != 1){
+            fprintf(stderr,"Job server closed the connection\n");
+            exit(EXIT_FAILURE);
+        }
+        if(f.kind == FRAME_ERROR){
+            size = f.length < sizeof(message) ? f.length : sizeof(message) - 1;
+            if(read_full(fd, message, size) != (ssize_t) size)
+                size = 0;
+            message[size] = '\0';
+            fprintf(stderr,"Job server: %s\n", message);
+            exit(EXIT_FAILURE);
+        }
+        if(f.kind == FRAME_RESULT && (pending & JOB_C) && f.rows == dim_m && f.cols == dim_n &&
+           f.length == (size_t) dim_m * dim_n * sizeof(int) && read_full(fd, result_c, f.length) == (ssize_t) f.length)
+            pending &= ~JOB_C;
+        else if(f.kind == FRAME_VALUES && (pending & JOB_VALUES) && f.cols >= 0 && f.cols <= svd_cols &&
+                f.length == f.cols * sizeof(double) && read_full(fd, singular_values, f.length) == (ssize_t) f.length){
+            count = f.cols;
+            pending &= ~JOB_VALUES;
+        }
+        else{
+            fprintf(stderr,"Malformed reply frame: remote_job()\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    close(fd);
+    return count;
+}
+
+// SVD, a wide C is decomposed as C' which has the same singular values
+void load_workspace(void){
+    for(int i = 0; i < dim_m; i++){
+        for(int j = 0; j < dim_n; j++){
+            if(dim_m >= dim_n)
+                combined_result[(size_t) j*svd_ld + i] = result_c[(size_t) i*dim_n + j];
+            else
+                combined_result[(size_t) i*svd_ld + j] = result_c[(size_t) i*dim_n + j];
+        }
+    }
+}
+
+/**
+ Fills singular_values from the SVD workspace, with the method the
+ options ask for: top k, Gram eigenvalues, or Jacobi on one or more threads.
+return:
+   how many values were computed, largest first
+*/
+int singular_values_of_c(void){
+    int status;
+    
+    if(opts.top_k > 0 && opts.top_k < svd_cols){
+        status = svd_top_k(combined_result, svd_ld, singular_values, svd_rows, svd_cols, opts.top_k, opts.svd_tol);
+        if(status == -1){
+            fprintf(stderr, "Failed allocated memory : svd_top_k() in singular_values_of_c()\n");
+            exit(EXIT_FAILURE);
+        }
+        if(status > TOPK_MAX_ITER)
+            printf("Warning: Top %d values did not settle to %g in %d iterations...\n", opts.top_k, opts.svd_tol, TOPK_MAX_ITER);
+        topk_iterations = status > TOPK_MAX_ITER ? TOPK_MAX_ITER : status;
+        return opts.top_k;
+    }
+    if(opts.svd_method == SVD_GRAM){
+        if(svd_values_gram(combined_result, svd_ld, singular_values, svd_rows, svd_cols) == 0)
+            return svd_cols;
+        fprintf(stderr,"Gram eigenvalues failed, using Jacobi\n");
+    }
+    if(opts.svd_threads > 1)
+        svd_parallel(combined_result, svd_ld, singular_values, svd_rows, svd_cols, opts.svd_vectors, opts.svd_threads);
+    else
+        svd(combined_result, svd_ld, singular_values, svd_rows, svd_cols, opts.svd_vectors);
+    return svd_cols;
+}
+
+/**
+ Read-only private mapping of size bytes from offset on in an input
+ file, offset is 0 or the data offset of a binary header. The front of
+ the file is mapped too, so the pointer minus offset unmaps it.
+ The kernel is told the file is read front to back and to start reading
+ ahead now, workers forked later share the same page cache pages.
+return:
+   the elements on success
+   NULL on failure, errno set
+*/
+char *map_input(int fd, size_t offset, size_t size){
+    char *map = mmap(NULL, offset + size, PROT_READ, MAP_PRIVATE, fd, 0);
+    
+    if(map == MAP_FAILED)
+        return NULL;
+    madvise(map, offset + size, MADV_SEQUENTIAL);
+    madvise(map, offset + size, MADV_WILLNEED);
+    return map + offset;
+}
+
+/**
+ Opens input `number` and reads its header when it is a binary matrix
+ file, h is left all zero for a raw text input.
+return:
+   the descriptor on success
+  -1 after reporting the failure
+*/
+int open_input(const char *path, int number, struct matfile_header *h, size_t *file_size){
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    
+    if(fd == -1 || fstat(fd, &st) == -1){
+        fprintf(stderr,"Input %d file could not be opened: %s\n", number, strerror(errno));
+        return -1;
+    }
+    *file_size = st.st_size;
+    if(matfile_probe(fd, *file_size, h) == -1){
+        close(fd);
+        return -1;
+    }
+    if(h->magic != 0)
+        printf("Input %d: %s %llux%llu binary matrix\n", number, dtype_name(h->dtype),
+               (unsigned long long) h->rows, (unsigned long long) h->cols);
+    return fd;
+}
+
+/**
+ Fills buffer with the dense char matrix of an input. Raw text and
+ dense int8 files take one read, any other binary layout is mapped
+ and converted element by element.
+return:
+   0 on success
+  -1 on a short read or an element that is not a char value
+*/
+int load_input(int fd, const struct matfile_header *h, char *buffer, size_t size){
+    char *data;
+    int status;
+    
+    if(h->magic == 0 || matfile_is_dense_int8(h)){
+        if(lseek(fd, h->offset, SEEK_SET) == -1)
+            return -1;
+        return read_full(fd, buffer, size) == (ssize_t) size ? 0 : -1;
+    }
+    data = map_input(fd, h->offset, matfile_extent(h));
+    if(data == NULL)
+        return -1;
+    status = matfile_load_int8(data, h, buffer);
+    munmap(data - h->offset, h->offset + matfile_extent(h));
+    return status;
+}
+
+// [rows x cols] of dtype as a binary matrix file, ends the program on failure
+void save_matrix(const char *path, int dtype, const void *data, int rows, int cols){
+    struct matfile_header h;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    
+    matfile_init(&h, dtype, rows, cols, 0);
+    if(fd == -1 || matfile_write(fd, &h, data) == -1){
+        fprintf(stderr,"Output %s could not be written: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+// Every element and a space, one row per line
+void print_matrix(char *matrix, int rows, int cols, int ascii){
+    for(int i = 0; i < rows; i++)
+        writer_char_row(&out, matrix + (size_t) i*cols, cols, ascii);
+}
+
+// output: [1, 2, 3, 4]
+void display_arr(double *array, int n){
+    writer_char(&out, '[');
+    for(int i = 0; i < n-1; i++){
+        writer_fixed3(&out, array[i]);
+        writer_text(&out, ", ");
+    }
+    writer_fixed3(&out, array[n-1]);
+    writer_text(&out, "]\n");
+}
+
+// n x n V, column j at v + j*ld, same layout as display_result()
+void display_vectors(double *v, int ld, int n){
+    writer_text(&out, "[\n");
+    for(int i = 0; i <n; i++){
+        writer_char(&out, '[');
+        for(int j = 0; j <n-1; j++){
+            writer_fixed3(&out, v[(size_t) j*ld + i]);
+            writer_text(&out, ", ");
+        }
+        writer_fixed3(&out, v[(size_t) (n-1)*ld + i]);
+        writer_text(&out, "],\n");
+    }
+    writer_text(&out, "]\n");
+}
+
+// Same layout as the old 2d double dump, C is printed before the SVD overwrites it
+// The elements are integers, so "%.3f" is the digits and ".000"
+void display_result(int *array, int rows, int cols){
+    writer_text(&out, "[\n");
+    for(int i = 0; i <rows; i++){
+        writer_char(&out, '[');
+        writer_int_row(&out, array + (size_t) i*cols, cols, ".000, ", ".000],\n");
+    }
+    writer_text(&out, "]\n");
+}
+
+// display_result() of an int64 C
+void display_wide(const int64_t *array, int rows, int cols){
+    writer_text(&out, "[\n");
+    for(int i = 0; i <rows; i++){
+        writer_char(&out, '[');
+        writer_long_row(&out, array + (size_t) i*cols, cols, ".000, ", ".000],\n");
+    }
+    writer_text(&out, "]\n");
+}
+
+// Singular values and vectors as the options ask for them, after the SVD
+void print_values(void){
+    if((opts.reply & JOB_VALUES) && opts.s2_out[0] != '\0'){
+        save_matrix(opts.s2_out, DTYPE_DOUBLE, singular_values, 1, value_count);
+        printf("Singular Values Squared: %s\n", opts.s2_out);
+    }
+    else if((opts.reply & JOB_VALUES) && opts.output == OUTPUT_TEXT){
+        writer_text(&out, "Singular Values Squared:\n");
+        display_arr(singular_values, value_count);
+    }
+    
+    // V of C' holds the left vectors of C
+    if(opts.svd_vectors && opts.output == OUTPUT_TEXT){
+        writer_text(&out, dim_m >= dim_n ? "Right Singular Vectors V:\n" : "Left Singular Vectors U:\n");
+        display_vectors(combined_result + svd_rows, svd_ld, svd_cols);
+    }
+}
+
+double seconds_now(void){
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Adds the time since start to phase, returns the start of the next one
+double phase_mark(enum phase phase, double start){
+    double now = seconds_now();
+    
+    phase_seconds[phase] += now - start;
+    if(phase_first[phase] == 0.0)
+        phase_first[phase] = start;
+    phase_last[phase] = now;
+    return now;
+}
+
+/**
+ Splits the wall time of multiply() that was counted as the multiply:
+ the parent's time building and writing requests is the distribute
+ phase, reading and storing results the gather phase, the rest is spent
+ waiting on the workers. The thread backend has neither.
+ */
+void multiply_phases(void){
+    phase_seconds[PHASE_MULTIPLY] -= pool.send_time + pool.receive_time;
+    phase_seconds[PHASE_DISTRIBUTE] += pool.send_time;
+    phase_seconds[PHASE_GATHER] += pool.receive_time;
+    pool.send_time = pool.receive_time = 0.0;
+}
+
+// One line, name=milliseconds, read by pipes-bench
+void print_timings(void){
+    printf("Timings ms:");
+    for(int p = 0; p < PHASE_COUNT; p++)
+        printf(" %s=%.3f", phase_names[p], phase_seconds[p] * 1e3);
+    printf("\n");
+}
+
+// --stats: every worker of the pool sends its stats on the way out
+void attach_worker_stats(void){
+    if(!opts.stats || pool.count == 0)
+        return;
+    free(worker_stats);
+    worker_stats = calloc(pool.count, sizeof(struct worker_stats));
+    pool.stats = worker_stats;
+}
+
+/**
+ Starts the workers of the fork backend: forked here, or connected to
+ the --hosts daemons. Ends the program when they cannot be had.
+ */
+void start_workers(void){
+    int window = opts.window ? opts.window : opts.host_count > 0 ? REMOTE_WINDOW : TILE_WINDOW;
+    
+    if(opts.host_count > 0){
+        if(connect_hosts(window) == -1)
+            exit(EXIT_FAILURE);
+    }
+    else if(pool_start(&pool, worker_count, window, process_tiles) == -1){
+        perror("Worker creation error\n");
+        exit(EXIT_FAILURE);
+    }
+    attach_worker_stats();
+}
+
+/**
+ --hosts: worker_count connections handed out round-robin over the
+ hosts, so -w 2 is two connections, two worker processes, per host.
+return:
+   0 when every connection is up and in the pool
+  -1 after reporting the host that could not be reached
+*/
+int connect_hosts(int window){
+    char list[sizeof(opts.hosts)], **hosts = malloc(opts.host_count * sizeof(char *)), *save;
+    int *fds = malloc(worker_count * sizeof(int)), count, status = 0;
+    
+    if(hosts == NULL || fds == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in connect_hosts()\n");
+        free(hosts);
+        free(fds);
+        return -1;
+    }
+    snprintf(list, sizeof(list), "%s", opts.hosts);
+    hosts[0] = strtok_r(list, ",", &save);
+    for(int h = 1; h < opts.host_count; h++)
+        hosts[h] = strtok_r(NULL, ",", &save);
+    
+    for(count = 0; count < worker_count; count++){
+        const char *host = hosts[count % opts.host_count];
+        
+        if(host == NULL || (fds[count] = sock_connect_tcp(host)) == -1){
+            fprintf(stderr,"Worker %s could not be reached: %s\n", host != NULL ? host : "(empty)", strerror(errno));
+            status = -1;
+            break;
+        }
+    }
+    if(status == 0 && pool_attach(&pool, fds, count, window) == -1){
+        perror("Worker creation error\n");
+        status = -1;
+    }
+    if(status == 0)
+        printf("Connected to %d workers on %d hosts\n", count, opts.host_count);
+    else{
+        while(count-- > 0)
+            close(fds[count]);
+    }
+    free(hosts);
+    free(fds);
+    return status;
+}
+
+/**
+ --worker: a remote worker daemon for the --hosts of other runs. Each
+ connection is served by its own forked process_tiles(), which reads
+ tiles from the socket and writes results to it until the parent of
+ the run shuts it down, so a host gives as many workers as connections
+ are opened to it. The daemon runs until SIGINT or SIGTERM.
+ */
+void serve_tiles(void){
+    int client, connections = 0;
+    pid_t pid;
+    
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    signal(SIGPIPE, SIG_IGN);
+    // The connection workers are never waited for, the kernel reaps them
+    signal(SIGCHLD, SIG_IGN);
+    serving = 1;
+    
+    serve_fd = sock_listen_tcp(opts.worker_address);
+    if(serve_fd == -1){
+        fprintf(stderr,"Worker address %s could not be opened: %s\n", opts.worker_address, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    printf("Serving tiles on %s [pid: %d]\n", opts.worker_address, getpid());
+    
+    while(serving){
+        client = accept(serve_fd, NULL, NULL);
+        if(client == -1 && errno == EINTR)
+            continue;
+        if(client == -1){
+            perror("accept() in serve_tiles()");
+            break;
+        }
+        sock_nodelay(client);
+        pid = fork();
+        if(pid == 0){
+            close(serve_fd);
+            process_tiles(connections, client, client);
+            _exit(EXIT_SUCCESS);
+        }
+        if(pid == -1)
+            perror("fork() in serve_tiles()");
+        close(client);
+        connections++;
+    }
+    printf("Stopping the worker\n");
+}
+
+// Seconds since the start of the run in ms, null for a time never taken
+static void print_ms(FILE *fp, const char *name, double time){
+    if(time == 0.0)
+        fprintf(fp, "\"%s\": null", name);
+    else
+        fprintf(fp, "\"%s\": %.3f", name, (time - epoch) * 1e3);
+}
+
+/**
+ --stats: one JSON document on stderr, or in the --stats file, written
+ on the way out so a failed run reports how far it got. Times are ms,
+ *_ms points in time are relative to the start of the run.
+ */
+void write_stats(void){
+    static int written;
+    const char *method = opts.svd_method == SVD_GRAM ? "gram" : opts.svd_threads > 1 ? "jacobi-parallel" : "jacobi";
+    int64_t events[COUNTER_COUNT];
+    uint64_t sent = 0, received = 0;
+    FILE *fp = stderr;
+    int workers = worker_stats != NULL ? worker_count : 0;
+    
+    if(!opts.stats || written || getpid() != main_pid)
+        return;
+    written = 1;
+    if(opts.stats_path[0] != '\0' && (fp = fopen(opts.stats_path, "w")) == NULL){
+        fprintf(stderr,"Stats file %s could not be written: %s\n", opts.stats_path, strerror(errno));
+        return;
+    }
+    if(opts.top_k > 0 && opts.top_k < svd_cols)
+        method = "top-k";
+    
+    fprintf(fp, "{\n  \"pid\": %d, \"backend\": \"%s\", \"transport\": \"%s\", \"ingest\": \"%s\", \"algo\": \"%s\", \"kernel\": \"%s\",\n",
+            (int) main_pid, opts.backend == BACKEND_THREADS ? "threads" : "fork", opts.transport == TRANSPORT_SHM ? "shm" : "pipe",
+            opts.ingest == INGEST_MMAP ? "mmap" : "read", algo == ALGO_STRASSEN ? "strassen" : "classic", kernel_name());
+    fprintf(fp, "  \"dims\": [%d, %d, %d], \"grid\": [%d, %d], \"tiles\": %d, \"worker_count\": %d, \"batch_pairs\": %d,\n",
+            dim_m, dim_k, dim_n, grid_rows, grid_cols, tile_count, worker_count, batch_count);
+    fprintf(fp, "  \"elapsed_ms\": %.3f,\n  \"phases\": {", (seconds_now() - epoch) * 1e3);
+    for(int p = 0; p < PHASE_COUNT; p++){
+        fprintf(fp, "%s\n    \"%s\": {\"ms\": %.3f, ", p ? "," : "", phase_names[p], phase_seconds[p] * 1e3);
+        print_ms(fp, "start_ms", phase_first[p]);
+        fprintf(fp, ", ");
+        print_ms(fp, "end_ms", phase_last[p]);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  },\n  \"svd\": {\"method\": \"%s\", \"kernel\": \"%s\", \"sweeps\": %d, \"rotations\": %ld, \"power_iterations\": %d},\n",
+            method, svd_kernel_name(), svd_counts.sweeps, svd_counts.rotations, topk_iterations);
+    if(opts.cache_dir[0] != '\0')
+        fprintf(fp, "  \"cache\": {\"hit\": %s, \"hits\": %llu, \"misses\": %llu, \"stores\": %llu, \"evictions\": %llu},\n",
+                cached ? "true" : "false", (unsigned long long) cache.counts.hits, (unsigned long long) cache.counts.misses,
+                (unsigned long long) cache.counts.stores, (unsigned long long) cache.counts.evictions);
+    
+    counters_read(&parent_counters, events);
+    fprintf(fp, "  \"parent\": {\"pid\": %d", (int) main_pid);
+    stats_print_events(fp, events);
+    fprintf(fp, "},\n  \"workers\": [");
+    for(int i = 0; i < workers; i++){
+        struct worker_stats *w = &worker_stats[i];
+        
+        sent += w->bytes_sent;
+        received += w->bytes_received;
+        fprintf(fp, "%s\n    {\"worker\": %d, \"pid\": %d, \"tiles\": %d, ", i ? "," : "", i, (int) w->pid, w->tiles);
+        print_ms(fp, "start_ms", w->start);
+        fprintf(fp, ", ");
+        print_ms(fp, "end_ms", w->end);
+        fprintf(fp, ", \"wait_ms\": %.3f, \"busy_ms\": %.3f, \"bytes_sent\": %llu, \"bytes_received\": %llu",
+                w->wait_seconds * 1e3, w->busy_seconds * 1e3, (unsigned long long) w->bytes_sent, (unsigned long long) w->bytes_received);
+        stats_print_events(fp, w->events);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "%s],\n  \"pipes\": {\"bytes_sent\": %llu, \"bytes_received\": %llu},\n  \"threads\": [",
+            workers ? "\n  " : "", (unsigned long long) sent, (unsigned long long) received);
+    for(int i = 0; thread_stats != NULL && i < thread_stats_count; i++){
+        struct thread_stats *t = &thread_stats[i];
+        
+        fprintf(fp, "%s\n    {\"thread\": %d, \"tasks\": %d, \"steals\": %d, \"stolen\": %d, \"ms\": %.3f",
+                i ? "," : "", i, t->tasks, t->steals, t->stolen, t->seconds * 1e3);
+        stats_print_events(fp, t->events);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "%s]\n}\n", thread_stats_count ? "\n  " : "");
+    
+    if(fp != stderr)
+        fclose(fp);
+    counters_close(&parent_counters);
+    free(worker_stats);
+    free(thread_stats);
+    worker_stats = NULL;
+    thread_stats = NULL;
+}
+
+void handle_SIGINT(int sig_no){
+    if(serving && (sig_no == SIGINT || sig_no == SIGTERM)){
+        // The server stops between jobs, the workers wait for their pipes to close
+        serving = 0;
+    }
+    else if(sig_no == SIGINT){
+        //Terminate children
+        pool_kill(&pool, SIGTERM);
         fprintf(stderr, "Aborting program due to SIGINT\n");
         cleanup();
     }
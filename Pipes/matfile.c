@@ -0,0 +1,210 @@
+//
+//  matfile.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "matfile.h"
+#include "protocol.h"
+
+static const char *dtype_names[] = {NULL, "int8", "int16", "int32", "float", "double", "int64"};
+
+// Bytes of one element, 0 for an unknown type
+size_t dtype_size(int dtype){
+    switch(dtype){
+        case DTYPE_INT8: return 1;
+        case DTYPE_INT16: return 2;
+        case DTYPE_INT32: return 4;
+        case DTYPE_FLOAT: return sizeof(float);
+        case DTYPE_DOUBLE: return sizeof(double);
+        case DTYPE_INT64: return sizeof(int64_t);
+    }
+    return 0;
+}
+
+const char *dtype_name(int dtype){
+    return dtype_size(dtype) ? dtype_names[dtype] : "unknown";
+}
+
+// enum matfile_dtype of a name, -1 when unknown
+int dtype_parse(const char *name){
+    for(int d = DTYPE_INT8; d <= DTYPE_INT64; d++){
+        if(strcmp(name, dtype_names[d]) == 0)
+            return d;
+    }
+    return -1;
+}
+
+/**
+ Header of a row major [rows x cols] file, each row padded to a
+ multiple of row_align bytes, 0 or 1 for no padding.
+ */
+void matfile_init(struct matfile_header *h, int dtype, size_t rows, size_t cols, size_t row_align){
+    memset(h, 0, sizeof(*h));
+    h->magic = MATFILE_MAGIC;
+    h->version = MATFILE_VERSION;
+    h->dtype = dtype;
+    h->rows = rows;
+    h->cols = cols;
+    h->col_stride = dtype_size(dtype);
+    h->row_stride = cols * h->col_stride;
+    if(row_align > 1)
+        h->row_stride = (h->row_stride + row_align - 1) / row_align * row_align;
+    h->offset = MATFILE_ALIGN;
+}
+
+// Bytes from `offset` to the end of the last element
+size_t matfile_extent(const struct matfile_header *h){
+    if(h->rows == 0 || h->cols == 0)
+        return 0;
+    return (h->rows - 1) * h->row_stride + (h->cols - 1) * h->col_stride + dtype_size(h->dtype);
+}
+
+/**
+ Reads and checks the header of a possibly binary input.
+return:
+   1 for a valid binary matrix file, header in h
+   0 when the file does not start with the magic, a raw text input
+  -1 after reporting a header that does not describe the file
+*/
+int matfile_probe(int fd, size_t file_size, struct matfile_header *h){
+    size_t size;
+
+    if(file_size < sizeof(*h) || pread(fd, h, sizeof(*h), 0) != (ssize_t) sizeof(*h) || h->magic != MATFILE_MAGIC){
+        memset(h, 0, sizeof(*h));
+        return 0;
+    }
+    size = dtype_size(h->dtype);
+    if(h->version != MATFILE_VERSION || size == 0){
+        fprintf(stderr,"Binary matrix file version %d, type %d is not supported\n", h->version, h->dtype);
+        return -1;
+    }
+    if(h->rows == 0 || h->cols == 0 || h->rows > INT32_MAX || h->cols > INT32_MAX ||
+       h->col_stride < size || h->row_stride < size || h->offset < sizeof(*h)){
+        fprintf(stderr,"Malformed binary matrix header: %llux%llu, strides %llu and %llu, offset %llu\n",
+                (unsigned long long) h->rows, (unsigned long long) h->cols, (unsigned long long) h->row_stride,
+                (unsigned long long) h->col_stride, (unsigned long long) h->offset);
+        return -1;
+    }
+    if(h->offset > file_size || matfile_extent(h) > file_size - h->offset){
+        fprintf(stderr,"Binary matrix file is short: %zu bytes, the header needs %llu\n",
+                file_size, (unsigned long long) (h->offset + matfile_extent(h)));
+        return -1;
+    }
+    return 1;
+}
+
+// A row major char matrix with no padding, usable without a copy
+int matfile_is_dense_int8(const struct matfile_header *h){
+    return h->dtype == DTYPE_INT8 && h->col_stride == 1 && h->row_stride == h->cols;
+}
+
+// Element (i, j), data points at `offset` in the file
+double matfile_get(const char *data, const struct matfile_header *h, size_t i, size_t j){
+    const char *p = data + i * h->row_stride + j * h->col_stride;
+    int16_t s; int32_t w; float f; double d; int64_t l;
+
+    switch(h->dtype){
+        case DTYPE_INT8: return (signed char) *p;
+        case DTYPE_INT16: memcpy(&s, p, sizeof(s)); return s;
+        case DTYPE_INT32: memcpy(&w, p, sizeof(w)); return w;
+        case DTYPE_FLOAT: memcpy(&f, p, sizeof(f)); return f;
+        case DTYPE_DOUBLE: memcpy(&d, p, sizeof(d)); return d;
+        case DTYPE_INT64: memcpy(&l, p, sizeof(l)); return (double) l;
+    }
+    return 0.0;
+}
+
+/**
+ Copies any layout and type into a dense row major char matrix, the
+ form the multiply kernels take.
+return:
+   0 on success
+  -1 after reporting the first element that is not a char value
+*/
+int matfile_load_int8(const char *data, const struct matfile_header *h, char *dst){
+    double value;
+
+    if(matfile_is_dense_int8(h)){
+        memcpy(dst, data, h->rows * h->cols);
+        return 0;
+    }
+    for(size_t i = 0; i < h->rows; i++){
+        for(size_t j = 0; j < h->cols; j++){
+            value = matfile_get(data, h, i, j);
+            if(value != floor(value) || value < -128.0 || value > 127.0){
+                fprintf(stderr,"Element (%zu, %zu) = %g of a %s matrix does not fit a char\n", i, j, value, dtype_name(h->dtype));
+                return -1;
+            }
+            dst[i * h->cols + j] = (char) value;
+        }
+    }
+    return 0;
+}
+
+/**
+ Copies any layout and type into a dense row major int64 matrix, the
+ operands of a chain. Integer types are copied exactly, an int64 too,
+ which a double would round.
+return:
+   0 on success
+  -1 after reporting the first element that is not an integer
+*/
+int matfile_load_int64(const char *data, const struct matfile_header *h, int64_t *dst){
+    double value;
+    int64_t l;
+    
+    for(size_t i = 0; i < h->rows; i++){
+        for(size_t j = 0; j < h->cols; j++){
+            if(h->dtype == DTYPE_INT64){
+                memcpy(&l, data + i * h->row_stride + j * h->col_stride, sizeof(l));
+                dst[i * h->cols + j] = l;
+                continue;
+            }
+            value = matfile_get(data, h, i, j);
+            if(value != floor(value) || value < -0x1p63 || value >= 0x1p63){
+                fprintf(stderr,"Element (%zu, %zu) = %g of a %s matrix is not an int64\n", i, j, value, dtype_name(h->dtype));
+                return -1;
+            }
+            dst[i * h->cols + j] = (int64_t) value;
+        }
+    }
+    return 0;
+}
+
+/**
+ Writes the header and a dense row major [rows x cols] data as laid
+ out by h, the padding is zero filled. Rows go out in one write when
+ there is no padding between them.
+return:
+   0 on success
+  -1 on error, errno set
+*/
+int matfile_write(int fd, const struct matfile_header *h, const void *data){
+    size_t line = h->cols * h->col_stride, gap = h->row_stride - line;
+    char pad[MATFILE_ALIGN] = {0};
+    size_t part;
+
+    if(write_full(fd, h, sizeof(*h)) == -1)
+        return -1;
+    for(size_t done = sizeof(*h); done < h->offset; done += part){
+        part = h->offset - done < sizeof(pad) ? h->offset - done : sizeof(pad);
+        if(write_full(fd, pad, part) == -1)
+            return -1;
+    }
+    if(gap == 0)
+        return write_full(fd, data, h->rows * line);
+    for(size_t i = 0; i < h->rows; i++){
+        if(write_full(fd, (const char *) data + i * line, line) == -1)
+            return -1;
+        // Nothing follows the last row
+        for(size_t done = 0; i + 1 < h->rows && done < gap; done += part){
+            part = gap - done < sizeof(pad) ? gap - done : sizeof(pad);
+            if(write_full(fd, pad, part) == -1)
+                return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+//
+//  matfile.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef matfile_h
+#define matfile_h
+
+#include "globals.h"
+#include <stdint.h>
+/*
+ Binary matrix files: a 64 byte header, then the elements from `offset`
+ on, row i column j at offset + i*row_stride + j*col_stride. The data
+ starts on a MATFILE_ALIGN boundary, so a mapping of the file hands out
+ aligned rows with no parsing. A dense int8 file is used in place as
+ an input; any other type or layout is converted once on load.
+ Everything is little endian, as written by the machines this runs on.
+ */
+
+#define MATFILE_MAGIC 0x54414d50 // "PMAT" at the start of the file
+#define MATFILE_VERSION 1
+#define MATFILE_ALIGN 64        // Data offset, one cache line
+
+enum matfile_dtype {
+    DTYPE_INT8 = 1,     // The element type of the raw text inputs
+    DTYPE_INT16,
+    DTYPE_INT32,        // C
+    DTYPE_FLOAT,
+    DTYPE_DOUBLE,       // Singular values
+    DTYPE_INT64         // C of a --chain or --power
+};
+
+struct matfile_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t dtype;     // enum matfile_dtype
+    uint64_t rows, cols;
+    uint64_t row_stride; // Bytes from one row to the next
+    uint64_t col_stride; // Bytes from one column to the next
+    uint64_t offset;    // Bytes from the start of the file to element (0, 0)
+    uint64_t reserved[2];
+};
+
+size_t dtype_size(int dtype);
+const char *dtype_name(int dtype);
+int dtype_parse(const char *name);
+void matfile_init(struct matfile_header *h, int dtype, size_t rows, size_t cols, size_t row_align);
+size_t matfile_extent(const struct matfile_header *h);
+int matfile_probe(int fd, size_t file_size, struct matfile_header *h);
+int matfile_is_dense_int8(const struct matfile_header *h);
+double matfile_get(const char *data, const struct matfile_header *h, size_t i, size_t j);
+int matfile_load_int8(const char *data, const struct matfile_header *h, char *dst);
+int matfile_load_int64(const char *data, const struct matfile_header *h, int64_t *dst);
+int matfile_write(int fd, const struct matfile_header *h, const void *data);
+
+#endif /* matfile_h */
@@ -0,0 +1,71 @@
+//
+//  matrix.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "matrix.h"
+#include "kernel.h"
+
+/**
+ Bounds of tile `index` when a rows x cols matrix is split into a
+ grid_rows x grid_cols grid, tiles numbered row by row.
+ Edge tiles absorb the remainder when the grid does not divide the matrix.
+ */
+void grid_tile(int rows, int cols, int grid_rows, int grid_cols, int index, struct tile *t){
+    int r = index / grid_cols, c = index % grid_cols;
+    
+    t->row0 = (int) ((long) r * rows / grid_rows);
+    t->col0 = (int) ((long) c * cols / grid_cols);
+    t->rows = (int) ((long) (r+1) * rows / grid_rows) - t->row0;
+    t->cols = (int) ((long) (c+1) * cols / grid_cols) - t->col0;
+}
+
+// Rows of the tile from [m x k] A, full width: [t->rows x k] I.E A11, A12 for C11
+void get_tile_rows(const char *matrix, char *row, int k, const struct tile *t){
+    memcpy(row, matrix + (size_t) t->row0 * k, (size_t) t->rows * k);
+    row[(size_t) t->rows * k] = '\0';
+    //printf("row: %s\n", row);
+}
+
+// Columns of the tile from [k x n] B, full height: [k x t->cols] I.E B11, B21 for C11
+void get_tile_columns(const char *matrix, char *column, int k, int n, const struct tile *t){
+    size_t m = 0;
+    
+    for(int i = 0; i < k; i++){
+        memcpy(column + m, matrix + (size_t) i*n + t->col0, t->cols);
+        m += t->cols;
+    }
+    column[m] = '\0';
+    //printf("col: %s\n", column);
+}
+
+/**
+ [rows x inner] . [inner x cols] -> [rows x cols]
+ lda, ldb and ldc are the row strides of m1, m2 and result, so the
+ operands can be packed tiles or views into the full matrices.
+ Inputs are expected to have passed check_matrix().
+ */
+void multiply_matrices(const char *m1, int lda, const char *m2, int ldb, int *result, int ldc, int rows, int cols, int inner){
+    multiply_blocked(m1, lda, m2, ldb, result, ldc, rows, cols, inner);
+}
+
+/**
+ A '\0' element is out of range, checked once per input instead of on
+ every access.
+return:
+   0 when every element is usable
+  -1 after reporting the first '\0' element
+*/
+int check_matrix(const char *matrix, int rows, int cols){
+    const char *hole = memchr(matrix, '\0', (size_t) rows * cols);
+    long offset;
+    
+    if(hole == NULL)
+        return 0;
+    offset = hole - matrix;
+    fprintf(stderr, "FATAL ERROR\nIndex ij out of range : (%ld, %ld)\n", offset / cols, offset % cols);
+    return -1;
+}
@@ -0,0 +1,29 @@
+//
+//  matrix.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef matrix_h
+#define matrix_h
+
+#include "globals.h"
+/*
+ Tile geometry, tile extraction and multiplication of char matrices.
+ */
+
+// A rectangular block of C, rows [row0, row0+rows) and columns [col0, col0+cols)
+struct tile {
+    int row0, col0;
+    int rows, cols;
+};
+
+void grid_tile(int rows, int cols, int grid_rows, int grid_cols, int index, struct tile *t);
+void get_tile_rows(const char *matrix, char *row, int k, const struct tile *t);
+void get_tile_columns(const char *matrix, char *column, int k, int n, const struct tile *t);
+void multiply_matrices(const char *m1, int lda, const char *m2, int ldb, int *result, int ldc, int rows, int cols, int inner);
+int check_matrix(const char *matrix, int rows, int cols);
+
+#endif /* matrix_h */
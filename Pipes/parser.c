@@ -7,29 +7,130 @@
 //
 
 #include "parser.h"
+#include "strassen.h"
+#include "protocol.h"
+#include "stream.h"
+#include "cache.h"
+#include "chain.h"
+
+// Long only options start after the single character ones
+enum {
+    OPT_TRANSPORT = 256,
+    OPT_KERNEL,
+    OPT_SELF_CHECK,
+    OPT_ALGO,
+    OPT_CROSSOVER,
+    OPT_INGEST,
+    OPT_DIMS,
+    OPT_SVD_THREADS,
+    OPT_SVD_VECTORS,
+    OPT_SVD_METHOD,
+    OPT_SVD_TOL,
+    OPT_SVD_KERNEL,
+    OPT_BACKEND,
+    OPT_SERVE,
+    OPT_CONNECT,
+    OPT_REPLY,
+    OPT_BATCH,
+    OPT_BATCH_OUT,
+    OPT_C_OUT,
+    OPT_S2_OUT,
+    OPT_QUIET,
+    OPT_OUTPUT,
+    OPT_TIMINGS,
+    OPT_STATS,
+    OPT_HOSTS,
+    OPT_WORKER,
+    OPT_WINDOW,
+    OPT_STREAM,
+    OPT_CACHE,
+    OPT_CACHE_SIZE,
+    OPT_INCREMENTAL,
+    OPT_CHAIN,
+    OPT_CHAIN_DIMS,
+    OPT_POWER
+};
+
+static const struct option long_options[] = {
+    {"transport", required_argument, NULL, OPT_TRANSPORT},
+    {"kernel", required_argument, NULL, OPT_KERNEL},
+    {"self-check", no_argument, NULL, OPT_SELF_CHECK},
+    {"algo", required_argument, NULL, OPT_ALGO},
+    {"crossover", required_argument, NULL, OPT_CROSSOVER},
+    {"ingest", required_argument, NULL, OPT_INGEST},
+    {"dims", required_argument, NULL, OPT_DIMS},
+    {"svd-threads", required_argument, NULL, OPT_SVD_THREADS},
+    {"svd-vectors", no_argument, NULL, OPT_SVD_VECTORS},
+    {"svd-method", required_argument, NULL, OPT_SVD_METHOD},
+    {"svd-tol", required_argument, NULL, OPT_SVD_TOL},
+    {"svd-kernel", required_argument, NULL, OPT_SVD_KERNEL},
+    {"backend", required_argument, NULL, OPT_BACKEND},
+    {"serve", required_argument, NULL, OPT_SERVE},
+    {"connect", required_argument, NULL, OPT_CONNECT},
+    {"reply", required_argument, NULL, OPT_REPLY},
+    {"batch", required_argument, NULL, OPT_BATCH},
+    {"batch-out", required_argument, NULL, OPT_BATCH_OUT},
+    {"c-out", required_argument, NULL, OPT_C_OUT},
+    {"s2-out", required_argument, NULL, OPT_S2_OUT},
+    {"quiet", no_argument, NULL, OPT_QUIET},
+    {"output", required_argument, NULL, OPT_OUTPUT},
+    {"timings", no_argument, NULL, OPT_TIMINGS},
+    {"stats", optional_argument, NULL, OPT_STATS},
+    {"hosts", required_argument, NULL, OPT_HOSTS},
+    {"worker", required_argument, NULL, OPT_WORKER},
+    {"window", required_argument, NULL, OPT_WINDOW},
+    {"stream", optional_argument, NULL, OPT_STREAM},
+    {"cache", required_argument, NULL, OPT_CACHE},
+    {"cache-size", required_argument, NULL, OPT_CACHE_SIZE},
+    {"incremental", required_argument, NULL, OPT_INCREMENTAL},
+    {"chain", required_argument, NULL, OPT_CHAIN},
+    {"chain-dims", required_argument, NULL, OPT_CHAIN_DIMS},
+    {"power", required_argument, NULL, OPT_POWER},
+    {NULL, 0, NULL, 0}
+};
 
 //Parser functions
 
+// A byte count with an optional K, M or G, -1 for anything else or zero
+static int parse_bytes(const char *text, size_t *bytes){
+    char *end;
+    
+    *bytes = strtoull(text, &end, 10);
+    if(end != text && *end != '\0' && end[1] == '\0' && strchr("KkMmGg", *end) != NULL){
+        *bytes <<= *end == 'K' || *end == 'k' ? 10 : *end == 'M' || *end == 'm' ? 20 : 30;
+        end++;
+    }
+    return end == text || *end != '\0' || *bytes == 0 ? -1 : 0;
+}
+
 /**
 parameters:
-   ip   : input path buffer
-   op   : input2 path buffer
-   n     : matrix size(2^n)
+   opts : options to fill, defaults are set here
    argc : argument count
    argv : arguments vector
 return:
    0 on success
    1 on failure
 */
-int parse_arguments(char *input1_path, char *input2_path, int *n, int argc, char *argv[]){
+int parse_arguments(struct options *opts, int argc, char *argv[]){
     int option;
+    char *end;
+    
+    memset(opts, 0, sizeof(*opts));
+    snprintf(opts->kernel, sizeof(opts->kernel), "auto");
+    snprintf(opts->svd_kernel, sizeof(opts->svd_kernel), "scalar");
+    opts->crossover = STRASSEN_CROSSOVER;
+    opts->svd_threads = 1;
+    opts->svd_tol = 1e-6;
+    opts->reply = JOB_C | JOB_VALUES;
+    opts->cache_limit = CACHE_LIMIT;
     
-    while((option = getopt(argc, argv, "i:j:n:")) != -1){ //get option from the getopt() method
+    while((option = getopt_long(argc, argv, "i:j:n:g:w:k:", long_options, NULL)) != -1){ //get option from the getopt() method
         switch(option){
             case 'i': // input1 file path
-                snprintf(input1_path,255,"%s",optarg);
-                if (access(input1_path, F_OK | R_OK) != -1)
-                    printf("Input 1 path : %s\n", input1_path);
+                snprintf(opts->input1_path,255,"%s",optarg);
+                if (access(opts->input1_path, F_OK | R_OK) != -1)
+                    printf("Input 1 path : %s\n", opts->input1_path);
                 else{
                     fprintf(stderr,"Input 1 file not accessable: %s\n", strerror(errno));
                     return 1;
@@ -37,17 +138,260 @@ int parse_arguments(char *input1_path, char *input2_path, int *n, int argc, char
                     
                 break;
             case 'j': // input2 file path
-                snprintf(input2_path,255,"%s",optarg);
-                if (access(input2_path, F_OK | R_OK) != -1)
-                    printf("Input 2 path : %s\n", input2_path);
+                snprintf(opts->input2_path,255,"%s",optarg);
+                if (access(opts->input2_path, F_OK | R_OK) != -1)
+                    printf("Input 2 path : %s\n", opts->input2_path);
                 else{
                     fprintf(stderr,"Input 2 file not accessable: %s\n", strerror(errno));
                     return 1;
                 }
                 break;
             case 'n':
-                *n = (int) strtol(optarg, NULL, 10);
-                printf("N: %d\n", *n);
+                opts->n = (int) strtol(optarg, NULL, 10);
+                printf("N: %d\n", opts->n);
+                break;
+            case 'g': // tile grid, PxQ
+                opts->grid_rows = (int) strtol(optarg, &end, 10);
+                if(*end != 'x' && *end != 'X'){
+                    fprintf(stderr,"Grid must be given as PxQ: %s\n", optarg);
+                    return 1;
+                }
+                opts->grid_cols = (int) strtol(end+1, &end, 10);
+                if(*end != '\0' || opts->grid_rows < 1 || opts->grid_cols < 1){
+                    fprintf(stderr,"Invalid grid: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'w': // worker count
+                opts->workers = (int) strtol(optarg, NULL, 10);
+                if(opts->workers < 1){
+                    fprintf(stderr,"Worker count must be positive: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_TRANSPORT:
+                if(strcmp(optarg, "pipe") == 0)
+                    opts->transport = TRANSPORT_PIPE;
+                else if(strcmp(optarg, "shm") == 0)
+                    opts->transport = TRANSPORT_SHM;
+                else{
+                    fprintf(stderr,"Unknown transport: %s (pipe or shm)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_KERNEL:
+                snprintf(opts->kernel, sizeof(opts->kernel), "%s", optarg);
+                break;
+            case OPT_SELF_CHECK:
+                opts->self_check = 1;
+                break;
+            case OPT_ALGO:
+                if(strcmp(optarg, "classic") == 0)
+                    opts->algo = ALGO_CLASSIC;
+                else if(strcmp(optarg, "strassen") == 0)
+                    opts->algo = ALGO_STRASSEN;
+                else{
+                    fprintf(stderr,"Unknown algorithm: %s (classic or strassen)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_CROSSOVER:
+                opts->crossover = (int) strtol(optarg, NULL, 10);
+                if(opts->crossover < 1){
+                    fprintf(stderr,"Crossover must be positive: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_INGEST:
+                if(strcmp(optarg, "read") == 0)
+                    opts->ingest = INGEST_READ;
+                else if(strcmp(optarg, "mmap") == 0)
+                    opts->ingest = INGEST_MMAP;
+                else{
+                    fprintf(stderr,"Unknown ingest mode: %s (read or mmap)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_DIMS: // MxKxN, A is MxK and B is KxN
+                opts->dim_m = (int) strtol(optarg, &end, 10);
+                if(*end == 'x' || *end == 'X')
+                    opts->dim_k = (int) strtol(end+1, &end, 10);
+                if(*end == 'x' || *end == 'X')
+                    opts->dim_n = (int) strtol(end+1, &end, 10);
+                if(*end != '\0' || opts->dim_m < 1 || opts->dim_k < 1 || opts->dim_n < 1){
+                    fprintf(stderr,"Dimensions must be given as MxKxN: %s\n", optarg);
+                    return 1;
+                }
+                printf("Dims: %dx%dx%d\n", opts->dim_m, opts->dim_k, opts->dim_n);
+                break;
+            case OPT_SVD_THREADS: // 0 is one per online CPU
+                opts->svd_threads = (int) strtol(optarg, &end, 10);
+                if(*end != '\0' || opts->svd_threads < 0){
+                    fprintf(stderr,"SVD thread count must be 0 or more: %s\n", optarg);
+                    return 1;
+                }
+                if(opts->svd_threads == 0)
+                    opts->svd_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+                break;
+            case 'k': // top k singular values
+                opts->top_k = (int) strtol(optarg, &end, 10);
+                if(*end != '\0' || opts->top_k < 1){
+                    fprintf(stderr,"K must be positive: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_SVD_TOL:
+                opts->svd_tol = strtod(optarg, &end);
+                if(*end != '\0' || opts->svd_tol <= 0.0){
+                    fprintf(stderr,"SVD tolerance must be positive: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_SVD_KERNEL:
+                snprintf(opts->svd_kernel, sizeof(opts->svd_kernel), "%s", optarg);
+                break;
+            case OPT_SVD_VECTORS:
+                opts->svd_vectors = 1;
+                break;
+            case OPT_SVD_METHOD:
+                if(strcmp(optarg, "jacobi") == 0)
+                    opts->svd_method = SVD_JACOBI;
+                else if(strcmp(optarg, "gram") == 0)
+                    opts->svd_method = SVD_GRAM;
+                else{
+                    fprintf(stderr,"Unknown SVD method: %s (jacobi or gram)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_BACKEND:
+                if(strcmp(optarg, "fork") == 0)
+                    opts->backend = BACKEND_FORK;
+                else if(strcmp(optarg, "threads") == 0)
+                    opts->backend = BACKEND_THREADS;
+                else{
+                    fprintf(stderr,"Unknown backend: %s (fork or threads)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_SERVE:
+                snprintf(opts->serve_path, sizeof(opts->serve_path), "%s", optarg);
+                break;
+            case OPT_CONNECT:
+                snprintf(opts->connect_path, sizeof(opts->connect_path), "%s", optarg);
+                break;
+            case OPT_HOSTS: // HOST:PORT,HOST:PORT,...
+                snprintf(opts->hosts, sizeof(opts->hosts), "%s", optarg);
+                opts->host_count = 1;
+                for(const char *c = opts->hosts; *c != '\0'; c++)
+                    opts->host_count += *c == ',';
+                break;
+            case OPT_WORKER:
+                snprintf(opts->worker_address, sizeof(opts->worker_address), "%s", optarg);
+                break;
+            case OPT_WINDOW:
+                opts->window = atoi(optarg);
+                if(opts->window < 1){
+                    fprintf(stderr,"Window must be at least one tile: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_REPLY:
+                if(strcmp(optarg, "c") == 0)
+                    opts->reply = JOB_C;
+                else if(strcmp(optarg, "values") == 0)
+                    opts->reply = JOB_VALUES;
+                else if(strcmp(optarg, "both") == 0)
+                    opts->reply = JOB_C | JOB_VALUES;
+                else{
+                    fprintf(stderr,"Unknown reply: %s (c, values or both)\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_BATCH:
+                snprintf(opts->batch_path, sizeof(opts->batch_path), "%s", optarg);
+                if(access(opts->batch_path, F_OK | R_OK) == -1){
+                    fprintf(stderr,"Batch file not accessable: %s\n", strerror(errno));
+                    return 1;
+                }
+                printf("Batch path : %s\n", opts->batch_path);
+                break;
+            case OPT_BATCH_OUT:
+                snprintf(opts->batch_out, sizeof(opts->batch_out), "%s", optarg);
+                break;
+            case OPT_C_OUT:
+                snprintf(opts->c_out, sizeof(opts->c_out), "%s", optarg);
+                break;
+            case OPT_S2_OUT:
+                snprintf(opts->s2_out, sizeof(opts->s2_out), "%s", optarg);
+                break;
+            case OPT_QUIET:
+                opts->quiet = 1;
+                break;
+            case OPT_TIMINGS:
+                opts->timings = 1;
+                break;
+            case OPT_STATS:
+                opts->stats = 1;
+                if(optarg != NULL)
+                    snprintf(opts->stats_path, sizeof(opts->stats_path), "%s", optarg);
+                break;
+            case OPT_STREAM: // Memory budget in bytes, K, M or G
+                opts->stream_budget = STREAM_BUDGET;
+                if(optarg == NULL)
+                    break;
+                if(parse_bytes(optarg, &opts->stream_budget) == -1){
+                    fprintf(stderr,"Stream budget must be a byte count, K, M or G: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_CACHE:
+                snprintf(opts->cache_dir, sizeof(opts->cache_dir), "%s", optarg);
+                break;
+            case OPT_INCREMENTAL:
+                snprintf(opts->incremental_path, sizeof(opts->incremental_path), "%s", optarg);
+                break;
+            case OPT_CHAIN: // FILE,FILE,...
+                snprintf(opts->chain, sizeof(opts->chain), "%s", optarg);
+                opts->chain_count = 1;
+                for(const char *c = opts->chain; *c != '\0'; c++)
+                    opts->chain_count += *c == ',';
+                break;
+            case OPT_CHAIN_DIMS: // D0xD1x...xDm, matrix i is Di x Di+1
+                opts->chain_dim_count = 0;
+                for(char *p = optarg; opts->chain_dim_count <= CHAIN_MAX; p = end + 1){
+                    opts->chain_dims[opts->chain_dim_count] = (int) strtol(p, &end, 10);
+                    if(opts->chain_dims[opts->chain_dim_count++] < 1 || (*end != 'x' && *end != 'X'))
+                        break;
+                }
+                if(*end != '\0' || opts->chain_dim_count < 2 || opts->chain_dims[opts->chain_dim_count - 1] < 1){
+                    fprintf(stderr,"Chain dimensions must be given as D0xD1x...xDm, at most %d matrices: %s\n", CHAIN_MAX, optarg);
+                    return 1;
+                }
+                break;
+            case OPT_POWER:
+                opts->power = (int) strtol(optarg, &end, 10);
+                if(*end != '\0' || opts->power < 1){
+                    fprintf(stderr,"Power must be positive: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_CACHE_SIZE:
+                if(parse_bytes(optarg, &opts->cache_limit) == -1){
+                    fprintf(stderr,"Cache size must be a byte count, K, M or G: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_OUTPUT:
+                if(strcmp(optarg, "text") == 0)
+                    opts->output = OUTPUT_TEXT;
+                else if(strcmp(optarg, "bin") == 0)
+                    opts->output = OUTPUT_BIN;
+                else if(strcmp(optarg, "none") == 0)
+                    opts->output = OUTPUT_NONE;
+                else{
+                    fprintf(stderr,"Unknown output: %s (text, bin or none)\n", optarg);
+                    return 1;
+                }
                 break;
             case ':':
                 printf("Option needs a value\n");
@@ -61,7 +405,120 @@ int parse_arguments(char *input1_path, char *input2_path, int *n, int argc, char
         printf("Given extra arguments: %s\n", argv[optind]);
     }
     
-    if(strlen(input1_path) == 0 || strlen(input2_path) == 0){
+    if(opts->svd_method == SVD_GRAM && opts->svd_vectors){
+        fprintf(stderr,"--svd-method=gram gives singular values only, not --svd-vectors\n");
+        return 1;
+    }
+    if(opts->top_k > 0 && (opts->svd_vectors || opts->svd_method == SVD_GRAM)){
+        fprintf(stderr,"-k gives the top singular values only, without --svd-vectors or --svd-method\n");
+        return 1;
+    }
+    
+    if(opts->backend == BACKEND_THREADS && opts->transport == TRANSPORT_SHM){
+        fprintf(stderr,"--backend=threads shares C already, not --transport=shm\n");
+        return 1;
+    }
+    
+    if(opts->serve_path[0] != '\0' && opts->connect_path[0] != '\0'){
+        fprintf(stderr,"--serve and --connect cannot be used together\n");
+        return 1;
+    }
+    // Jobs arrive over the socket, nothing is shared with the workers before they are forked
+    if(opts->serve_path[0] != '\0' && (opts->transport == TRANSPORT_SHM || opts->ingest == INGEST_MMAP)){
+        fprintf(stderr,"--serve ships every job through the pipes, not --transport=shm or --ingest=mmap\n");
+        return 1;
+    }
+    if((opts->serve_path[0] != '\0' || opts->connect_path[0] != '\0') && opts->svd_vectors){
+        fprintf(stderr,"The job server sends back C and the singular values only, not --svd-vectors\n");
+        return 1;
+    }
+    
+    // Remote workers get every operand over the network, they share nothing with this process
+    if(opts->hosts[0] != '\0' && (opts->backend == BACKEND_THREADS || opts->transport == TRANSPORT_SHM || opts->connect_path[0] != '\0')){
+        fprintf(stderr,"--hosts sends tiles over TCP, not with --backend=threads, --transport=shm or --connect\n");
+        return 1;
+    }
+    
+    if(opts->batch_path[0] != '\0' && (opts->serve_path[0] != '\0' || opts->connect_path[0] != '\0')){
+        fprintf(stderr,"--batch runs locally, not with --serve or --connect\n");
+        return 1;
+    }
+    if(opts->batch_out[0] != '\0' && opts->batch_path[0] == '\0'){
+        fprintf(stderr,"--batch-out goes with --batch\n");
+        return 1;
+    }
+    
+    if((opts->c_out[0] != '\0' || opts->s2_out[0] != '\0') && (opts->serve_path[0] != '\0' || opts->batch_path[0] != '\0')){
+        fprintf(stderr,"--c-out and --s2-out go with a single multiply, not --serve or --batch\n");
+        return 1;
+    }
+    if((opts->c_out[0] != '\0' && !(opts->reply & JOB_C)) || (opts->s2_out[0] != '\0' && !(opts->reply & JOB_VALUES))){
+        fprintf(stderr,"--c-out and --s2-out need C and the values in the --reply\n");
+        return 1;
+    }
+    
+    if(opts->output == OUTPUT_BIN && opts->c_out[0] == '\0' && opts->s2_out[0] == '\0' && opts->batch_out[0] == '\0'){
+        fprintf(stderr,"--output=bin writes to --c-out, --s2-out or --batch-out, give at least one\n");
+        return 1;
+    }
+    
+    // C is never in memory as a whole, it goes to its file and gets no SVD
+    if(opts->stream_budget > 0 && (opts->serve_path[0] != '\0' || opts->connect_path[0] != '\0' || opts->batch_path[0] != '\0' ||
+                                   opts->hosts[0] != '\0' || opts->transport == TRANSPORT_SHM)){
+        fprintf(stderr,"--stream multiplies on threads of this process, not with --serve, --connect, --batch, --hosts or --transport=shm\n");
+        return 1;
+    }
+    if(opts->stream_budget > 0 && (opts->c_out[0] == '\0' || opts->s2_out[0] != '\0' || opts->svd_vectors || opts->top_k > 0)){
+        fprintf(stderr,"--stream writes C to --c-out and does no SVD, not --s2-out, --svd-vectors or -k\n");
+        return 1;
+    }
+    
+    // Entries are what a local run computes, C and the values without V
+    if(opts->cache_dir[0] != '\0' && (opts->serve_path[0] != '\0' || opts->connect_path[0] != '\0' || opts->batch_path[0] != '\0' ||
+                                     opts->stream_budget > 0 || opts->svd_vectors)){
+        fprintf(stderr,"--cache keeps C and the values of a single local multiply, not with --serve, --connect, --batch, --stream or --svd-vectors\n");
+        return 1;
+    }
+    
+    // Tiles of C are kept from run to run, Strassen's products mix all of them
+    if(opts->incremental_path[0] != '\0' && (opts->serve_path[0] != '\0' || opts->connect_path[0] != '\0' || opts->batch_path[0] != '\0' ||
+                                            opts->stream_budget > 0 || opts->algo == ALGO_STRASSEN)){
+        fprintf(stderr,"--incremental recomputes tiles of a local multiply, not with --serve, --connect, --batch, --stream or --algo=strassen\n");
+        return 1;
+    }
+    
+    // Every step of a chain is a new multiply of int64 tiles, shipped to the workers
+    if((opts->chain[0] != '\0' || opts->power > 0) && (opts->serve_path[0] != '\0' || opts->connect_path[0] != '\0' || opts->batch_path[0] != '\0' ||
+                                                      opts->stream_budget > 0 || opts->cache_dir[0] != '\0' || opts->incremental_path[0] != '\0' ||
+                                                      opts->algo == ALGO_STRASSEN || opts->transport == TRANSPORT_SHM)){
+        fprintf(stderr,"--chain and --power multiply int64 tiles, not with --serve, --connect, --batch, --stream, --cache, --incremental, --algo=strassen or --transport=shm\n");
+        return 1;
+    }
+    if(opts->chain[0] != '\0' && opts->power > 0){
+        fprintf(stderr,"--chain and --power cannot be used together\n");
+        return 1;
+    }
+    if(opts->chain_count > CHAIN_MAX){
+        fprintf(stderr,"A chain is at most %d matrices, %d given\n", CHAIN_MAX, opts->chain_count);
+        return 1;
+    }
+    if(opts->chain_dim_count > 0 && opts->chain[0] == '\0'){
+        fprintf(stderr,"--chain-dims goes with --chain\n");
+        return 1;
+    }
+    if(opts->chain_dim_count > 0 && opts->chain_dim_count != opts->chain_count + 1){
+        fprintf(stderr,"--chain-dims gives %d sizes, a chain of %d matrices needs %d\n", opts->chain_dim_count, opts->chain_count, opts->chain_count + 1);
+        return 1;
+    }
+    
+    if(opts->reply != (JOB_C | JOB_VALUES) && opts->connect_path[0] == '\0'){
+        fprintf(stderr,"--reply goes with --connect\n");
+        return 1;
+    }
+    
+    // A power has A only, a chain names its own files
+    if(!opts->self_check && opts->serve_path[0] == '\0' && opts->batch_path[0] == '\0' && opts->worker_address[0] == '\0' && opts->chain[0] == '\0' &&
+       (strlen(opts->input1_path) == 0 || (strlen(opts->input2_path) == 0 && opts->power == 0))){
         print_usage();
         return 1;
     }
@@ -72,5 +529,33 @@ int parse_arguments(char *input1_path, char *input2_path, int *n, int argc, char
 void print_usage(void){
     printf("Input path missing\n");
     printf("\nUsage:\n"
-           "./programA [-i1 input 2 file path] [-i2 input 2 file path] [-n 2^n matrix size]\n");
+           "./programA [-i1 input 2 file path] [-i2 input 2 file path] [-n 2^n matrix size]\n"
+           "           [-g PxQ tile grid, default 2x2, 256x256 tiles with threads]\n"
+           "           [-w worker count, default one per tile, one per CPU with threads]\n"
+           "           [--backend=fork|threads] [--transport=pipe|shm]\n"
+           "           [--kernel=auto|scalar|sse4.1|avx2|avx512vnni]\n"
+           "           [--algo=classic|strassen] [--crossover=N, default 256] [--ingest=read|mmap]\n"
+           "           [--dims=MxKxN, A is MxK and B is KxN, instead of -n]\n"
+           "           [--svd-threads=N, default 1, 0 is one per CPU] [--svd-vectors]\n"
+           "           [--svd-method=jacobi|gram] [-k top K singular values] [--svd-tol=T, default 1e-6]\n"
+           "           [--svd-kernel=scalar|auto|avx2, default scalar, the vector ones round differently]\n"
+           "           [--c-out=FILE] [--s2-out=FILE, binary matrix files instead of printing C and the values]\n"
+           "           [--quiet, A and B are not printed] [--output=text|bin|none, default text]\n"
+           "           [--timings, wall time of ingest, distribute, multiply, gather, svd and output]\n"
+           "           [--stats[=FILE], JSON of phases, workers, pipe bytes, SVD sweeps and hardware counters at exit]\n"
+           "           [--hosts=HOST:PORT,..., tiles go to remote workers, -w connections per host, default 1]\n"
+           "           [--window=N, tiles in flight per worker, default 2, 4 with --hosts]\n"
+           "           [--cache=DIR] [--cache-size=BYTES, default 1G, C and the values of earlier runs, least recently used go first]\n"
+           "           [--incremental=STATE, only tiles whose rows of A or columns of B changed since the run that wrote STATE]\n"
+           "           [--stream[=BYTES], out of core: C goes to --c-out panel by panel within BYTES, default 256M, no SVD]\n"
+           "           Inputs made by pipes-convert are binary matrix files and need no -n or --dims\n"
+           "./programA --serve=SOCKET [-w workers, default one per CPU] [options above]\n"
+           "./programA -i1 ... -i2 ... [-n N | --dims=MxKxN] --connect=SOCKET [--reply=c|values|both]\n"
+           "./programA --batch=FILE [-n N | --dims=MxKxN] [--batch-out=FILE] [-w workers, default one per CPU]\n"
+           "           [--backend=fork|threads] [--transport=pipe|shm] [--ingest=read|mmap] [--kernel=...]\n"
+           "./programA --chain=FILE,FILE,... [--chain-dims=D0xD1x...xDm | -n N] [-w workers, default one per CPU] [-g PxQ]\n"
+           "           [--backend=fork|threads] [--hosts=...] [--c-out=FILE] [SVD and output options above], int64 intermediates\n"
+           "./programA -i FILE --power=P [-n N | --dims=MxMxM] [options of --chain]\n"
+           "./programA --worker=[HOST:]PORT [--kernel=...], remote worker for --hosts, one process per connection\n"
+           "./programA --self-check\n");
 }
@@ -10,11 +10,100 @@
 #define parser_h
 
 #include "globals.h"
+#include "chain.h"
 /*
  Array and command line input parsing functions.
  */
 
-int parse_arguments(char *input1_path, char *input2_path, int *n, int argc, char *argv[]);
+// How operands and results move between parent and workers
+enum transport {
+    TRANSPORT_PIPE,     // Operands and results are copied through pipes
+    TRANSPORT_SHM       // A, B and C live in shared memory, pipes carry tile indices
+};
+
+// How the input files are brought into memory
+enum ingest {
+    INGEST_READ,        // read() into private buffers
+    INGEST_MMAP         // Mapped read-only, workers read their tiles from the page cache
+};
+
+// How C is computed from the worker results
+enum algo {
+    ALGO_CLASSIC,       // One worker task per tile of the grid
+    ALGO_STRASSEN       // Seven worker tasks, one per Strassen product
+};
+
+// Where the tiles are multiplied
+enum backend {
+    BACKEND_FORK,       // Worker processes fed over pipes by the parent
+    BACKEND_THREADS     // Threads of this process, writing straight into C
+};
+
+// How the singular values of C are found
+enum svd_method {
+    SVD_JACOBI,         // One-sided Jacobi sweeps on C
+    SVD_GRAM            // Eigenvalues of C'C, faster, small values lose precision
+};
+
+// What is printed of the matrices
+enum output {
+    OUTPUT_TEXT,        // A, B, C and the values as text
+    OUTPUT_BIN,         // Results only to the binary files of --c-out, --s2-out or --batch-out
+    OUTPUT_NONE         // Nothing, for timing the computation
+};
+
+// Parsed command line options
+struct options {
+    char input1_path[255];
+    char input2_path[255];
+    int n;              // Matrix size exponent, matrices are 2^n x 2^n
+    int grid_rows;      // Tile grid C is split into (-g PxQ), 0 until main() picks the backend's default
+    int grid_cols;
+    int workers;        // Worker process or thread count (-w), 0 for the backend's default
+    enum backend backend; // --backend=fork|threads
+    enum transport transport; // --transport=pipe|shm
+    char kernel[32];    // --kernel=auto|scalar|sse4.1|avx2|avx512vnni
+    char svd_kernel[32]; // --svd-kernel=scalar|auto|avx2, scalar keeps the original rounding
+    int self_check;     // --self-check, compare kernels and exit
+    enum algo algo;     // --algo=classic|strassen
+    int crossover;      // --crossover=N, Strassen recursion stops at this size
+    enum ingest ingest; // --ingest=read|mmap
+    int dim_m;          // --dims=MxKxN, rectangular A [M x K] and B [K x N], 0 when -n is used
+    int dim_k;
+    int dim_n;
+    int svd_threads;    // --svd-threads=N, 1 keeps the serial cyclic SVD
+    int svd_vectors;    // --svd-vectors, build and print V as well
+    enum svd_method svd_method; // --svd-method=jacobi|gram
+    int top_k;          // -k K, only the K largest singular values, 0 for all
+    double svd_tol;     // --svd-tol=T, relative change at which the top K are converged
+    char serve_path[108]; // --serve=PATH, run as a job server on this Unix socket
+    char connect_path[108]; // --connect=PATH, send the multiply to a job server
+    int reply;          // --reply=c|values|both, JOB_* flags asked of the server
+    char batch_path[255]; // --batch=FILE, many [M x K] . [K x N] pairs back to back, sizes from -n or --dims
+    char batch_out[255]; // --batch-out=FILE, all products as raw ints instead of text
+    char c_out[255];    // --c-out=FILE, C as a binary int32 matrix file instead of text
+    char s2_out[255];   // --s2-out=FILE, the squared singular values as a binary 1 x n double file
+    int quiet;          // --quiet, A and B are not echoed
+    enum output output; // --output=text|bin|none
+    int timings;        // --timings, one line of per phase wall times at the end
+    int stats;          // --stats[=FILE], a JSON document of phases, workers and counters at exit
+    char stats_path[255]; // Its file, stderr when empty
+    char hosts[1024];   // --hosts=HOST:PORT,..., remote workers instead of forked ones
+    int host_count;     // Entries in hosts
+    char worker_address[262]; // --worker=[HOST:]PORT, run as a remote worker daemon
+    int window;         // --window=N, tiles in flight per worker, 0 for the default
+    size_t stream_budget; // --stream[=BYTES], out of core multiply in this much memory, 0 when not streaming
+    char cache_dir[255]; // --cache=DIR, results of earlier runs by their inputs and options
+    size_t cache_limit; // --cache-size=BYTES, all entries together
+    char incremental_path[255]; // --incremental=STATE, block hashes and C of the last run
+    char chain[2048];   // --chain=FILE,FILE,..., the product of all of them in the cheapest order
+    int chain_count;    // Files in chain
+    int chain_dims[CHAIN_MAX + 1]; // --chain-dims=D0xD1x...xDm, sizes of raw text files in the chain
+    int chain_dim_count;
+    int power;          // --power=P, A^P of the -i input, 0 when not a power
+};
+
+int parse_arguments(struct options *opts, int argc, char *argv[]);
 void print_usage(void);
 
 #endif /* parser_h */
@@ -0,0 +1,329 @@
+//
+//  pool.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "pool.h"
+#include "stats.h"
+
+int msgbuf_append(struct msgbuf *buf, const void *data, size_t size){
+    char *grown;
+    size_t cap;
+    
+    if(buf->len + size > buf->cap){
+        cap = buf->cap ? buf->cap : 4096;
+        while(cap < buf->len + size)
+            cap *= 2;
+        grown = realloc(buf->data, cap);
+        if(grown == NULL)
+            return -1;
+        buf->data = grown;
+        buf->cap = cap;
+    }
+    if(data != NULL && size > 0)
+        memcpy(buf->data + buf->len, data, size);
+    buf->len += size;
+    return 0;
+}
+
+// Same layout and EMSGSIZE check as send_frame(), queued instead of written
+int frame_append(struct msgbuf *out, struct frame *f, const void *payload1, size_t len1, const void *payload2, size_t len2){
+    if(len1 + len2 > UINT32_MAX){
+        errno = EMSGSIZE;
+        return -1;
+    }
+    f->length = (uint32_t) (len1 + len2);
+    if(msgbuf_append(out, f, sizeof(*f)) == -1 ||
+       msgbuf_append(out, payload1, len1) == -1 || msgbuf_append(out, payload2, len2) == -1)
+        return -1;
+    return 0;
+}
+
+void msgbuf_free(struct msgbuf *buf){
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int set_nonblocking(int fd){
+    int flags = fcntl(fd, F_GETFL);
+    
+    if(flags == -1)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ Forks count workers, each running worker_main() on its own pair of pipes.
+ Only the parent returns from here.
+return:
+   0 on success
+  -1 on failure
+*/
+int pool_start(struct pool *pool, int count, int window, void (*worker_main)(int worker, int in_fd, int out_fd)){
+    int req[2], res[2];
+    
+    memset(pool, 0, sizeof(*pool));
+    pool->workers = calloc(count, sizeof(struct worker));
+    if(pool->workers == NULL)
+        return -1;
+    pool->window = window;
+    
+    // A dead worker must show up as EPIPE, not kill the parent
+    signal(SIGPIPE, SIG_IGN);
+    
+    for(int i = 0; i < count; i++){
+        if(pipe(req) == -1 || pipe(res) == -1)
+            return -1;
+        
+        pool->workers[i].pid = fork();
+        if(pool->workers[i].pid == -1)
+            return -1;
+        
+        if(pool->workers[i].pid == 0){
+            close(req[1]);
+            close(res[0]);
+            // Earlier workers would never see end of file while we hold their ends
+            for(int j = 0; j < i; j++){
+                close(pool->workers[j].req_fd);
+                close(pool->workers[j].res_fd);
+            }
+            worker_main(i, req[0], res[1]);
+            _exit(EXIT_SUCCESS);
+        }
+        
+        close(req[0]);
+        close(res[1]);
+        pool->workers[i].req_fd = req[1];
+        pool->workers[i].res_fd = res[0];
+        pool->count++;
+        if(set_nonblocking(req[1]) == -1 || set_nonblocking(res[0]) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ Pool over connected sockets, one remote worker per socket, written
+ and read both ways. The sockets are the pool's from here on.
+return:
+   0 on success
+  -1 on failure
+*/
+int pool_attach(struct pool *pool, const int *fds, int count, int window){
+    memset(pool, 0, sizeof(*pool));
+    pool->workers = calloc(count, sizeof(struct worker));
+    if(pool->workers == NULL)
+        return -1;
+    pool->window = window;
+    
+    // A worker dropping its connection must show up as EPIPE, not kill the parent
+    signal(SIGPIPE, SIG_IGN);
+    
+    for(int i = 0; i < count; i++){
+        pool->workers[i].req_fd = pool->workers[i].res_fd = fds[i];
+        pool->count++;
+        if(set_nonblocking(fds[i]) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+static double pool_clock(void){
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Writes as much of the pending requests as the pipe takes
+static int pool_send(struct worker *w){
+    ssize_t put;
+    
+    while(w->out.done < w->out.len){
+        put = write(w->req_fd, w->out.data + w->out.done, w->out.len - w->out.done);
+        if(put == -1 && errno == EINTR)
+            continue;
+        // Pipe full, the rest goes when poll() says it can
+        if(put == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if(put == -1)
+            return -1;
+        w->out.done += put;
+        w->bytes_sent += put;
+    }
+    w->out.len = w->out.done = 0;
+    return 0;
+}
+
+// Reads whatever results are available, each finished frame goes to the job
+static int pool_receive(struct worker *w, struct job *job, int *finished){
+    ssize_t got;
+    
+    for(;;){
+        if(w->in_done < sizeof(w->in))
+            got = read(w->res_fd, (char *) &w->in + w->in_done, sizeof(w->in) - w->in_done);
+        else
+            got = read(w->res_fd, w->payload.data + w->payload.len, w->in.length - w->payload.len);
+        
+        if(got == -1 && errno == EINTR)
+            continue;
+        // Nothing more to read yet
+        if(got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if(got <= 0){
+            fprintf(stderr, "Worker %d exited with %d tiles in flight\n", (int) w->pid, w->in_flight);
+            return -1;
+        }
+        w->bytes_received += got;
+        
+        if(w->in_done < sizeof(w->in)){
+            w->in_done += got;
+            if(w->in_done < sizeof(w->in))
+                continue;
+            // Header complete, make room for the payload
+            w->payload.len = 0;
+            if(msgbuf_append(&w->payload, NULL, w->in.length) == -1)
+                return -1;
+            w->payload.len = 0;
+        }
+        else
+            w->payload.len += got;
+        
+        if(w->payload.len == w->in.length){
+            if(job->result(job->ctx, &w->in, w->payload.data) == -1)
+                return -1;
+            w->in_done = 0;
+            w->in_flight--;
+            (*finished)++;
+        }
+    }
+}
+
+/**
+ Runs one job over the pool. Tiles are handed out on demand, at most
+ pool->window per worker, so faster workers end up with more tiles.
+return:
+   0 when every tile has been answered
+  -1 on failure
+*/
+int pool_run(struct pool *pool, struct job *job){
+    int next = 0, finished = 0, polled;
+    struct pollfd *fds = malloc(2 * pool->count * sizeof(struct pollfd));
+    struct worker *w;
+    double start;
+    
+    if(fds == NULL)
+        return -1;
+    
+    while(finished < job->tile_count){
+        start = pool_clock();
+        for(int i = 0; i < pool->count; i++){
+            w = &pool->workers[i];
+            while(w->in_flight < pool->window && next < job->tile_count){
+                if(job->request(job->ctx, next++, &w->out) == -1){
+                    fprintf(stderr, "Tile %d could not be queued: %s\n", next - 1, strerror(errno));
+                    goto fail;
+                }
+                w->in_flight++;
+            }
+            fds[2*i].fd = w->req_fd;
+            fds[2*i].events = w->out.done < w->out.len ? POLLOUT : 0;
+            fds[2*i+1].fd = w->res_fd;
+            fds[2*i+1].events = w->in_flight > 0 ? POLLIN : 0;
+        }
+        pool->send_time += pool_clock() - start;
+        
+        polled = poll(fds, 2 * pool->count, -1);
+        if(polled == -1 && errno == EINTR)
+            continue;
+        if(polled == -1)
+            goto fail;
+        
+        for(int i = 0; i < pool->count; i++){
+            w = &pool->workers[i];
+            if(fds[2*i].revents & (POLLERR | POLLHUP)){
+                fprintf(stderr, "Worker %d closed its request pipe\n", (int) w->pid);
+                goto fail;
+            }
+            start = pool_clock();
+            if((fds[2*i].revents & POLLOUT) && pool_send(w) == -1)
+                goto fail;
+            pool->send_time += pool_clock() - start;
+            start = pool_clock();
+            if((fds[2*i+1].revents & (POLLIN | POLLHUP | POLLERR)) && pool_receive(w, job, &finished) == -1)
+                goto fail;
+            pool->receive_time += pool_clock() - start;
+        }
+    }
+    free(fds);
+    return 0;
+    
+fail:
+    free(fds);
+    return -1;
+}
+
+/**
+ Reads the FRAME_STATS a worker left in its result pipe on the way out.
+ Nothing else can follow the last result, so the frame is whole once
+ the worker is reaped, or missing when the worker did not send one.
+ */
+static void pool_collect(struct worker *w, struct worker_stats *stats){
+    struct worker_stats sent;
+    struct frame f;
+    
+    memset(stats, 0, sizeof(*stats));
+    stats->pid = w->pid;
+    for(int i = 0; i < COUNTER_COUNT; i++)
+        stats->events[i] = -1;
+    // A remote worker follows its own options, it may not send any
+    if(w->pid > 0 && recv_frame(w->res_fd, &f) == 1 && f.kind == FRAME_STATS && f.length == sizeof(sent) &&
+       read_full(w->res_fd, &sent, sizeof(sent)) == sizeof(sent)){
+        *stats = sent;
+        w->bytes_received += sizeof(f) + sizeof(sent);
+    }
+    stats->bytes_sent = w->bytes_sent;
+    stats->bytes_received = w->bytes_received;
+}
+
+// Closing the request pipes ends the worker loops, then every worker is reaped
+// Remote workers see end of file on their socket, they are their daemon's to reap
+void pool_stop(struct pool *pool){
+    pid_t wpid;
+    
+    for(int i = 0; i < pool->count; i++){
+        if(pool->workers[i].pid > 0)
+            close(pool->workers[i].req_fd);
+        else
+            shutdown(pool->workers[i].req_fd, SHUT_WR);
+    }
+    
+    for(int i = 0; i < pool->count; i++){
+        if(pool->workers[i].pid > 0){
+            do{
+                wpid = waitpid(pool->workers[i].pid, NULL, 0);
+            }
+            while (wpid == -1 && errno == EINTR);
+            
+            if (wpid == -1)
+                perror("Wait error\n");
+        }
+        if(pool->stats != NULL)
+            pool_collect(&pool->workers[i], &pool->stats[i]);
+        close(pool->workers[i].res_fd);
+        msgbuf_free(&pool->workers[i].out);
+        msgbuf_free(&pool->workers[i].payload);
+    }
+    free(pool->workers);
+    memset(pool, 0, sizeof(*pool));
+}
+
+void pool_kill(struct pool *pool, int sig_no){
+    for(int i = 0; i < pool->count; i++){
+        if(pool->workers[i].pid > 0)
+            kill(pool->workers[i].pid, sig_no);
+    }
+}
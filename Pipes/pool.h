@@ -0,0 +1,73 @@
+//
+//  pool.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef pool_h
+#define pool_h
+
+#include "globals.h"
+#include "protocol.h"
+#include <poll.h>
+#include <sys/socket.h>
+/*
+ Worker processes and the event driven parent side of a multiply.
+ The parent never blocks on a single worker: requests are written and
+ results are read with non-blocking I/O driven by poll(), so sending,
+ computing and gathering overlap and no pipe buffer size limits n.
+ */
+
+// Growable byte buffer holding frames that are partly written or read
+struct msgbuf {
+    char *data;
+    size_t len;         // Bytes stored
+    size_t cap;
+    size_t done;        // Bytes already written out / read in
+};
+
+struct worker {
+    pid_t pid;          // 0 for a remote worker
+    int req_fd;         // Parent > worker, non-blocking
+    int res_fd;         // Worker > parent, non-blocking, the same socket as req_fd for a remote worker
+    int in_flight;      // Tiles sent and not answered yet
+    struct msgbuf out;  // Requests waiting to be written
+    struct frame in;    // Header of the result being read
+    size_t in_done;     // Header bytes read so far
+    struct msgbuf payload; // Payload of the result being read
+    uint64_t bytes_sent; // Request pipe bytes written
+    uint64_t bytes_received; // Result pipe bytes read
+};
+
+struct pool {
+    int count;
+    int window;         // Tiles in flight per worker
+    struct worker *workers;
+    double send_time;   // Seconds spent building and writing requests, summed over pool_run() calls
+    double receive_time; // Seconds spent reading and consuming results
+    struct worker_stats *stats; // When not NULL, pool_stop() fills one entry per worker
+};
+
+// One multiply: tile_count requests, each answered by exactly one result
+struct job {
+    int tile_count;
+    void *ctx;
+    // Appends the request frame for tile index to out, 0 on success
+    int (*request)(void *ctx, int index, struct msgbuf *out);
+    // Consumes the result of a tile, 0 on success
+    int (*result)(void *ctx, const struct frame *f, const void *payload);
+};
+
+int pool_start(struct pool *pool, int count, int window, void (*worker_main)(int worker, int in_fd, int out_fd));
+int pool_attach(struct pool *pool, const int *fds, int count, int window);
+int pool_run(struct pool *pool, struct job *job);
+void pool_stop(struct pool *pool);
+void pool_kill(struct pool *pool, int sig_no);
+
+int msgbuf_append(struct msgbuf *buf, const void *data, size_t size);
+int frame_append(struct msgbuf *out, struct frame *f, const void *payload1, size_t len1, const void *payload2, size_t len2);
+void msgbuf_free(struct msgbuf *buf);
+
+#endif /* pool_h */
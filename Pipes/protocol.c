@@ -0,0 +1,130 @@
+//
+//  protocol.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "protocol.h"
+
+/**
+ Reads exactly size bytes, a single read() may return less on a pipe.
+return:
+   size on success
+   0 on end of file before the first byte
+  -1 on error or end of file in the middle
+*/
+ssize_t read_full(int fd, void *buf, size_t size){
+    size_t done = 0;
+    ssize_t got;
+    
+    while(done < size){
+        got = read(fd, (char *) buf + done, size - done);
+        if(got == -1 && errno == EINTR)
+            continue;
+        if(got == 0 && done == 0)
+            return 0;
+        if(got <= 0)
+            return -1;
+        done += got;
+    }
+    return (ssize_t) size;
+}
+
+/**
+ Reads and drops size bytes, the payload of a refused frame, so the
+ next header is found where it is expected.
+return:
+   0 on success
+  -1 on error or end of file
+*/
+int discard_full(int fd, size_t size){
+    char sink[4096];
+    size_t part;
+    
+    while(size > 0){
+        part = size < sizeof(sink) ? size : sizeof(sink);
+        if(read_full(fd, sink, part) != (ssize_t) part)
+            return -1;
+        size -= part;
+    }
+    return 0;
+}
+
+// 0 on success, -1 on error
+int write_full(int fd, const void *buf, size_t size){
+    size_t done = 0;
+    ssize_t put;
+    
+    while(done < size){
+        put = write(fd, (const char *) buf + done, size - done);
+        if(put == -1 && errno == EINTR)
+            continue;
+        if(put <= 0)
+            return -1;
+        done += put;
+    }
+    return 0;
+}
+
+/**
+ Header and up to two payload parts in one writev(), the rest of a
+ partial write is finished off part by part.
+return:
+   0 on success
+  -1 on error, EMSGSIZE when the payload does not fit the 32 bit length
+*/
+int send_frame(int fd, struct frame *f, const void *payload1, size_t len1, const void *payload2, size_t len2){
+    struct iovec iov[3];
+    int count = 0;
+    ssize_t put;
+    
+    if(len1 + len2 > UINT32_MAX){
+        errno = EMSGSIZE;
+        return -1;
+    }
+    f->length = (uint32_t) (len1 + len2);
+    iov[count].iov_base = f;
+    iov[count++].iov_len = sizeof(*f);
+    if(len1 > 0){
+        iov[count].iov_base = (void *) payload1;
+        iov[count++].iov_len = len1;
+    }
+    if(len2 > 0){
+        iov[count].iov_base = (void *) payload2;
+        iov[count++].iov_len = len2;
+    }
+    
+    do{
+        put = writev(fd, iov, count);
+    }
+    while(put == -1 && errno == EINTR);
+    if(put == -1)
+        return -1;
+    
+    for(int i = 0; i < count; i++){
+        if((size_t) put >= iov[i].iov_len){
+            put -= iov[i].iov_len;
+            continue;
+        }
+        if(write_full(fd, (char *) iov[i].iov_base + put, iov[i].iov_len - put) == -1)
+            return -1;
+        put = 0;
+    }
+    return 0;
+}
+
+/**
+return:
+   1 when a header was read
+   0 on end of file
+  -1 on error
+*/
+int recv_frame(int fd, struct frame *f){
+    ssize_t got = read_full(fd, f, sizeof(*f));
+    
+    if(got == 0)
+        return 0;
+    return got == sizeof(*f) ? 1 : -1;
+}
@@ -0,0 +1,59 @@
+//
+//  protocol.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef protocol_h
+#define protocol_h
+
+#include "globals.h"
+#include <stdint.h>
+#include <sys/uio.h>
+/*
+ Framed messages between the parent and the workers, and between a
+ client and the job server.
+ Every message is a fixed size header followed by `length` payload bytes,
+ moved with as few read()/writev() calls as the pipe allows.
+ */
+
+enum frame_kind {
+    FRAME_TILE = 1,     // Parent > worker: compute a tile, [rows x inner] and [inner x cols] operands follow
+    FRAME_RESULT = 2,   // Worker > parent: finished tile, [rows x cols] ints follow
+    FRAME_PRODUCT = 3,  // Parent > worker: Strassen product `index`, [rows x inner] and [inner x cols] int16 operands follow
+    FRAME_JOB = 4,      // Client > server: multiply [rows x inner] by [inner x cols], A and B follow, index holds JOB_* flags
+    FRAME_VALUES = 5,   // Server > client: `cols` squared singular values follow as doubles
+    FRAME_ERROR = 6,    // Server > client: the job failed, a message follows
+    FRAME_BATCH = 7,    // Parent > worker: row0 pairs of a batch from pair `index` on, each [rows x inner] A then [inner x cols] B
+    FRAME_STATS = 8,    // Worker > parent: struct worker_stats (stats.h), the last frame of a worker under --stats
+    FRAME_WIDE = 9      // Parent > worker: a tile of a chain, int64 operands follow and the FRAME_RESULT holds int64
+};
+
+// What a client wants back, the server answers in this order
+enum job_reply {
+    JOB_C = 1,          // FRAME_RESULT holding all of C
+    JOB_VALUES = 2,     // FRAME_VALUES
+    JOB_BINARY = 4      // Not a reply: A and B came from binary files, '\0' is a valid element
+};
+
+// With the shm transport both kinds are sent with an empty payload
+// A batch slice is answered by one FRAME_RESULT holding the row0 products back to back
+
+struct frame {
+    int32_t kind;
+    int32_t index;      // Tile number in the grid
+    int32_t row0, col0; // Position of the tile in C
+    int32_t rows, cols;
+    int32_t inner;      // Shared dimension of the operands
+    uint32_t length;    // Payload bytes following the header
+};
+
+ssize_t read_full(int fd, void *buf, size_t size);
+int discard_full(int fd, size_t size);
+int write_full(int fd, const void *buf, size_t size);
+int send_frame(int fd, struct frame *f, const void *payload1, size_t len1, const void *payload2, size_t len2);
+int recv_frame(int fd, struct frame *f);
+
+#endif /* protocol_h */
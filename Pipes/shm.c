@@ -0,0 +1,52 @@
+//
+//  shm.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "shm.h"
+
+static size_t page_align(size_t size){
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+/**
+ Layout: [A | B | C], each part starting on a page boundary so the
+ inputs can be made read-only on their own.
+return:
+   0 on success
+  -1 on failure, errno set
+*/
+int shm_create(struct shm_region *region, size_t a_bytes, size_t b_bytes, size_t c_count){
+    size_t a_size = page_align(a_bytes + 1), b_size = page_align(b_bytes + 1);
+    
+    memset(region, 0, sizeof(*region));
+    region->size = a_size + b_size + page_align(c_count * sizeof(int));
+    
+    // Anonymous but shared: fork() hands the same pages to every worker
+    region->base = mmap(NULL, region->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+    if(region->base == MAP_FAILED){
+        region->base = NULL;
+        return -1;
+    }
+    
+    region->a = region->base;
+    region->b = region->base + a_size;
+    region->c = (int *) (region->base + a_size + b_size);
+    return 0;
+}
+
+// Worker side: inputs are only read, catch stray writes
+int shm_protect_inputs(struct shm_region *region){
+    return mprotect(region->base, (char *) region->c - region->base, PROT_READ);
+}
+
+void shm_destroy(struct shm_region *region){
+    if(region->base != NULL){
+        munmap(region->base, region->size);
+        region->base = NULL;
+    }
+}
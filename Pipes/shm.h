@@ -0,0 +1,29 @@
+//
+//  shm.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef shm_h
+#define shm_h
+
+#include "globals.h"
+/*
+ Shared memory region holding A, B and C for the shm transport.
+ Created before fork() so every worker inherits the same mapping.
+ */
+
+struct shm_region {
+    char *base;         // Start of the mapping, NULL when not created
+    size_t size;
+    char *a, *b;        // Inputs, read-only in the workers
+    int *c;             // Result, written in place by the workers
+};
+
+int shm_create(struct shm_region *region, size_t a_bytes, size_t b_bytes, size_t c_count);
+int shm_protect_inputs(struct shm_region *region);
+void shm_destroy(struct shm_region *region);
+
+#endif /* shm_h */
@@ -0,0 +1,179 @@
+//
+//  sock.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "sock.h"
+
+// socket() that is not inherited by the workers. SOCK_CLOEXEC is not
+// portable (macOS lacks it), so the flag is set afterwards.
+static int cloexec_socket(int domain, int type, int protocol){
+    int fd = socket(domain, type, protocol);
+    
+    if(fd != -1 && fcntl(fd, F_SETFD, FD_CLOEXEC) == -1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int unix_address(const char *path, struct sockaddr_un *addr){
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr->sun_path)){
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ Listening socket at path. A socket file left behind by a server that
+ did not exit cleanly is removed first.
+return:
+   the socket on success
+  -1 on failure, errno set
+*/
+int sock_listen_unix(const char *path){
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+    
+    if(unix_address(path, &addr) == -1)
+        return -1;
+    if(stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+    
+    fd = cloexec_socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1)
+        return -1;
+    if(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(fd, SOCK_BACKLOG) == -1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+return:
+   a socket connected to the server at path
+  -1 on failure, errno set
+*/
+int sock_connect_unix(const char *path){
+    struct sockaddr_un addr;
+    int fd;
+    
+    if(unix_address(path, &addr) == -1)
+        return -1;
+    fd = cloexec_socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1)
+        return -1;
+    if(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ Resolves "host:port", "[v6 address]:port", or for a passive socket a
+ bare "port" or "*:port" meaning every local address.
+return:
+   0 on success, the list in *res
+  -1 after reporting an address that does not resolve, errno set
+*/
+static int tcp_address(const char *address, int passive, struct addrinfo **res){
+    const char *colon = strrchr(address, ':'), *port = colon != NULL ? colon + 1 : address;
+    struct addrinfo hints;
+    char host[256] = "";
+    size_t length = colon != NULL ? (size_t) (colon - address) : 0;
+    int rc;
+    
+    if(length >= sizeof(host) || *port == '\0' || (colon == NULL && !passive)){
+        fprintf(stderr,"Address %s is not HOST:PORT\n", address);
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(host, address, length);
+    host[length] = '\0';
+    if(host[0] == '[' && length > 1 && host[length-1] == ']'){
+        memmove(host, host + 1, length - 2);
+        host[length-2] = '\0';
+    }
+    
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    rc = getaddrinfo(host[0] != '\0' && strcmp(host, "*") != 0 ? host : NULL, port, &hints, res);
+    if(rc != 0){
+        fprintf(stderr,"Address %s could not be resolved: %s\n", address, gai_strerror(rc));
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ Listening TCP socket on address, see tcp_address(). The port can be
+ taken again right after a previous listener exits.
+return:
+   the socket on success
+  -1 on failure, errno set
+*/
+int sock_listen_tcp(const char *address){
+    struct addrinfo *res, *ai;
+    int fd = -1, on = 1;
+    
+    if(tcp_address(address, 1, &res) == -1)
+        return -1;
+    for(ai = res; ai != NULL; ai = ai->ai_next){
+        fd = cloexec_socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd == -1)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if(bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOCK_BACKLOG) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+/**
+ Connects to the first address of host:port that answers, with Nagle
+ off: a frame is written whole and the other side waits for all of it.
+return:
+   the connected socket
+  -1 on failure, errno set
+*/
+int sock_connect_tcp(const char *address){
+    struct addrinfo *res, *ai;
+    int fd = -1;
+    
+    if(tcp_address(address, 0, &res) == -1)
+        return -1;
+    for(ai = res; ai != NULL; ai = ai->ai_next){
+        fd = cloexec_socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd == -1)
+            continue;
+        if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 && sock_nodelay(fd) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// Sends small frames at once instead of waiting to fill a segment
+int sock_nodelay(int fd){
+    int on = 1;
+    
+    return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
@@ -0,0 +1,32 @@
+//
+//  sock.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef sock_h
+#define sock_h
+
+#include "globals.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+/*
+ Stream sockets: local ones for the job server, TCP ones between the
+ parent and remote workers. Jobs, tiles and replies are the same frames
+ the workers use, see protocol.h.
+ */
+
+#define SOCK_BACKLOG 16 // Clients waiting while the server is busy with another
+
+int sock_listen_unix(const char *path);
+int sock_connect_unix(const char *path);
+int sock_listen_tcp(const char *address);
+int sock_connect_tcp(const char *address);
+int sock_nodelay(int fd);
+
+#endif /* sock_h */
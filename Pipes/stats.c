@@ -0,0 +1,85 @@
+//
+//  stats.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "stats.h"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+int stats_enabled;
+const char *counter_names[COUNTER_COUNT] = {"cycles", "instructions", "cache_misses"};
+
+#ifdef __linux__
+static const uint64_t counter_configs[COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+};
+#endif
+
+double stats_clock(void){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ Starts the hardware counters of the calling thread, user space only.
+ Each counter is its own event, so one the PMU lacks leaves the others
+ working; a VM without a PMU gives none, and neither does a system
+ without perf_event_open().
+ */
+#ifdef __linux__
+void counters_open(struct counters *c){
+    struct perf_event_attr attr;
+
+    for(int i = 0; i < COUNTER_COUNT; i++){
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = counter_configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        c->fd[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+}
+#else
+void counters_open(struct counters *c){
+    for(int i = 0; i < COUNTER_COUNT; i++)
+        c->fd[i] = -1;
+}
+#endif
+
+// Counts so far, -1 for a counter that is not open
+void counters_read(const struct counters *c, int64_t *events){
+    uint64_t value;
+
+    for(int i = 0; i < COUNTER_COUNT; i++){
+        events[i] = -1;
+        if(c->fd[i] != -1 && read(c->fd[i], &value, sizeof(value)) == sizeof(value))
+            events[i] = (int64_t) value;
+    }
+}
+
+void counters_close(struct counters *c){
+    for(int i = 0; i < COUNTER_COUNT; i++){
+        if(c->fd[i] != -1)
+            close(c->fd[i]);
+        c->fd[i] = -1;
+    }
+}
+
+// ", \"cycles\": N, ..." with null for the missing ones
+void stats_print_events(FILE *fp, const int64_t *events){
+    for(int i = 0; i < COUNTER_COUNT; i++){
+        if(events[i] < 0)
+            fprintf(fp, ", \"%s\": null", counter_names[i]);
+        else
+            fprintf(fp, ", \"%s\": %lld", counter_names[i], (long long) events[i]);
+    }
+}
@@ -0,0 +1,55 @@
+//
+//  stats.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef stats_h
+#define stats_h
+
+#include "globals.h"
+#include <stdint.h>
+/*
+ --stats: what each worker process or thread did, and hardware counters
+ from perf_event_open() where the kernel allows them. Counters count
+ user space only, the default perf_event_paranoid level permits that
+ without privileges. A counter that cannot be opened reads -1 and is
+ written as null.
+ */
+
+enum counter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_COUNT
+};
+
+// Counters of the calling thread, -1 for one that is not available
+struct counters {
+    int fd[COUNTER_COUNT];
+};
+
+// One worker process, the last frame it sends (FRAME_STATS) before it exits
+struct worker_stats {
+    int32_t pid;
+    int32_t tiles;          // Tiles, products or batch slices answered
+    double start, end;      // CLOCK_MONOTONIC seconds, worker_main() entry and exit
+    double wait_seconds;    // Blocked on the request pipe
+    double busy_seconds;    // Reading operands, multiplying and writing results
+    int64_t events[COUNTER_COUNT];
+    uint64_t bytes_sent;    // Filled in by the parent: request pipe bytes
+    uint64_t bytes_received; // Result pipe bytes
+};
+
+extern int stats_enabled;   // Set from --stats, threads and workers open their counters when it is
+extern const char *counter_names[COUNTER_COUNT];
+
+double stats_clock(void);
+void counters_open(struct counters *c);
+void counters_read(const struct counters *c, int64_t *events);
+void counters_close(struct counters *c);
+void stats_print_events(FILE *fp, const int64_t *events);
+
+#endif /* stats_h */
@@ -0,0 +1,133 @@
+//
+//  strassen.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "strassen.h"
+#include "kernel.h"
+
+// Quadrants are numbered 0: X11, 1: X12, 2: X21, 3: X22
+struct strassen_term {
+    int q1;             // Always added
+    int q2;             // Added with sign2, unused when sign2 is 0
+    int sign2;
+};
+
+static const struct strassen_term a_terms[STRASSEN_PRODUCTS] = {
+    {0, 3, 1}, {2, 3, 1}, {0, 0, 0}, {3, 0, 0}, {0, 1, 1}, {2, 0, -1}, {1, 3, -1}
+};
+static const struct strassen_term b_terms[STRASSEN_PRODUCTS] = {
+    {0, 3, 1}, {0, 0, 0}, {1, 3, -1}, {2, 0, -1}, {3, 0, 0}, {0, 1, 1}, {2, 3, 1}
+};
+// Sign of M1..M7 in C11, C12, C21, C22
+static const int c_signs[STRASSEN_PRODUCTS][4] = {
+    {1, 0, 0, 1}, {0, 0, 1, -1}, {0, 1, 0, 1}, {1, 0, 1, 0}, {-1, 1, 0, 0}, {0, 0, 0, 1}, {1, 0, 0, 0}
+};
+
+// out [hr x hc] = Xq1 + sign2 * Xq2 over the quadrants of x, one loop per sign so they vectorize
+#define SUM_QUADRANTS(suffix, type)                                                     \
+static void sum_quadrants_##suffix(const type *x, int ldx, int hr, int hc,              \
+                                   const struct strassen_term *term, int16_t *out){     \
+    const type *x1 = x + (size_t) (term->q1 / 2) * hr * ldx + (term->q1 % 2) * hc;      \
+    const type *x2 = x + (size_t) (term->q2 / 2) * hr * ldx + (term->q2 % 2) * hc;      \
+    int16_t *o;                                                                         \
+                                                                                        \
+    for(int i = 0; i < hr; i++, x1 += ldx, x2 += ldx){                                  \
+        o = out + (size_t) i*hc;                                                        \
+        if(term->sign2 == 0){                                                           \
+            for(int j = 0; j < hc; j++)                                                 \
+                o[j] = x1[j];                                                           \
+        }                                                                               \
+        else if(term->sign2 > 0){                                                       \
+            for(int j = 0; j < hc; j++)                                                 \
+                o[j] = x1[j] + x2[j];                                                   \
+        }                                                                               \
+        else{                                                                           \
+            for(int j = 0; j < hc; j++)                                                 \
+                o[j] = x1[j] - x2[j];                                                   \
+        }                                                                               \
+    }                                                                                   \
+}
+
+SUM_QUADRANTS(char, char)
+SUM_QUADRANTS(int16, int16_t)
+
+/**
+ Operands of M(index+1) from the char inputs, A is [2hm x 2hk] and B
+ [2hk x 2hn]. op1 receives [hm x hk] and op2 [hk x hn], both contiguous.
+ */
+void strassen_operands(const char *a, int lda, const char *b, int ldb, int hm, int hk, int hn,
+                       int index, int16_t *op1, int16_t *op2){
+    sum_quadrants_char(a, lda, hm, hk, &a_terms[index], op1);
+    sum_quadrants_char(b, ldb, hk, hn, &b_terms[index], op2);
+}
+
+// c quadrants += sign * M(index+1), product is [hm x hn] contiguous
+void strassen_accumulate(const int *product, int index, int hm, int hn, int *c, int ldc){
+    int *cq;
+    
+    for(int q = 0; q < 4; q++){
+        if(c_signs[index][q] == 0)
+            continue;
+        cq = c + (size_t) (q / 2) * hm * ldc + (q % 2) * hn;
+        for(int i = 0; i < hm; i++){
+            if(c_signs[index][q] > 0){
+                for(int j = 0; j < hn; j++)
+                    cq[(size_t) i*ldc + j] += product[(size_t) i*hn + j];
+            }
+            else{
+                for(int j = 0; j < hn; j++)
+                    cq[(size_t) i*ldc + j] -= product[(size_t) i*hn + j];
+            }
+        }
+    }
+}
+
+// depth counts the levels of sums in a and b, the operands of M1..M7 are at 1
+static void strassen_recurse(const int16_t *a, int lda, const int16_t *b, int ldb, int *c, int ldc,
+                             int m, int k, int n, int crossover, int depth){
+    int hm = m / 2, hk = k / 2, hn = n / 2;
+    int16_t *op1, *op2;
+    int *product;
+    
+    if(m <= crossover || k <= crossover || n <= crossover || m % 2 || k % 2 || n % 2 ||
+       depth == STRASSEN_DEPTH_MAX){
+        multiply_blocked_int16(a, lda, b, ldb, c, ldc, m, n, k);
+        return;
+    }
+    
+    op1 = malloc((size_t) hm * hk * sizeof(int16_t));
+    op2 = malloc((size_t) hk * hn * sizeof(int16_t));
+    product = malloc((size_t) hm * hn * sizeof(int));
+    if(op1 == NULL || op2 == NULL || product == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in strassen_multiply()\n");
+        _exit(EXIT_FAILURE);
+    }
+    
+    for(int i = 0; i < m; i++)
+        memset(c + (size_t) i*ldc, 0, n * sizeof(int));
+    
+    for(int p = 0; p < STRASSEN_PRODUCTS; p++){
+        sum_quadrants_int16(a, lda, hm, hk, &a_terms[p], op1);
+        sum_quadrants_int16(b, ldb, hk, hn, &b_terms[p], op2);
+        strassen_recurse(op1, hk, op2, hn, product, hn, hm, hk, hn, crossover, depth + 1);
+        strassen_accumulate(product, p, hm, hn, c, ldc);
+    }
+    
+    free(op1);
+    free(op2);
+    free(product);
+}
+
+/**
+ c [m x n] = a [m x k] . b [k x n] for operands from strassen_operands(),
+ recursing while every dimension is even and above the crossover, the
+ blocked kernel handles the rest.
+ */
+void strassen_multiply(const int16_t *a, int lda, const int16_t *b, int ldb, int *c, int ldc,
+                       int m, int k, int n, int crossover){
+    strassen_recurse(a, lda, b, ldb, c, ldc, m, k, n, crossover, 1);
+}
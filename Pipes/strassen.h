@@ -0,0 +1,41 @@
+//
+//  strassen.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef strassen_h
+#define strassen_h
+
+#include "globals.h"
+#include <stdint.h>
+/*
+ Strassen's seven products on the same quadrant split the workers use.
+ With A and B split into quadrants X11, X12, X21, X22:
+   M1 = (A11 + A22)(B11 + B22)    C11 = M1 + M4 - M5 + M7
+   M2 = (A21 + A22) B11           C12 = M3 + M5
+   M3 = A11 (B12 - B22)           C21 = M2 + M4
+   M4 = A22 (B21 - B11)           C22 = M1 - M2 + M3 + M6
+   M5 = (A11 + A12) B22
+   M6 = (A21 - A11)(B11 + B12)
+   M7 = (A12 - A22)(B21 + B22)
+ Everything stays in integers, so C matches the classical product exactly.
+ Each level of sums doubles the range of the operands: chars in
+ [-128, 127] become [-256, 255] in M1..M7, and eight levels still fit
+ int16, which the SIMD micro-kernels multiply. The recursion stops there
+ whatever the crossover.
+ */
+
+#define STRASSEN_PRODUCTS 7
+#define STRASSEN_CROSSOVER 256 // Below this the blocked kernel is faster
+#define STRASSEN_DEPTH_MAX 8    // Levels of sums of chars int16 holds
+
+void strassen_operands(const char *a, int lda, const char *b, int ldb, int hm, int hk, int hn,
+                       int index, int16_t *op1, int16_t *op2);
+void strassen_multiply(const int16_t *a, int lda, const int16_t *b, int ldb, int *c, int ldc,
+                       int m, int k, int n, int crossover);
+void strassen_accumulate(const int *product, int index, int hm, int hn, int *c, int ldc);
+
+#endif /* strassen_h */
@@ -0,0 +1,348 @@
+//
+//  stream.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "stream.h"
+#include "matrix.h"
+#include "tpool.h"
+#include "stats.h"
+
+// Buffers and the panel in flight of one stream_multiply()
+struct stream {
+    const struct stream_job *job;
+    int rows, cols;         // Panel sizes, the last ones of a row or column may be smaller
+    int row_panels;         // A panels per B panel
+    char *a[2];             // A panel buffers, unused when A is mapped
+    const char *a_panel[2]; // A panel of each slot, in its buffer or in the mapping
+    char *b;                // B panel buffer
+    const char *b_panel;    // [k x b_cols], in the buffer or, all of a mapped B, in the mapping
+    int b_cols;
+    int *c[2];              // C panels, [rows x b_cols] each
+    // Panel being multiplied, read by the tasks
+    int slot, task_rows;
+    // Helper thread: C panel `write` goes out, A panel `read` comes in, -1 for none
+    long write, read;
+    int status;
+    uint64_t bytes_read, bytes_written;
+};
+
+// Row and column of C where panel `step` starts, panels go down the rows first
+static void panel_origin(const struct stream *s, long step, int *row0, int *col0){
+    *row0 = (int) (step % s->row_panels) * s->rows;
+    *col0 = (int) (step / s->row_panels) * s->cols;
+}
+
+static int min_int(int a, int b){
+    return a < b ? a : b;
+}
+
+// madvise() of the pages under [p, p + size)
+static void advise(const char *p, size_t size, int advice){
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE), start = (uintptr_t) p & ~(page - 1);
+    
+    madvise((void *) start, (uintptr_t) p + size - start, advice);
+}
+
+// pread() of exactly size bytes, -1 on an error or a file that ends early
+static int pread_full(int fd, void *buf, size_t size, off_t offset){
+    ssize_t got;
+    
+    for(size_t done = 0; done < size; done += got){
+        got = pread(fd, (char *) buf + done, size - done, offset + done);
+        if(got == -1 && errno == EINTR){
+            got = 0;
+            continue;
+        }
+        if(got <= 0){
+            if(got == 0)
+                errno = EIO;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int pwrite_full(int fd, const void *buf, size_t size, off_t offset){
+    ssize_t put;
+    
+    for(size_t done = 0; done < size; done += put){
+        put = pwrite(fd, (const char *) buf + done, size - done, offset + done);
+        if(put == -1 && errno == EINTR){
+            put = 0;
+            continue;
+        }
+        if(put == -1)
+            return -1;
+    }
+    return 0;
+}
+
+// A raw text element is never '\0', same message as check_matrix() with the position in the whole matrix
+static int check_panel(const char *panel, size_t size, int cols, int row0, int col0){
+    const char *hole = memchr(panel, '\0', size);
+    long offset;
+    
+    if(hole == NULL)
+        return 0;
+    offset = hole - panel;
+    fprintf(stderr, "FATAL ERROR\nIndex ij out of range : (%ld, %ld)\n", row0 + offset / cols, col0 + offset % cols);
+    return -1;
+}
+
+/**
+ Brings the A rows of panel `step` into slot: read into its buffer, or
+ for a mapped A pointed at in place with the kernel asked to read the
+ pages ahead.
+return:
+   0 on success
+  -1 after reporting the failure
+*/
+static int load_a(struct stream *s, int slot, long step){
+    const struct stream_job *job = s->job;
+    int row0, col0, rows;
+    size_t size;
+    off_t offset;
+    
+    panel_origin(s, step, &row0, &col0);
+    rows = min_int(s->rows, job->m - row0);
+    size = (size_t) rows * job->k;
+    offset = job->a.offset + (off_t) row0 * job->k;
+    
+    if(job->a.map != NULL){
+        s->a_panel[slot] = job->a.map + offset;
+        advise(s->a_panel[slot], size, MADV_WILLNEED);
+    }
+    else{
+        if(pread_full(job->a.fd, s->a[slot], size, offset) == -1){
+            fprintf(stderr,"Rows %d to %d of A could not be read: %s\n", row0, row0 + rows - 1, strerror(errno));
+            return -1;
+        }
+        s->a_panel[slot] = s->a[slot];
+    }
+    s->bytes_read += size;
+    if(job->a.text && check_panel(s->a_panel[slot], size, job->k, row0, 0) == -1)
+        return -1;
+    return 0;
+}
+
+/**
+ Columns col0 on of B, as many as a panel holds. All of a mapped B is
+ used in place, anything narrower is gathered row by row.
+return:
+   0 on success
+  -1 after reporting the failure
+*/
+static int load_b(struct stream *s, int col0){
+    const struct stream_job *job = s->job;
+    int cols = min_int(s->cols, job->n - col0);
+    off_t offset;
+    
+    s->b_cols = cols;
+    s->b_panel = s->b;
+    if(job->b.map != NULL && cols == job->n)
+        s->b_panel = job->b.map + job->b.offset;
+    else if(cols == job->n){
+        if(pread_full(job->b.fd, s->b, (size_t) job->k * cols, job->b.offset) == -1){
+            fprintf(stderr,"B could not be read: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    else{
+        for(int i = 0; i < job->k; i++){
+            offset = job->b.offset + (off_t) i * job->n + col0;
+            if(job->b.map != NULL)
+                memcpy(s->b + (size_t) i * cols, job->b.map + offset, cols);
+            else if(pread_full(job->b.fd, s->b + (size_t) i * cols, cols, offset) == -1){
+                fprintf(stderr,"Row %d of B could not be read: %s\n", i, strerror(errno));
+                return -1;
+            }
+        }
+    }
+    s->bytes_read += (size_t) job->k * cols;
+    if(job->b.text && check_panel(s->b_panel, (size_t) job->k * cols, cols, 0, col0) == -1)
+        return -1;
+    return 0;
+}
+
+// C panel `step` from its slot to its place in the output, one write per row unless it is full width
+static int write_c(struct stream *s, int slot, long step){
+    const struct stream_job *job = s->job;
+    int row0, col0, rows, cols;
+    off_t offset;
+    
+    panel_origin(s, step, &row0, &col0);
+    rows = min_int(s->rows, job->m - row0);
+    cols = min_int(s->cols, job->n - col0);
+    for(int i = 0; i < rows; i += cols == job->n ? rows : 1){
+        offset = job->out_offset + ((off_t) (row0 + i) * job->n + col0) * sizeof(int);
+        if(pwrite_full(job->out_fd, s->c[slot] + (size_t) i * cols, (cols == job->n ? (size_t) rows : 1) * cols * sizeof(int), offset) == -1){
+            fprintf(stderr,"C could not be written: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    s->bytes_written += (size_t) rows * cols * sizeof(int);
+    return 0;
+}
+
+// Helper thread of one step: the previous C panel out, the next A panel in
+static void *stream_helper(void *arg){
+    struct stream *s = arg;
+    
+    s->status = 0;
+    if(s->write >= 0 && write_c(s, (int) (s->write % 2), s->write) == -1)
+        s->status = -1;
+    if(s->status == 0 && s->read >= 0 && load_a(s, (int) (s->read % 2), s->read) == -1)
+        s->status = -1;
+    return NULL;
+}
+
+// STREAM_TASK_ROWS rows of the current C panel
+static void stream_task(void *ctx, int index){
+    struct stream *s = ctx;
+    int r0 = index * STREAM_TASK_ROWS, rows = min_int(STREAM_TASK_ROWS, s->task_rows - r0);
+    
+    multiply_matrices(s->a_panel[s->slot] + (size_t) r0 * s->job->k, s->job->k, s->b_panel, s->b_cols,
+                      s->c[s->slot] + (size_t) r0 * s->b_cols, s->b_cols, rows, s->b_cols, s->job->k);
+}
+
+/**
+ Panel sizes for the budget: B whole when it takes no more than half
+ of it, else column panels of half the budget, then as many rows of A
+ and C as the rest holds twice over. Sizes are rounded to the kernel's
+ blocks when there is room.
+return:
+   0 on success
+  -1 when the budget cannot hold one row of A and C and one column of B
+*/
+int stream_plan(const struct stream_job *job, int *panel_rows, int *panel_cols){
+    size_t k = job->k, cols = job->n, rows, row_bytes;
+    
+    if(k * cols > job->budget / 2 || k * cols > STREAM_PANEL_MAX){
+        cols = (job->budget / 2 < STREAM_PANEL_MAX ? job->budget / 2 : STREAM_PANEL_MAX) / k;
+        if(cols >= 64)
+            cols -= cols % 64;
+    }
+    if(cols < 1 || k * cols >= job->budget)
+        return -1;
+    
+    row_bytes = 2 * k + 2 * cols * sizeof(int);
+    rows = (job->budget - k * cols) / row_bytes;
+    if(rows > (size_t) job->m)
+        rows = job->m;
+    if(rows * (k > cols * sizeof(int) ? k : cols * sizeof(int)) > STREAM_PANEL_MAX)
+        rows = STREAM_PANEL_MAX / (k > cols * sizeof(int) ? k : cols * sizeof(int));
+    if(rows >= STREAM_TASK_ROWS && rows < (size_t) job->m)
+        rows -= rows % STREAM_TASK_ROWS;
+    if(rows < 1)
+        return -1;
+    *panel_rows = (int) rows;
+    *panel_cols = (int) cols;
+    return 0;
+}
+
+/**
+ C = A x B panel by panel, see stream.h. The output file must already
+ be large enough, or be extended by the writes.
+return:
+   0 on success
+  -1 after reporting the failure
+*/
+int stream_multiply(const struct stream_job *job, struct stream_stats *stats){
+    struct stream s;
+    struct thread_job tasks;
+    pthread_t helper;
+    long steps;
+    int row0, col0, rc, status = 0;
+    double t;
+    
+    memset(&s, 0, sizeof(s));
+    memset(stats, 0, sizeof(*stats));
+    s.job = job;
+    if(stream_plan(job, &s.rows, &s.cols) == -1){
+        fprintf(stderr,"A memory budget of %zu bytes cannot hold a row of A and C and a column of B, at least %zu are needed\n",
+                job->budget, (size_t) job->k * 3 + 2 * sizeof(int));
+        return -1;
+    }
+    s.row_panels = (job->m + s.rows - 1) / s.rows;
+    steps = (long) s.row_panels * ((job->n + s.cols - 1) / s.cols);
+    
+    for(int i = 0; i < 2; i++){
+        s.a[i] = job->a.map == NULL ? malloc((size_t) s.rows * job->k) : NULL;
+        s.c[i] = malloc((size_t) s.rows * s.cols * sizeof(int));
+        if((job->a.map == NULL && s.a[i] == NULL) || s.c[i] == NULL)
+            status = -1;
+    }
+    s.b = job->b.map == NULL || s.cols < job->n ? malloc((size_t) job->k * s.cols) : NULL;
+    if(status == -1 || (s.b == NULL && (job->b.map == NULL || s.cols < job->n))){
+        fprintf(stderr, "Failed allocated memory : malloc() in stream_multiply()\n");
+        status = -1;
+        goto out;
+    }
+    stats->panel_rows = s.rows;
+    stats->panel_cols = s.cols;
+    
+    // The first panels have nothing to hide behind
+    t = stats_clock();
+    if(load_b(&s, 0) == -1 || load_a(&s, 0, 0) == -1){
+        status = -1;
+        goto out;
+    }
+    stats->wait_seconds += stats_clock() - t;
+    
+    tasks.ctx = &s;
+    tasks.run = stream_task;
+    for(long step = 0; step < steps; step++){
+        panel_origin(&s, step, &row0, &col0);
+        s.slot = (int) (step % 2);
+        s.task_rows = min_int(s.rows, job->m - row0);
+        s.write = step - 1;
+        s.read = step + 1 < steps ? step + 1 : -1;
+        if((rc = pthread_create(&helper, NULL, stream_helper, &s)) != 0){
+            fprintf(stderr, "pthread_create() in stream_multiply(): %s\n", strerror(rc));
+            status = -1;
+            break;
+        }
+        
+        t = stats_clock();
+        tasks.task_count = (s.task_rows + STREAM_TASK_ROWS - 1) / STREAM_TASK_ROWS;
+        if(tpool_run(job->threads, &tasks, NULL) == -1)
+            status = -1;
+        stats->multiply_seconds += stats_clock() - t;
+        
+        t = stats_clock();
+        pthread_join(helper, NULL);
+        if(status == -1 || s.status == -1){
+            status = -1;
+            break;
+        }
+        // Done with these rows until the next B panel, the page cache can have them back
+        if(job->a.map != NULL)
+            advise(s.a_panel[s.slot], (size_t) s.task_rows * job->k, MADV_DONTNEED);
+        // A new column of panels starts with its B, nothing to overlap it with
+        if(step + 1 < steps && (step + 1) % s.row_panels == 0 && load_b(&s, col0 + s.cols) == -1){
+            status = -1;
+            break;
+        }
+        stats->wait_seconds += stats_clock() - t;
+        stats->panels++;
+    }
+    // The last panel has no next step to go out with
+    t = stats_clock();
+    if(status == 0 && write_c(&s, (int) ((steps - 1) % 2), steps - 1) == -1)
+        status = -1;
+    stats->wait_seconds += stats_clock() - t;
+    stats->bytes_read = s.bytes_read;
+    stats->bytes_written = s.bytes_written;
+    
+out:
+    for(int i = 0; i < 2; i++){
+        free(s.a[i]);
+        free(s.c[i]);
+    }
+    free(s.b);
+    return status;
+}
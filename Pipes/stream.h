@@ -0,0 +1,59 @@
+//
+//  stream.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef stream_h
+#define stream_h
+
+#include "globals.h"
+#include <stdint.h>
+#include <pthread.h>
+/*
+ Out of core multiply: C = A x B with A, B and C on disk and only
+ panels of them in memory. B is taken in column panels as wide as the
+ budget allows (all of B when it fits); for each one, A is streamed in
+ row panels, and each C panel is written to its place in the output file.
+ Two A panels and two C panels take turns: while the threads multiply
+ one, a helper thread reads the next A panel and writes the previous C
+ panel. Only a new B panel is read with nothing to overlap, which
+ happens once per column panel.
+ */
+
+#define STREAM_BUDGET (256L << 20) // Default memory budget of --stream
+#define STREAM_TASK_ROWS 64     // Rows of a C panel per thread task, KERNEL_MC
+#define STREAM_PANEL_MAX (1L << 30) // Bytes of one panel, one pread() or pwrite() of it stays below INT_MAX as macOS needs
+
+struct stream_input {
+    int fd;
+    const char *map;    // The whole file with --ingest=mmap, panels are used in place; NULL to pread() them
+    off_t offset;       // Bytes to element (0, 0), past a binary header
+    int text;           // Raw text input, '\0' is not an element
+};
+
+struct stream_job {
+    struct stream_input a, b;
+    int m, k, n;        // A is [m x k], B is [k x n]
+    int out_fd;         // C as dense row major ints at out_offset
+    off_t out_offset;
+    size_t budget;      // Bytes for all panels together
+    int threads;        // Compute threads
+};
+
+// How a stream went, times are seconds of the calling thread
+struct stream_stats {
+    int panel_rows, panel_cols;
+    long panels;        // C panels written
+    double wait_seconds; // Blocked on reads and writes the helper had not finished, B panels included
+    double multiply_seconds;
+    uint64_t bytes_read;    // Panels of A and B, read or mapped
+    uint64_t bytes_written;
+};
+
+int stream_plan(const struct stream_job *job, int *panel_rows, int *panel_cols);
+int stream_multiply(const struct stream_job *job, struct stream_stats *stats);
+
+#endif /* stream_h */
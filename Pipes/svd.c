@@ -0,0 +1,785 @@
+//
+//  svd.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "svd.h"
+#include <float.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SVD_X86
+#endif
+
+// ============================================================= Column kernels
+
+static void dots_scalar(const double *x, const double *y, int len, double *p, double *q, double *r){
+    double p0 = 0.0, q0 = 0.0, r0 = 0.0, x0, y0;
+    
+    for (int i=0; i<len; i++) {
+        x0 = x[i]; y0 = y[i];
+        p0 += x0*y0; q0 += x0*x0; r0 += y0*y0;
+    }
+    *p = p0; *q = q0; *r = r0;
+}
+
+static void rotate_scalar(double *x, double *y, int len, double c0, double s0){
+    double d1, d2;
+    
+    for (int i=0; i<len; i++) {
+        d1 = x[i]; d2 = y[i];
+        x[i] = d1*c0+d2*s0; y[i] = -d1*s0+d2*c0;
+    }
+}
+
+static int always_supported(void){
+    return 1;
+}
+
+#ifdef SVD_X86
+static int avx2_supported(void){
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+// Four lanes per sum, two vectors per pass to hide the FMA latency
+__attribute__((target("avx2,fma")))
+static void dots_avx2(const double *x, const double *y, int len, double *p, double *q, double *r){
+    __m256d p0 = _mm256_setzero_pd(), q0 = p0, r0 = p0, p1 = p0, q1 = p0, r1 = p0, x0, y0, x1, y1;
+    double lanes[4], pt, qt, rt;
+    int i = 0;
+    
+    for (; i + 8 <= len; i += 8) {
+        x0 = _mm256_loadu_pd(x + i); y0 = _mm256_loadu_pd(y + i);
+        x1 = _mm256_loadu_pd(x + i + 4); y1 = _mm256_loadu_pd(y + i + 4);
+        p0 = _mm256_fmadd_pd(x0, y0, p0); q0 = _mm256_fmadd_pd(x0, x0, q0); r0 = _mm256_fmadd_pd(y0, y0, r0);
+        p1 = _mm256_fmadd_pd(x1, y1, p1); q1 = _mm256_fmadd_pd(x1, x1, q1); r1 = _mm256_fmadd_pd(y1, y1, r1);
+    }
+    dots_scalar(x + i, y + i, len - i, &pt, &qt, &rt);
+    _mm256_storeu_pd(lanes, _mm256_add_pd(p0, p1));
+    *p = lanes[0] + lanes[1] + lanes[2] + lanes[3] + pt;
+    _mm256_storeu_pd(lanes, _mm256_add_pd(q0, q1));
+    *q = lanes[0] + lanes[1] + lanes[2] + lanes[3] + qt;
+    _mm256_storeu_pd(lanes, _mm256_add_pd(r0, r1));
+    *r = lanes[0] + lanes[1] + lanes[2] + lanes[3] + rt;
+}
+
+__attribute__((target("avx2,fma")))
+static void rotate_avx2(double *x, double *y, int len, double c0, double s0){
+    __m256d c = _mm256_set1_pd(c0), s = _mm256_set1_pd(s0), d1, d2;
+    int i = 0;
+    
+    for (; i + 4 <= len; i += 4) {
+        d1 = _mm256_loadu_pd(x + i); d2 = _mm256_loadu_pd(y + i);
+        _mm256_storeu_pd(x + i, _mm256_fmadd_pd(d1, c, _mm256_mul_pd(d2, s)));
+        _mm256_storeu_pd(y + i, _mm256_fmsub_pd(d2, c, _mm256_mul_pd(d1, s)));
+    }
+    rotate_scalar(x + i, y + i, len - i, c0, s0);
+}
+#endif /* SVD_X86 */
+
+// Best first, scalar keeps the summation order of the original routine
+static const struct svd_variant svd_variants[] = {
+#ifdef SVD_X86
+    {"avx2", avx2_supported, dots_avx2, rotate_avx2},
+#endif
+    {"scalar", always_supported, dots_scalar, rotate_scalar},
+};
+static const struct svd_variant *svd_selected = &svd_variants[sizeof(svd_variants) / sizeof(svd_variants[0]) - 1];
+struct svd_counts svd_counts;
+
+/**
+ Picks the column kernels by name (--svd-kernel), "auto" for the widest
+ one this CPU runs. The vector ones sum in another order, so only
+ "scalar", the default, gives the digits of the original routine.
+return:
+   0 on success
+  -1 when the name is unknown or the CPU lacks the instructions
+*/
+int svd_select(const char *name){
+    int count = sizeof(svd_variants) / sizeof(svd_variants[0]);
+    
+    for(int i = 0; i < count; i++){
+        if((strcmp(name, "auto") == 0 || strcmp(name, svd_variants[i].name) == 0) && svd_variants[i].supported()){
+            svd_selected = &svd_variants[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *svd_kernel_name(void){
+    return svd_selected->name;
+}
+
+/**
+ One arena for the whole decomposition, column major: column j of
+ C (m rows) with column j of V (n rows) under it when vectors is set,
+ at A + j*ld. ld is rounded up so that every column starts on a
+ SVD_ALIGN boundary.
+return:
+   the workspace, free() it
+   NULL on failure
+*/
+double *svd_workspace(int m, int n, int vectors, int *ld){
+    size_t per = SVD_ALIGN / sizeof(double), size;
+    
+    *ld = (int) ((m + (vectors ? n : 0) + per - 1) / per * per);
+    size = (size_t) *ld * n * sizeof(double);
+    return aligned_alloc(SVD_ALIGN, size ? size : SVD_ALIGN);
+}
+
+// ============================================================= Serial
+
+/* svd.c: Perform a singular value decomposition A = USV' of an m x n matrix, m >= n.
+*
+* This routine has been adapted with permission from a Pascal implementation
+* (c) 1988 J. C. Nash, "Compact numerical methods for computers", Hilger 1990.
+* The A matrix must be pre-allocated with m+n rows and n columns, column major
+* with leading dimension ld (see svd_workspace()). On calling the matrix to be
+* decomposed is contained in the first m rows of A. On return the m first rows
+* of A contain the product US and the lower n rows contain V (not V'). The S2
+* vector returns the square of the singular values.
+* Without vectors A needs only the m rows, V is neither built nor rotated,
+* which halves the rotation work for a square C.
+*
+* (c) Copyright 1996 by Carl Edward Rasmussen. */
+void svd(double *A, int ld, double *S2, int m, int n, int vectors){
+    int  j, k, EstColRank = n, RotCount = n, SweepCount = 0, rows = vectors ? m+n : m;
+    long rotations = 0;
+    int slimit = (n<120) ? 30 : n/4;
+    double eps = 1e-15, e2 = 10.0*m*eps*eps, tol = 0.1*eps, vt, p, q, r, c0, s0;
+    double *x, *y;
+
+    for (j=0; j<n && vectors; j++) {
+        memset(A + (size_t) j*ld + m, 0, n * sizeof(double));
+        A[(size_t) j*ld + m + j] = 1.0;
+    }
+    // A single column has no pairs, the sweep below would never set its norm
+    if (n == 1) {
+        svd_selected->dots(A, A, m, &p, &q, &r);
+        S2[0] = q;
+        return;
+    }
+   
+    while (RotCount != 0 && SweepCount++ <= slimit) {
+        RotCount = EstColRank*(EstColRank-1)/2;
+        for (j=0; j<EstColRank-1; j++)
+            
+        for (k=j+1; k<EstColRank; k++) {
+            x = A + (size_t) j*ld; y = A + (size_t) k*ld;
+            svd_selected->dots(x, y, m, &p, &q, &r);
+            S2[j] = q; S2[k] = r;
+            if (q >= r) {
+                if (q<=e2*S2[0] || fabs(p)<=tol*q)
+                    RotCount--;
+                else {
+                    p /= q;
+                    r = 1.0-r/q;
+                    vt = sqrt(4.0*p*p+r*r);
+                    c0 = sqrt(0.5*(1.0+r/vt));
+                    s0 = p/(vt*c0);
+                    svd_selected->rotate(x, y, rows, c0, s0);
+                    rotations++;
+                }
+            }
+            else {
+                p /= r;
+                q = q/r-1.0;
+                vt = sqrt(4.0*p*p+q*q);
+                s0 = sqrt(0.5*(1.0-q/vt));
+                if (p<0.0) s0 = -s0;
+                c0 = p/(vt*s0);
+                svd_selected->rotate(x, y, rows, c0, s0);
+                rotations++;
+            }
+        }
+        while (EstColRank>2 && S2[EstColRank-1]<=S2[0]*tol+tol*tol) EstColRank--;
+    }
+    // The loop test counts one past the last sweep run when the limit is hit
+    svd_counts.sweeps += SweepCount <= slimit ? SweepCount : slimit + 1;
+    svd_counts.rotations += rotations;
+    if (SweepCount > slimit)
+        printf("Warning: Reached maximum number of sweeps (%d) in SVD routine...\n" ,slimit);
+}
+
+// ============================================================= Parallel
+
+/**
+ Barrier for the sweep steps. pthread_barrier_t is optional in POSIX and
+ macOS does not have it. The generation tells a woken thread that its
+ own round is over, not a later one.
+ */
+struct svd_barrier {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count, waiting;
+    unsigned long generation;
+};
+
+static void barrier_init(struct svd_barrier *b, int count){
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->cond, NULL);
+    b->count = count;
+    b->waiting = 0;
+    b->generation = 0;
+}
+
+static void barrier_wait(struct svd_barrier *b){
+    unsigned long generation;
+    
+    pthread_mutex_lock(&b->lock);
+    generation = b->generation;
+    if(++b->waiting == b->count){
+        b->waiting = 0;
+        b->generation++;
+        pthread_cond_broadcast(&b->cond);
+    }
+    else{
+        while(generation == b->generation)
+            pthread_cond_wait(&b->cond, &b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void barrier_destroy(struct svd_barrier *b){
+    pthread_cond_destroy(&b->cond);
+    pthread_mutex_destroy(&b->lock);
+}
+
+// State shared by the threads of one svd_parallel() call
+struct svd_shared {
+    double *A;
+    int ld;
+    double *S2;
+    int m, n;
+    int rows;           // Rows rotated, m+n with V and m without
+    int rank;           // EstColRank of svd(), trailing negligible columns are left out
+    int players;        // rank rounded up to even, column rank is a bye when it is odd
+    int steps;          // players-1 steps make a sweep, every pair meets once
+    int threads;
+    int slimit;
+    double e2, tol;
+    double big;         // Largest column norm at the start of the sweep
+    int done;
+    long *rotations;    // Per thread count of the current sweep
+    int *touched;       // Sweep in which each column was last rotated
+    int *order;         // Column permutation and scratch, for sorting between sweeps
+    int *scratch;
+    double *column;
+    struct svd_barrier barrier;
+};
+
+struct svd_thread {
+    struct svd_shared *s;
+    int id;
+};
+
+/**
+ Pair i of a round-robin step (circle method): column 0 stays in place
+ and the others turn around it, so each step holds players/2 disjoint
+ pairs and a sweep of players-1 steps meets every pair exactly once.
+ */
+static void round_robin_pair(int players, int step, int i, int *j, int *k){
+    int ring = players - 1;
+    int a = i == 0 ? 0 : 1 + (step + i) % ring;
+    int b = 1 + (step + ring - i) % ring;
+    
+    *j = a < b ? a : b;
+    *k = a < b ? b : a;
+}
+
+/**
+ Orthogonalizes columns j and k over U and V rows, with the same
+ negligible column and orthogonality tests as svd(). The rotation is
+ the smallest angle one: svd() also uses rotations to swap columns into
+ decreasing norm order, which takes many extra sweeps when the pairs
+ come round-robin, so here the columns are sorted between sweeps instead.
+return:
+   1 when the columns were rotated
+   0 when they are already orthogonal
+*/
+static int rotate_pair(double *A, int ld, double *S2, int m, int rows, int j, int k, double small, double tol){
+    double *x = A + (size_t) j*ld, *y = A + (size_t) k*ld, p, q, r, zeta, t, c0, s0;
+    
+    svd_selected->dots(x, y, m, &p, &q, &r);
+    S2[j] = q; S2[k] = r;
+    if ((q<=small && r<=small) || fabs(p)<=tol*(q >= r ? q : r))
+        return 0;
+    zeta = (r-q)/(2.0*p);
+    t = (zeta >= 0.0 ? 1.0 : -1.0)/(fabs(zeta)+sqrt(1.0+zeta*zeta));
+    c0 = 1.0/sqrt(1.0+t*t);
+    s0 = c0*t;
+    // x*c - y*s, x*s + y*c
+    svd_selected->rotate(x, y, rows, c0, -s0);
+    return 1;
+}
+
+// Puts the columns of A and S2 in decreasing norm order, as svd() leaves them
+static void sort_columns(struct svd_shared *s){
+    int i, j, c, moved = 0;
+    size_t bytes = (size_t) s->rows * sizeof(double);
+    
+    for(i = 0; i < s->n; i++)
+        s->order[i] = i;
+    // Nearly sorted after the first sweeps, insertion sort is linear then
+    for(i = 1; i < s->n; i++){
+        c = s->order[i];
+        for(j = i; j > 0 && s->S2[s->order[j-1]] < s->S2[c]; j--)
+            s->order[j] = s->order[j-1];
+        s->order[j] = c;
+        moved |= j != i;
+    }
+    if(!moved)
+        return;
+    for(j = 0; j < s->n; j++)
+        s->column[j] = s->S2[s->order[j]];
+    memcpy(s->S2, s->column, s->n * sizeof(double));
+    for(j = 0; j < s->n; j++)
+        s->scratch[j] = s->touched[s->order[j]];
+    memcpy(s->touched, s->scratch, s->n * sizeof(int));
+    
+    // Whole columns move, one cycle of the permutation at a time through the spare column
+    memset(s->scratch, 0, s->n * sizeof(int));
+    for(i = 0; i < s->n; i++){
+        if(s->scratch[i] || s->order[i] == i)
+            continue;
+        memcpy(s->column, s->A + (size_t) i*s->ld, bytes);
+        for(j = i; s->order[j] != i; j = s->order[j]){
+            memcpy(s->A + (size_t) j*s->ld, s->A + (size_t) s->order[j]*s->ld, bytes);
+            s->scratch[j] = 1;
+        }
+        memcpy(s->A + (size_t) j*s->ld, s->column, bytes);
+        s->scratch[j] = 1;
+    }
+}
+
+// Sweeps until one passes without a rotation, thread 0 decides between sweeps
+static void *svd_sweeps(void *arg){
+    struct svd_thread *t = arg;
+    struct svd_shared *s = t->s;
+    int j, k, sweep = 0;
+    long total, rotations;
+    
+    while(!s->done){
+        rotations = 0;
+        sweep++;
+        for(int step = 0; step < s->steps; step++){
+            for(int i = t->id; i < s->players / 2; i += s->threads){
+                round_robin_pair(s->players, step, i, &j, &k);
+                if(k >= s->rank)
+                    continue;
+                // Neither column moved since this pair was found orthogonal last sweep
+                if(s->touched[j] < sweep-1 && s->touched[k] < sweep-1)
+                    continue;
+                if(rotate_pair(s->A, s->ld, s->S2, s->m, s->rows, j, k, s->e2 * s->big, s->tol)){
+                    s->touched[j] = s->touched[k] = sweep;
+                    rotations++;
+                }
+            }
+            // Next step touches the same columns in other pairs
+            barrier_wait(&s->barrier);
+        }
+        s->rotations[t->id] = rotations;
+        barrier_wait(&s->barrier);
+        if(t->id == 0){
+            total = 0;
+            for(int i = 0; i < s->threads; i++)
+                total += s->rotations[i];
+            svd_counts.sweeps++;
+            svd_counts.rotations += total;
+            sort_columns(s);
+            s->big = s->S2[0];
+            if(total == 0)
+                s->done = 1;
+            else if(sweep > s->slimit)
+                s->done = -1;
+            while (s->rank>2 && s->S2[s->rank-1]<=s->S2[0]*s->tol+s->tol*s->tol) s->rank--;
+            s->players = s->rank + s->rank % 2;
+            s->steps = s->players - 1;
+        }
+        barrier_wait(&s->barrier);
+    }
+    return NULL;
+}
+
+/**
+ Same decomposition and layout as svd(): A has m+n rows (m without
+ vectors), C in the first m on entry, US and V on return, S2 the
+ squared singular values in decreasing order. Only the order and angle
+ of the rotations differ from svd(), the tests and sweep limit are the
+ same, so the values agree to rounding. threads is capped at n/2, the
+ pairs of one step.
+*/
+void svd_parallel(double *A, int ld, double *S2, int m, int n, int vectors, int threads){
+    struct svd_shared s;
+    struct svd_thread *t;
+    pthread_t *tid;
+    double eps = 1e-15;
+    int i, rc;
+    
+    if(threads > (n + 1) / 2)
+        threads = (n + 1) / 2;
+    if(threads < 2 || n < 3){
+        svd(A, ld, S2, m, n, vectors);
+        return;
+    }
+    
+    for (i=0; i<n && vectors; i++) {
+        memset(A + (size_t) i*ld + m, 0, n * sizeof(double));
+        A[(size_t) i*ld + m + i] = 1.0;
+    }
+    
+    memset(&s, 0, sizeof(s));
+    s.A = A; s.ld = ld; s.S2 = S2; s.m = m; s.n = n;
+    s.rows = vectors ? m+n : m;
+    s.rank = n;
+    s.players = n + n % 2;
+    s.steps = s.players - 1;
+    s.threads = threads;
+    s.slimit = (n<120) ? 30 : n/4;
+    s.e2 = 10.0*m*eps*eps;
+    s.tol = 0.1*eps;
+    // svd() compares against S2[0], the first column norm
+    for (i=0; i<m; i++)
+        s.big += A[i]*A[i];
+    
+    t = malloc(threads * sizeof(*t));
+    tid = malloc(threads * sizeof(*tid));
+    s.rotations = calloc(threads, sizeof(long));
+    s.touched = calloc(n, sizeof(int));
+    s.order = malloc(n * sizeof(int));
+    s.scratch = malloc(n * sizeof(int));
+    s.column = malloc((size_t) (m + n) * sizeof(double));
+    if(t == NULL || tid == NULL || s.rotations == NULL || s.touched == NULL ||
+       s.order == NULL || s.scratch == NULL || s.column == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in svd_parallel()\n");
+        exit(EXIT_FAILURE);
+    }
+    barrier_init(&s.barrier, threads);
+    
+    // This thread is thread 0
+    for(i = 1; i < threads; i++){
+        t[i].s = &s;
+        t[i].id = i;
+        if((rc = pthread_create(&tid[i], NULL, svd_sweeps, &t[i])) != 0){
+            fprintf(stderr, "pthread_create() in svd_parallel(): %s\n", strerror(rc));
+            exit(EXIT_FAILURE);
+        }
+    }
+    t[0].s = &s;
+    t[0].id = 0;
+    svd_sweeps(&t[0]);
+    for(i = 1; i < threads; i++)
+        pthread_join(tid[i], NULL);
+    
+    if (s.done == -1)
+        printf("Warning: Reached maximum number of sweeps (%d) in SVD routine...\n" ,s.slimit);
+    
+    barrier_destroy(&s.barrier);
+    free(s.rotations);
+    free(s.touched);
+    free(s.order);
+    free(s.scratch);
+    free(s.column);
+    free(tid);
+    free(t);
+}
+
+// ============================================================= Gram
+
+/**
+ Householder reduction of the symmetric n x n g (row major, destroyed)
+ to tridiagonal form: diagonal in d, e[i] couples i and i+1. Only the
+ values are kept, the reflections are not accumulated, and only the
+ lower triangle of g is read or updated. v and w hold n.
+ Once the trailing block falls below eps*|g| (Frobenius) its
+ eigenvalues are rounding noise, as for the negligible columns in
+ svd(), and it is left as zeros instead of reduced further.
+ */
+static void tridiagonalize(double *g, int n, double *d, double *e, double *v, double *w){
+    int i, j, k, len;
+    double norm, alpha, c, t, *b, rest = 0.0, tol;
+    
+    for (i=0; i<n; i++)
+        for (j=0; j<=i; j++)
+            rest += (i == j ? 1.0 : 2.0)*g[(size_t) i*n + j]*g[(size_t) i*n + j];
+    tol = DBL_EPSILON*DBL_EPSILON*rest;
+    
+    for (k=0; k<n-2; k++) {
+        if (k > 0 && rest <= tol) {
+            for (i=k; i<n; i++) d[i] = e[i] = 0.0;
+            return;
+        }
+        len = n-k-1;
+        b = g + (size_t) (k+1)*n + k+1;     // Trailing block, row stride n
+        norm = 0.0;
+        for (i=0; i<len; i++) {
+            v[i] = g[(size_t) (k+1+i)*n + k];
+            norm += v[i]*v[i];
+        }
+        norm = sqrt(norm);
+        d[k] = g[(size_t) k*n + k];
+        if (norm == 0.0) {
+            e[k] = 0.0;
+            continue;
+        }
+        alpha = v[0] > 0.0 ? -norm : norm;
+        e[k] = alpha;
+        // v = (x - alpha e1) / |x - alpha e1|
+        v[0] -= alpha;
+        c = sqrt(2.0*norm*(norm+fabs(v[0]+alpha)));
+        for (i=0; i<len; i++) v[i] /= c;
+        // B - 2(v w' + w v') with w = Bv - (v'Bv) v, B from its lower triangle
+        for (i=0; i<len; i++) w[i] = 0.0;
+        for (i=0; i<len; i++) {
+            t = 0.0;
+            for (j=0; j<i; j++) {
+                t += b[(size_t) i*n + j]*v[j];
+                w[j] += b[(size_t) i*n + j]*v[i];
+            }
+            w[i] += t + b[(size_t) i*n + i]*v[i];
+        }
+        c = 0.0;
+        for (i=0; i<len; i++) c += v[i]*w[i];
+        for (i=0; i<len; i++) w[i] -= c*v[i];
+        rest = 0.0;
+        for (i=0; i<len; i++) {
+            for (j=0; j<i; j++) {
+                t = b[(size_t) i*n + j] -= 2.0*(v[i]*w[j] + w[i]*v[j]);
+                rest += 2.0*t*t;
+            }
+            t = b[(size_t) i*n + i] -= 4.0*v[i]*w[i];
+            rest += t*t;
+        }
+    }
+    if (n > 1) {
+        d[n-2] = g[(size_t) (n-2)*n + n-2];
+        e[n-2] = g[(size_t) (n-1)*n + n-2];
+    }
+    d[n-1] = g[(size_t) (n-1)*n + n-1];
+    e[n-1] = 0.0;
+}
+
+/**
+ Eigenvalues of the symmetric tridiagonal (d, e) into d, implicit QL
+ with shifts from the leading 2 x 2, e is destroyed.
+return:
+   0 on success
+  -1 when an eigenvalue needs more than 60 iterations
+*/
+static int tridiagonal_ql(double *d, double *e, int n){
+    int l, mm, i, iter;
+    double g, r, s, c, p, f, b, scale = 0.0;
+    
+    // One scale for the whole matrix: against their neighbours alone the
+    // couplings of a cluster of near zero eigenvalues never look negligible
+    for (i=0; i<n; i++)
+        scale = fmax(scale, fabs(d[i])+fabs(e[i]));
+    for (l=0; l<n; l++) {
+        iter = 0;
+        do {
+            // Split off where e is negligible
+            for (mm=l; mm<n-1; mm++)
+                if (fabs(e[mm]) <= DBL_EPSILON*scale) break;
+            if (mm == l)
+                break;
+            if (iter++ == 60)
+                return -1;
+            g = (d[l+1]-d[l])/(2.0*e[l]);
+            r = hypot(g, 1.0);
+            g = d[mm]-d[l]+e[l]/(g+copysign(r, g));
+            s = c = 1.0;
+            p = 0.0;
+            for (i=mm-1; i>=l; i--) {
+                f = s*e[i]; b = c*e[i];
+                e[i+1] = r = hypot(f, g);
+                if (r == 0.0) {
+                    // Deflated early, start over on the smaller problem
+                    d[i+1] -= p;
+                    e[mm] = 0.0;
+                    break;
+                }
+                s = f/r; c = g/r;
+                g = d[i+1]-p;
+                r = (d[i]-g)*s+2.0*c*b;
+                p = s*r;
+                d[i+1] = g+p;
+                g = c*r-b;
+            }
+            if (r == 0.0 && i >= l)
+                continue;
+            d[l] -= p;
+            e[l] = g;
+            e[mm] = 0.0;
+        } while (mm != l);
+    }
+    return 0;
+}
+
+/**
+ Squared singular values of the m x n A (first m rows of the workspace,
+ left untouched) as the eigenvalues of A'A, in decreasing order.
+ Forming A'A costs n^2 m/2, the reduction at most 2n^3/3 and less when
+ A'A is rank deficient, far less than the Jacobi sweeps, but it squares
+ the condition number: values below roughly eps*S2[0] are rounding
+ noise, negative ones are clamped to 0.
+return:
+   0 on success
+  -1 on failure, S2 undefined
+*/
+int svd_values_gram(const double *A, int ld, double *S2, int m, int n){
+    double *g = calloc((size_t) n * n, sizeof(double));
+    double *e = malloc(3 * (size_t) n * sizeof(double));
+    double p, q, r, t;
+    int i, j, status;
+    
+    if(g == NULL || e == NULL){
+        free(g);
+        free(e);
+        return -1;
+    }
+    for (j=0; j<n; j++) {
+        for (i=j; i<n; i++) {
+            svd_selected->dots(A + (size_t) j*ld, A + (size_t) i*ld, m, &p, &q, &r);
+            g[(size_t) j*n + i] = g[(size_t) i*n + j] = p;
+        }
+    }
+    tridiagonalize(g, n, S2, e, e + n, e + 2*n);
+    status = tridiagonal_ql(S2, e, n);
+    
+    // Few values, insertion sort
+    for (i=0; i<n; i++) {
+        t = S2[i] < 0.0 ? 0.0 : S2[i];
+        for (j=i; j>0 && S2[j-1] < t; j--)
+            S2[j] = S2[j-1];
+        S2[j] = t;
+    }
+    free(g);
+    free(e);
+    return status;
+}
+
+// ============================================================= Top k
+
+// Reproducible standard normal samples, xorshift64* and Box-Muller
+static double gaussian(unsigned long long *state){
+    double u1, u2;
+    
+    do {
+        *state ^= *state >> 12; *state ^= *state << 25; *state ^= *state >> 27;
+        u1 = (double) ((*state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+    } while (u1 == 0.0);
+    *state ^= *state >> 12; *state ^= *state << 25; *state ^= *state >> 27;
+    u2 = (double) ((*state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+    return sqrt(-2.0*log(u1))*cos(2.0*M_PI*u2);
+}
+
+// Y[m x l] = A[m x n] X[n x l], all column major
+static void times(const double *A, int lda, const double *X, int ldx, double *Y, int ldy, int m, int n, int l){
+    for (int c=0; c<l; c++) {
+        double *y = Y + (size_t) c*ldy;
+        memset(y, 0, m * sizeof(double));
+        for (int j=0; j<n; j++) {
+            double t = X[(size_t) c*ldx + j];
+            const double *a = A + (size_t) j*lda;
+            for (int i=0; i<m; i++) y[i] += a[i]*t;
+        }
+    }
+}
+
+// X[n x l] = A'[n x m] Y[m x l]
+static void times_transposed(const double *A, int lda, const double *Y, int ldy, double *X, int ldx, int m, int n, int l){
+    double p, q, r;
+    
+    for (int c=0; c<l; c++)
+        for (int j=0; j<n; j++) {
+            svd_selected->dots(A + (size_t) j*lda, Y + (size_t) c*ldy, m, &p, &q, &r);
+            X[(size_t) c*ldx + j] = p;
+        }
+}
+
+// Modified Gram-Schmidt, twice for orthogonality to working precision. Dependent columns become 0
+static void orthonormalize(double *Y, int ld, int m, int l){
+    double p, before, after, r;
+    
+    for (int pass=0; pass<2; pass++)
+        for (int c=0; c<l; c++) {
+            double *y = Y + (size_t) c*ld;
+            svd_selected->dots(y, y, m, &before, &after, &r);
+            if (before == 0.0)
+                continue;
+            for (int b=0; b<c; b++) {
+                const double *x = Y + (size_t) b*ld;
+                svd_selected->dots(x, y, m, &p, &after, &r);
+                for (int i=0; i<m; i++) y[i] -= p*x[i];
+            }
+            svd_selected->dots(y, y, m, &after, &p, &r);
+            // Only rounding is left of this column, the range of A is smaller than l
+            if (after <= 1e-20*before) {
+                memset(y, 0, m * sizeof(double));
+                continue;
+            }
+            after = sqrt(after);
+            for (int i=0; i<m; i++) y[i] /= after;
+        }
+}
+
+/**
+ Leading k squared singular values of the m x n A (left untouched),
+ randomized range finder with power iterations: Q spans A(A'A)^i G for
+ a gaussian G with k + TOPK_OVERSAMPLE columns, and the values of the
+ small B' = A'Q come from svd(). Iterates until no value among the top
+ k moves by more than tol relative, each pass costs O(mnk) instead of
+ the O(mn^2) of a Jacobi sweep.
+return:
+   power iterations used, TOPK_MAX_ITER + 1 when tol was not reached
+  -1 on failure
+*/
+int svd_top_k(const double *A, int ld, double *S2, int m, int n, int k, double tol){
+    int l = k + TOPK_OVERSAMPLE, ldb, it, converged = 0;
+    double *Y, *Bt, *W, *values, change;
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+    
+    if (l > n) l = n;
+    Y = malloc((size_t) m * l * sizeof(double));
+    Bt = malloc((size_t) n * l * sizeof(double));
+    W = svd_workspace(n, l, 0, &ldb);
+    values = malloc(l * sizeof(double));
+    if (Y == NULL || Bt == NULL || W == NULL || values == NULL) {
+        free(Y); free(Bt); free(W); free(values);
+        return -1;
+    }
+    
+    // Sketch of the range, Bt holds G for the first product
+    for (size_t i=0; i<(size_t) n*l; i++)
+        Bt[i] = gaussian(&seed);
+    times(A, ld, Bt, n, Y, m, m, n, l);
+    orthonormalize(Y, m, m, l);
+    
+    for (it=1; ; it++) {
+        times_transposed(A, ld, Y, m, Bt, n, m, n, l);
+        for (int c=0; c<l; c++)
+            memcpy(W + (size_t) c*ldb, Bt + (size_t) c*n, n * sizeof(double));
+        svd(W, ldb, values, n, l, 0);
+        
+        if (it > 1) {
+            converged = 1;
+            for (int i=0; i<k && converged; i++) {
+                change = fabs(values[i]-S2[i]);
+                converged = change <= tol*values[i] || values[i] <= values[0]*DBL_EPSILON;
+            }
+        }
+        memcpy(S2, values, k * sizeof(double));
+        if (converged || it == TOPK_MAX_ITER)
+            break;
+        // One power iteration: Q = orth(A A'Q)
+        times(A, ld, Bt, n, Y, m, m, n, l);
+        orthonormalize(Y, m, m, l);
+    }
+    
+    free(Y); free(Bt); free(W); free(values);
+    return converged ? it : TOPK_MAX_ITER + 1;
+}
@@ -0,0 +1,54 @@
+//
+//  svd.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef svd_h
+#define svd_h
+
+#include "globals.h"
+#include <pthread.h>
+/*
+ One-sided Jacobi singular value decomposition of C.
+ svd() is the serial cyclic routine, svd_parallel() visits the same
+ column pairs in round-robin order so that every step is a set of
+ disjoint rotations, spread over threads sharing A.
+ A is one column major arena, so the column dot products and rotations
+ are unit stride loops with SIMD variants picked at startup.
+ V is only built when asked for, and svd_values_gram() gets the values
+ alone from the eigenvalues of C'C. svd_top_k() finds the leading few
+ values through a randomized sketch of the range of C.
+ */
+
+#define SVD_ALIGN 64    // Column alignment in the workspace, one cache line
+#define TOPK_OVERSAMPLE 8   // Extra sample columns, the top k converge faster with them
+#define TOPK_MAX_ITER 50    // Power iterations before svd_top_k() gives up on the tolerance
+
+// Inner loops of a rotation: p = x.y, q = x.x, r = y.y and x, y = x*c + y*s, y*c - x*s
+struct svd_variant {
+    const char *name;
+    int (*supported)(void);
+    void (*dots)(const double *x, const double *y, int len, double *p, double *q, double *r);
+    void (*rotate)(double *x, double *y, int len, double c, double s);
+};
+
+// Work done by the Jacobi routines since the counts were last zeroed, for --stats
+struct svd_counts {
+    int sweeps;         // Sweeps over the column pairs
+    long rotations;     // Rotations applied
+};
+
+extern struct svd_counts svd_counts;
+
+int svd_select(const char *name);
+const char *svd_kernel_name(void);
+double *svd_workspace(int m, int n, int vectors, int *ld);
+void svd(double *A, int ld, double *S2, int m, int n, int vectors);
+void svd_parallel(double *A, int ld, double *S2, int m, int n, int vectors, int threads);
+int svd_values_gram(const double *A, int ld, double *S2, int m, int n);
+int svd_top_k(const double *A, int ld, double *S2, int m, int n, int k, double tol);
+
+#endif /* svd_h */
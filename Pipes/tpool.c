@@ -0,0 +1,178 @@
+//
+//  tpool.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "tpool.h"
+
+/*
+ No task creates new tasks, so a deque is just the range [lo, hi) of
+ task indices still to run. The owner takes lo, thieves cut off the top.
+ Each deque sits on its own cache line.
+ */
+struct deque {
+    pthread_mutex_t lock;
+    int lo, hi;
+} __attribute__((aligned(64)));
+
+struct tpool {
+    int count;
+    struct deque *deques;
+    struct thread_job *job;
+    struct thread_stats *stats;
+};
+
+struct tpool_thread {
+    struct tpool *pool;
+    int id;
+};
+
+// Next task of the thread's own deque, -1 when it is empty
+static int deque_take(struct deque *d){
+    int index = -1;
+    
+    pthread_mutex_lock(&d->lock);
+    if(d->lo < d->hi)
+        index = d->lo++;
+    pthread_mutex_unlock(&d->lock);
+    return index;
+}
+
+/**
+ Moves the back half of the fullest other deque into the empty deque
+ of thread id. Sizes are read without the locks to pick a victim, the
+ cut itself is made under the victim's lock.
+return:
+   tasks stolen, 0 when every deque is empty
+*/
+static int deque_steal(struct tpool *pool, int id){
+    struct deque *victim, *own = &pool->deques[id];
+    int best, size, lo, hi;
+    
+    for(;;){
+        victim = NULL;
+        best = 0;
+        for(int i = 1; i < pool->count; i++){
+            struct deque *d = &pool->deques[(id + i) % pool->count];
+            size = d->hi - d->lo;
+            if(size > best){
+                best = size;
+                victim = d;
+            }
+        }
+        if(victim == NULL)
+            return 0;
+        
+        pthread_mutex_lock(&victim->lock);
+        size = victim->hi - victim->lo;
+        hi = victim->hi;
+        lo = hi - (size + 1) / 2;
+        if(size > 0)
+            victim->hi = lo;
+        pthread_mutex_unlock(&victim->lock);
+        
+        // Someone else got there first, look again
+        if(size <= 0)
+            continue;
+        pthread_mutex_lock(&own->lock);
+        own->lo = lo;
+        own->hi = hi;
+        pthread_mutex_unlock(&own->lock);
+        return hi - lo;
+    }
+}
+
+static void *tpool_worker(void *arg){
+    struct tpool_thread *t = arg;
+    struct tpool *pool = t->pool;
+    struct thread_stats *stats = &pool->stats[t->id];
+    double start = stats_clock();
+    struct counters counters;
+    int index, got;
+    
+    if(stats_enabled)
+        counters_open(&counters);
+    for(;;){
+        while((index = deque_take(&pool->deques[t->id])) != -1){
+            pool->job->run(pool->job->ctx, index);
+            stats->tasks++;
+        }
+        if((got = deque_steal(pool, t->id)) == 0)
+            break;
+        stats->steals++;
+        stats->stolen += got;
+    }
+    stats->seconds = stats_clock() - start;
+    for(int i = 0; i < COUNTER_COUNT; i++)
+        stats->events[i] = -1;
+    if(stats_enabled){
+        counters_read(&counters, stats->events);
+        counters_close(&counters);
+    }
+    return NULL;
+}
+
+/**
+ Runs every task of the job on `threads` threads, the calling thread
+ being one of them, and returns when all are done. stats, when not
+ NULL, gets one entry per thread.
+return:
+   0 on success
+  -1 when the threads could not be set up, no task was run
+*/
+int tpool_run(int threads, struct thread_job *job, struct thread_stats *stats){
+    struct tpool pool;
+    struct tpool_thread *t;
+    pthread_t *tid;
+    int rc, i, status = 0;
+    
+    if(threads > job->task_count)
+        threads = job->task_count;
+    if(threads < 1)
+        threads = 1;
+    
+    pool.count = threads;
+    pool.job = job;
+    pool.deques = aligned_alloc(64, threads * sizeof(struct deque));
+    pool.stats = calloc(threads, sizeof(struct thread_stats));
+    t = malloc(threads * sizeof(*t));
+    tid = malloc(threads * sizeof(*tid));
+    if(pool.deques == NULL || pool.stats == NULL || t == NULL || tid == NULL){
+        fprintf(stderr, "Failed allocated memory : malloc() in tpool_run()\n");
+        status = -1;
+        goto out;
+    }
+    // Contiguous slices, neighbouring tiles share rows of A and columns of B
+    for(i = 0; i < threads; i++){
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].lo = (int) ((long) i * job->task_count / threads);
+        pool.deques[i].hi = (int) ((long) (i+1) * job->task_count / threads);
+        t[i].pool = &pool;
+        t[i].id = i;
+    }
+    
+    for(i = 1; i < threads; i++){
+        if((rc = pthread_create(&tid[i], NULL, tpool_worker, &t[i])) != 0){
+            fprintf(stderr, "pthread_create() in tpool_run(): %s\n", strerror(rc));
+            break;
+        }
+    }
+    // Threads that did not start leave their slice to be stolen
+    tpool_worker(&t[0]);
+    while(--i >= 1)
+        pthread_join(tid[i], NULL);
+    
+    for(i = 0; i < threads; i++)
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    if(stats != NULL)
+        memcpy(stats, pool.stats, threads * sizeof(struct thread_stats));
+out:
+    free(pool.deques);
+    free(pool.stats);
+    free(t);
+    free(tid);
+    return status;
+}
@@ -0,0 +1,42 @@
+//
+//  tpool.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef tpool_h
+#define tpool_h
+
+#include "globals.h"
+#include "stats.h"
+#include <pthread.h>
+/*
+ Thread backend: tasks run on threads of this process and write their
+ results in place, nothing is copied between address spaces.
+ Every thread starts with a contiguous slice of the tasks in its own
+ deque and works through it from the front. A thread whose deque runs
+ dry steals the back half of the fullest one, so uneven tiles and
+ uneven cores even out without a central queue.
+ */
+
+// A set of independent tasks, run(ctx, index) once for every index
+struct thread_job {
+    int task_count;
+    void *ctx;
+    void (*run)(void *ctx, int index);
+};
+
+// What one thread did, for the report after a run
+struct thread_stats {
+    int tasks;          // Tasks run
+    int steals;         // Successful steals
+    int stolen;         // Tasks taken in those steals
+    double seconds;     // From start to running out of tasks
+    int64_t events[COUNTER_COUNT]; // Hardware counters of the thread under --stats, -1 otherwise
+};
+
+int tpool_run(int threads, struct thread_job *job, struct thread_stats *stats);
+
+#endif /* tpool_h */
@@ -0,0 +1,199 @@
+//
+//  writer.c
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#include "writer.h"
+#include "protocol.h"
+
+void writer_init(struct writer *w, int fd){
+    memset(w, 0, sizeof(*w));
+    w->fd = fd;
+}
+
+/**
+ Room for size more bytes at the end of the buffer. A buffer past
+ WRITER_FLUSH_BYTES is written out first rather than grown further.
+return:
+   where the next bytes go, ends the program when memory runs out
+*/
+char *writer_reserve(struct writer *w, size_t size){
+    size_t capacity;
+    char *data;
+    
+    if(w->length + size <= w->capacity)
+        return w->data + w->length;
+    if(w->length >= WRITER_FLUSH_BYTES && writer_flush(w) == -1){
+        perror("Write error : writer_reserve()\n");
+        exit(EXIT_FAILURE);
+    }
+    capacity = w->capacity ? w->capacity : WRITER_INITIAL;
+    while(capacity < w->length + size)
+        capacity *= 2;
+    if(capacity != w->capacity){
+        data = realloc(w->data, capacity);
+        if(data == NULL){
+            fprintf(stderr, "Failed allocated memory : malloc() in writer_reserve()\n");
+            exit(EXIT_FAILURE);
+        }
+        w->data = data;
+        w->capacity = capacity;
+    }
+    return w->data + w->length;
+}
+
+void writer_text(struct writer *w, const char *text){
+    size_t size = strlen(text);
+    
+    memcpy(writer_reserve(w, size), text, size);
+    w->length += size;
+}
+
+void writer_char(struct writer *w, char c){
+    *writer_reserve(w, 1) = c;
+    w->length++;
+}
+
+// Same digits as printf("%ld") from p on, returns the end
+static char *format_int(char *p, long value){
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[24], *d = digits + sizeof(digits);
+    unsigned long u = value < 0 ? 0UL - (unsigned long) value : (unsigned long) value;
+    size_t count;
+    
+    // Two digits per division
+    while(u >= 100){
+        d -= 2;
+        memcpy(d, pairs + (u % 100) * 2, 2);
+        u /= 100;
+    }
+    if(u >= 10){
+        d -= 2;
+        memcpy(d, pairs + u * 2, 2);
+    }
+    else
+        *--d = (char) ('0' + u);
+    if(value < 0)
+        *p++ = '-';
+    count = digits + sizeof(digits) - d;
+    memcpy(p, d, count);
+    return p + count;
+}
+
+void writer_int(struct writer *w, long value){
+    char *end = format_int(writer_reserve(w, 24), value);
+    
+    w->length = end - w->data;
+}
+
+// Every value followed by sep, the last one by end, in one reservation
+void writer_int_row(struct writer *w, const int *values, int count, const char *sep, const char *end){
+    size_t sep_size = strlen(sep), end_size = strlen(end);
+    char *p = writer_reserve(w, (size_t) count * (12 + sep_size) + end_size);
+    
+    for(int i = 0; i < count; i++){
+        p = format_int(p, values[i]);
+        memcpy(p, i < count - 1 ? sep : end, i < count - 1 ? sep_size : end_size);
+        p += i < count - 1 ? sep_size : end_size;
+    }
+    w->length = p - w->data;
+}
+
+// writer_int_row() of int64 values
+void writer_long_row(struct writer *w, const int64_t *values, int count, const char *sep, const char *end){
+    size_t sep_size = strlen(sep), end_size = strlen(end);
+    char *p = writer_reserve(w, (size_t) count * (21 + sep_size) + end_size);
+    
+    for(int i = 0; i < count; i++){
+        p = format_int(p, values[i]);
+        memcpy(p, i < count - 1 ? sep : end, i < count - 1 ? sep_size : end_size);
+        p += i < count - 1 ? sep_size : end_size;
+    }
+    w->length = p - w->data;
+}
+
+// Every char and a space, then a newline: "%c " or "%d " per element
+void writer_char_row(struct writer *w, const char *values, int count, int ascii){
+    char *p = writer_reserve(w, (size_t) count * (ascii ? 2 : 5) + 1);
+    
+    for(int i = 0; i < count; i++){
+        if(ascii)
+            *p++ = values[i];
+        else
+            p = format_int(p, values[i]);
+        *p++ = ' ';
+    }
+    *p++ = '\n';
+    w->length = p - w->data;
+}
+
+/**
+ Same text as printf("%.3f"). The fraction is scaled by 1000 and
+ rounded, which is exact unless it lands next to a half; there, and
+ for values too large or not finite, printf() itself decides.
+ */
+void writer_fixed3(struct writer *w, double value){
+    double whole, scaled, thousandths, rest;
+    char *p;
+    int count;
+    
+    if(!isfinite(value) || fabs(value) >= 1e15){
+        p = writer_reserve(w, 512);
+        count = snprintf(p, 512, "%.3f", value);
+        w->length += count;
+        return;
+    }
+    whole = floor(fabs(value));
+    scaled = (fabs(value) - whole) * 1000.0;
+    thousandths = floor(scaled);
+    rest = scaled - thousandths;
+    if(fabs(rest - 0.5) < 1e-6){
+        p = writer_reserve(w, 32);
+        count = snprintf(p, 32, "%.3f", value);
+        w->length += count;
+        return;
+    }
+    if(rest > 0.5 && ++thousandths == 1000.0){
+        thousandths = 0.0;
+        whole += 1.0;
+    }
+    // -0.000 for a negative value that rounds to zero, as printf() does
+    if(signbit(value))
+        writer_char(w, '-');
+    writer_int(w, (long) whole);
+    p = writer_reserve(w, 4);
+    count = (int) thousandths;
+    p[0] = '.';
+    p[1] = (char) ('0' + count / 100);
+    p[2] = (char) ('0' + count / 10 % 10);
+    p[3] = (char) ('0' + count % 10);
+    w->length += 4;
+}
+
+/**
+ Writes out what is buffered, after anything still in stdio's buffer
+ so the two keep their order.
+return:
+   0 on success
+  -1 on error, errno set
+*/
+int writer_flush(struct writer *w){
+    int status;
+    
+    fflush(stdout);
+    status = write_full(w->fd, w->data, w->length);
+    w->length = 0;
+    return status;
+}
+
+void writer_free(struct writer *w){
+    free(w->data);
+    w->data = NULL;
+    w->length = w->capacity = 0;
+}
@@ -0,0 +1,43 @@
+//
+//  writer.h
+//  Pipes
+//
+//  Created by Muhammed Okumuş on 18.04.2020.
+//  Copyright © 2020 Muhammed Okumuş. All rights reserved.
+//
+
+#ifndef writer_h
+#define writer_h
+
+#include "globals.h"
+#include <stdint.h>
+/*
+ Buffered text output. Matrices are formatted into one growing buffer
+ with hand-rolled integer and %.3f conversions, then written with a
+ single write() instead of one printf() per element. The text is byte
+ for byte what printf() would have produced.
+ */
+
+#define WRITER_INITIAL (64 * 1024)          // First buffer, grown by doubling
+#define WRITER_FLUSH_BYTES (16 * 1024 * 1024) // Written out early past this, bounds the buffer for huge matrices
+
+struct writer {
+    int fd;
+    char *data;
+    size_t length;      // Bytes waiting to be written
+    size_t capacity;
+};
+
+void writer_init(struct writer *w, int fd);
+char *writer_reserve(struct writer *w, size_t size);
+void writer_text(struct writer *w, const char *text);
+void writer_char(struct writer *w, char c);
+void writer_int(struct writer *w, long value);
+void writer_int_row(struct writer *w, const int *values, int count, const char *sep, const char *end);
+void writer_long_row(struct writer *w, const int64_t *values, int count, const char *sep, const char *end);
+void writer_char_row(struct writer *w, const char *values, int count, int ascii);
+void writer_fixed3(struct writer *w, double value);
+int writer_flush(struct writer *w);
+void writer_free(struct writer *w);
+
+#endif /* writer_h */